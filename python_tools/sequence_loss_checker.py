@@ -0,0 +1,248 @@
+# -*- coding: utf-8 -*-
+# sequence_loss_checker.py
+# Written for python 3.11
+#
+# Every touch pad message published by a device carries a per-device sequence number
+# in the MQTT5 user property "seq". The device only uses up a sequence number once the
+# message is in its MQTT outbox, so any gap seen here is a message lost after that point.
+# The sequence runs on across deep sleep, and starts over at 0 at any other boot under
+# a new "epoch" (user property), so the sequences are told apart by (epoch, seq).
+#
+# Setup:
+# python3 -m venv .venv
+# source .venv/bin/activate
+# pip3 install --upgrade pip
+# pip3 install -r requirements.txt
+#
+import asyncio
+import aiomqtt
+import argparse
+from dataclasses import dataclass
+import logging
+from pprint import pformat
+
+import soilmoisture_config_utils as secure_connection_config
+
+logger = logging.getLogger('sequence_loss_checker')
+ACTIVE_CERTIFICATES_FILENAME = 'active_certificates.vars'
+DEFAULT_TOPIC = 'soilmoisture/+/touchpad/+'
+DEFAULT_REPORT_INTERVAL = 60  # seconds
+
+# Without an "epoch" (older devices), a sequence number this far below the expected one
+# is taken as a device restart (the sequence restarts at 0 on every boot) rather than a late arrival.
+RESTART_WINDOW = 1000
+
+
+
+#-------------------------------------------------------------------------------
+@dataclass
+class SequenceStats:
+    received: int = 0
+    lost: int = 0
+    late: int = 0
+    restarts: int = 0
+    expected: int | None = None
+    epoch: str | None = None
+
+    def loss_rate(self) -> float:
+        total = self.received + self.lost
+        return self.lost / total if total else 0.0
+
+
+
+#-------------------------------------------------------------------------------
+class SequenceLossTracker:
+    """
+    Compute gap (loss) rates from the per-device sequence number stream.
+    """
+
+    def __init__(self, restart_window=RESTART_WINDOW):
+        self.restart_window = restart_window
+        self.devices = {}
+
+
+    def add(self, device_id: str, seq: int, epoch: str | None = None) -> SequenceStats:
+        stats = self.devices.setdefault(device_id, SequenceStats())
+
+        if stats.expected is None:
+            # First message seen from this device.
+            pass
+        elif epoch is not None and epoch != stats.epoch:
+            # The device restarted. The messages of the new epoch before this one were lost.
+            stats.restarts += 1
+            stats.lost += seq
+        elif seq == stats.expected:
+            pass
+        elif seq > stats.expected:
+            # The messages in between were lost.
+            stats.lost += seq - stats.expected
+        elif seq == 0 or stats.expected - seq > self.restart_window:
+            # The device restarted.
+            stats.restarts += 1
+        else:
+            # A message that was previously counted as lost arrived late.
+            stats.late += 1
+            stats.received += 1
+            if stats.lost > 0:
+                stats.lost -= 1
+            return stats
+
+        stats.received += 1
+        stats.expected = seq + 1
+        if epoch is not None:
+            stats.epoch = epoch
+        return stats
+
+
+    def report(self) -> str:
+        lines = []
+        for device_id, stats in sorted(self.devices.items()):
+            lines.append(
+                f'{device_id}: received={stats.received}, lost={stats.lost}, late={stats.late}'
+                f', restarts={stats.restarts}, loss_rate={stats.loss_rate():.2%}'
+            )
+        return '\n'.join(lines)
+
+
+
+def get_user_property(mqtt_message, name):
+    """
+    Return the value of the MQTT5 user property 'name', or None.
+    """
+    properties = getattr(mqtt_message, 'properties', None)
+    user_properties = getattr(properties, 'UserProperty', None) or []
+    for key, value in user_properties:
+        if key == name:
+            return value
+    return None
+
+
+def get_sequence_number(mqtt_message):
+    """
+    Return the value of the MQTT5 user property "seq", or None.
+    """
+    value = get_user_property(mqtt_message, 'seq')
+    try:
+        return int(value) if value is not None else None
+    except ValueError:
+        return None
+
+
+
+#-------------------------------------------------------------------------------
+class CheckMqttSequences:
+    """
+    """
+
+    def __init__(self, args):
+        """
+        args is the Command Line Arguments.
+        """
+        self.args = args
+        self.tracker = SequenceLossTracker()
+
+        self.secure_conn_vars = secure_connection_config.read_config_file(self.args)
+        self.active_certificates = secure_connection_config.get_active_certificates_vars(self.secure_conn_vars)
+        self.certs_dir = secure_connection_config.get_active_certificates_dir(self.active_certificates)
+        self.connection_parameters = secure_connection_config.get_connection_parameters(
+            self.secure_conn_vars,
+            self.certs_dir,
+            mqtt_protocol=aiomqtt.ProtocolVersion.V5
+        )
+
+        self.tls_params = aiomqtt.TLSParameters(
+            ca_certs = self.connection_parameters['tls_params']['ca_certs'],
+            certfile = self.connection_parameters['tls_params']['certfile'],
+            keyfile = self.connection_parameters['tls_params']['keyfile'],
+            cert_reqs = self.connection_parameters['tls_params']['cert_reqs'],
+            tls_version = self.connection_parameters['tls_params']['tls_version'],
+        )
+
+        self.hostname = self.connection_parameters['hostname']
+        self.port = self.connection_parameters['port']
+        self.protocol = self.connection_parameters['protocol']
+        self.mqtt_topic = self.args.topic
+
+
+    def __repr__(self) -> str:
+        tmp = {
+            'hostname': self.hostname,
+            'port': self.port,
+            'tls_params': self.tls_params,
+            'protocol': self.protocol,
+            'mqtt_topic': self.mqtt_topic,
+        }
+        return pformat(tmp)
+
+
+    async def listen_for_sequence_numbers(self):
+        """
+        """
+        logger.info(f'listen_for_sequence_numbers()\n{self}\n')
+
+        async with aiomqtt.Client(
+            hostname=self.hostname,
+            port=self.port,
+            tls_params=self.tls_params,
+            protocol=self.protocol
+        ) as client:
+            await client.subscribe(self.mqtt_topic)
+            async for message in client.messages:
+                seq = get_sequence_number(message)
+                if seq is None:
+                    logger.debug(f'no sequence number: {message.topic.value}')
+                    continue
+                # topic: soilmoisture/<device-id>/touchpad/<sensor-id>
+                device_id = message.topic.value.split('/')[1]
+                self.tracker.add(device_id, seq, get_user_property(message, 'epoch'))
+
+
+    async def report_periodically(self):
+        """
+        """
+        while True:
+            await asyncio.sleep(self.args.interval)
+            print(self.tracker.report(), flush=True)
+
+
+    async def start(self):
+        """
+        """
+        async with asyncio.TaskGroup() as task_group:
+            task_group.create_task(self.listen_for_sequence_numbers())
+            task_group.create_task(self.report_periodically())
+
+
+
+#-------------------------------------------------------------------------------
+def commandLineArgs():
+    parser = argparse.ArgumentParser(
+            description='Compute message gap/loss rates from the "seq" user property of soil moisture messages.'
+        )
+    parser.add_argument("--active", default=ACTIVE_CERTIFICATES_FILENAME,  help="Active Certificates Filename. (default: %(default)s)")
+    parser.add_argument("--topic", default=DEFAULT_TOPIC,  help="MQTT Topic to subscribe to. (default: %(default)s)")
+    parser.add_argument("--interval", type=int, default=DEFAULT_REPORT_INTERVAL,  help="Report interval in seconds. (default: %(default)s)")
+    parser.add_argument("--debug", action="store_true", help="Run in debug mode.")
+    return parser.parse_args()
+
+
+def main(args) -> None:
+    """
+    """
+    check_mqtt_sequences = CheckMqttSequences(args)
+
+    if args.debug:
+        asyncio.run(check_mqtt_sequences.start(), debug=True)
+    else:
+        asyncio.run(check_mqtt_sequences.start())
+
+
+
+#-------------------------------------------------------------------------------
+if __name__ == "__main__":
+    args = commandLineArgs()
+    if args.debug:
+        logging.basicConfig(level=logging.DEBUG)
+    else:
+        logging.basicConfig(level=logging.INFO)
+    main(args)
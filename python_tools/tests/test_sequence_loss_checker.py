@@ -0,0 +1,105 @@
+# -*- coding: utf-8 -*-
+# tests/test_sequence_loss_checker.py
+#
+# To run tests:
+# python3 -m unittest test_sequence_loss_checker.py
+#
+import logging
+import sys
+import unittest
+from unittest.mock import Mock
+
+sys.path.append('..')
+from sequence_loss_checker import SequenceLossTracker, get_sequence_number, get_user_property
+
+
+
+class TestSequenceLossTracker(unittest.TestCase):
+    def test_no_loss(self):
+        tracker = SequenceLossTracker()
+        for seq in range(5, 10):
+            stats = tracker.add('device_a', seq)
+        self.assertEqual(5, stats.received)
+        self.assertEqual(0, stats.lost)
+        self.assertEqual(0.0, stats.loss_rate())
+
+
+    def test_gaps(self):
+        tracker = SequenceLossTracker()
+        for seq in [0, 1, 4, 5, 9]:
+            stats = tracker.add('device_a', seq)
+        self.assertEqual(5, stats.received)
+        self.assertEqual(5, stats.lost)
+        self.assertAlmostEqual(0.5, stats.loss_rate())
+
+
+    def test_late_arrival(self):
+        tracker = SequenceLossTracker()
+        for seq in [0, 2, 1, 3]:
+            stats = tracker.add('device_a', seq)
+        self.assertEqual(4, stats.received)
+        self.assertEqual(0, stats.lost)
+        self.assertEqual(1, stats.late)
+
+
+    def test_restart(self):
+        tracker = SequenceLossTracker(restart_window=10)
+        for seq in [100, 101, 0, 1, 500, 2]:
+            stats = tracker.add('device_a', seq)
+        self.assertEqual(2, stats.restarts)
+        self.assertEqual(6, stats.received)
+        self.assertEqual(498, stats.lost)
+
+
+    def test_epoch_restart_with_lost_first_message(self):
+        tracker = SequenceLossTracker()
+        for seq in [0, 1, 2]:
+            stats = tracker.add('device_a', seq, 'epoch_1')
+        # Seq 0 of the new epoch was lost, seq 1 is neither late nor a gap of the old epoch.
+        for seq in [1, 2, 3]:
+            stats = tracker.add('device_a', seq, 'epoch_2')
+        self.assertEqual(1, stats.restarts)
+        self.assertEqual(6, stats.received)
+        self.assertEqual(1, stats.lost)
+        self.assertEqual(0, stats.late)
+        self.assertEqual(4, stats.expected)
+
+        # Gaps within the new epoch are still counted.
+        stats = tracker.add('device_a', 6, 'epoch_2')
+        self.assertEqual(3, stats.lost)
+
+
+    def test_devices_are_independent(self):
+        tracker = SequenceLossTracker()
+        tracker.add('device_a', 0)
+        tracker.add('device_b', 7)
+        tracker.add('device_a', 2)
+        tracker.add('device_b', 8)
+        self.assertEqual(1, tracker.devices['device_a'].lost)
+        self.assertEqual(0, tracker.devices['device_b'].lost)
+        self.assertIn('device_a: received=2, lost=1', tracker.report())
+
+
+    def test_get_sequence_number(self):
+        message = Mock()
+        message.properties.UserProperty = [('other', 'x'), ('seq', '42')]
+        self.assertEqual(42, get_sequence_number(message))
+
+        message.properties.UserProperty = [('seq', 'abc')]
+        self.assertIsNone(get_sequence_number(message))
+
+        message.properties = None
+        self.assertIsNone(get_sequence_number(message))
+
+
+    def test_get_user_property(self):
+        message = Mock()
+        message.properties.UserProperty = [('epoch', '1a2b3c4d'), ('seq', '42')]
+        self.assertEqual('1a2b3c4d', get_user_property(message, 'epoch'))
+        self.assertIsNone(get_user_property(message, 'period'))
+
+
+
+if __name__ == '__main__':
+    logging.basicConfig(level=logging.DEBUG)
+    unittest.main()
@@ -0,0 +1,59 @@
+// benchmark.hpp
+
+#ifndef _BENCHMARK_HPP_
+#define _BENCHMARK_HPP_
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+
+// Stops the compiler from optimizing away a value that is otherwise unused.
+template<class T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+
+/*
+Run 'function' 'iterations' times and return the average time per iteration in nanoseconds.
+*/
+template<class Function>
+double time_iterations(unsigned iterations, Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned count = 0; count < iterations; ++count) {
+        function();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+
+inline void print_benchmark(const std::string& name, double ns_per_iteration)
+{
+    std::cout << std::left << std::setw(48) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(1) << ns_per_iteration
+              << " ns" << std::endl;
+}
+
+
+/*
+Run 'function' 'iterations' times, after a short warm-up,
+and print and return the average time per iteration in nanoseconds.
+*/
+template<class Function>
+double benchmark(const std::string& name, unsigned iterations, Function function)
+{
+    for (unsigned count = 0; count < iterations / 10 + 1; ++count) {
+        function();
+    }
+
+    double ns_per_iteration = time_iterations(iterations, function);
+    print_benchmark(name, ns_per_iteration);
+    return ns_per_iteration;
+}
+
+
+#endif // _BENCHMARK_HPP_
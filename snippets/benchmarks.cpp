@@ -0,0 +1,697 @@
+// benchmarks.cpp
+//
+// Host benchmarks of the header-only pieces of the ESP32 client.
+// The absolute numbers are for the host, only the relative numbers are meaningful.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "event_channel.hpp"
+#include "fast_array_average.hpp"
+#include "filter_pipeline.hpp"
+#include "flat_string_map.hpp"
+#include "touch_pipeline.hpp"
+
+using namespace std;
+
+
+
+//------------------------------------------------------------------------------
+// MQTT5 User Properties: parse cost per message.
+//------------------------------------------------------------------------------
+// Emulates what esp_mqtt5_client_get_user_property() hands back: strdup()ed keys and values.
+struct user_property_item {
+    const char *key;
+    const char *value;
+};
+
+static const pair<const char *, const char *> CONFIG_MESSAGE_PROPERTIES[] = {
+    {"active_pads", "0x001e"},
+    {"average_bits", "7"},
+    {"long_sample_period", "60"},
+    {"deadband", "16"},
+    {"publish_mode", "changed"},
+};
+static const size_t CONFIG_MESSAGE_PROPERTY_COUNT = sizeof(CONFIG_MESSAGE_PROPERTIES) / sizeof(CONFIG_MESSAGE_PROPERTIES[0]);
+
+
+static void get_user_properties(user_property_item *items)
+{
+    for (size_t i = 0; i < CONFIG_MESSAGE_PROPERTY_COUNT; ++i) {
+        items[i].key = strdup(CONFIG_MESSAGE_PROPERTIES[i].first);
+        items[i].value = strdup(CONFIG_MESSAGE_PROPERTIES[i].second);
+    }
+}
+
+
+// The original MqttUserProperties: malloc the item array and build std::map nodes.
+static void parse_into_std_map()
+{
+    user_property_item *items = static_cast<user_property_item *>(malloc(CONFIG_MESSAGE_PROPERTY_COUNT * sizeof(user_property_item)));
+    get_user_properties(items);
+
+    map<string, string> properties;
+    for (size_t i = 0; i < CONFIG_MESSAGE_PROPERTY_COUNT; ++i) {
+        properties.insert({items[i].key, items[i].value});
+        free((void*)items[i].key);
+        free((void*)items[i].value);
+    }
+    free(items);
+
+    auto value = properties.find("deadband");
+    do_not_optimize(value);
+}
+
+
+// The current MqttUserProperties: stack item array and a FlatStringMap.
+static void parse_into_flat_string_map()
+{
+    user_property_item items[8];
+    get_user_properties(items);
+
+    FlatStringMap<8, 256> properties;
+    for (size_t i = 0; i < CONFIG_MESSAGE_PROPERTY_COUNT; ++i) {
+        properties.insert_or_assign(items[i].key, items[i].value);
+    }
+    for (size_t i = 0; i < CONFIG_MESSAGE_PROPERTY_COUNT; ++i) {
+        free((void*)items[i].key);
+        free((void*)items[i].value);
+    }
+
+    auto value = properties.get("deadband");
+    do_not_optimize(value);
+}
+
+
+void benchmark_mqtt_user_properties()
+{
+    cout << endl << "MQTT5 user properties, parse cost per message ("
+         << CONFIG_MESSAGE_PROPERTY_COUNT << " properties):" << endl;
+
+    const unsigned iterations = 200000;
+    benchmark("  std::map<std::string, std::string>", iterations, parse_into_std_map);
+    benchmark("  FlatStringMap<8, 256>", iterations, parse_into_flat_string_map);
+}
+
+
+
+//------------------------------------------------------------------------------
+// Control event dispatch latency under publish load.
+//------------------------------------------------------------------------------
+// A model of the app event loop: a blocking FIFO between host threads stands in for a FreeRTOS queue.
+// Every averaging window the sampler posts one touch value per pad, and publishing each one
+//  (formatting plus esp_mqtt_client_enqueue()) takes 'PUBLISH_COST'. Meanwhile control events
+//  (timer ticks, config, force update) arrive at random and their post-to-handler time is measured:
+//   - shared:    one task handles the touch values and the control events (the app event loop before).
+//   - publisher: the touch values go to a dedicated publisher task, the event loop only sees control events.
+using Clock = chrono::steady_clock;
+
+template<class T>
+class HostQueue {
+public:
+    void push(const T& item) {
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            items.push_back(item);
+        }
+        not_empty.notify_one();
+    }
+
+    T pop() {
+        unique_lock<mutex> lock(queue_mutex);
+        not_empty.wait(lock, [this] { return !items.empty(); });
+        T item = items.front();
+        items.pop_front();
+        return item;
+    }
+
+private:
+    mutex queue_mutex;
+    condition_variable not_empty;
+    deque<T> items;
+};
+
+enum class model_event_kind { control, touch_value, stop };
+struct model_event {
+    model_event_kind kind;
+    Clock::time_point posted;
+    uint32_t touch_value;
+    uint8_t touch_pad_num;
+};
+
+static const unsigned TOUCH_PADS = 14;
+static const auto WINDOW_PERIOD = chrono::milliseconds(20);
+static const auto PUBLISH_COST = chrono::microseconds(250);
+static const auto RUN_TIME = chrono::milliseconds(1500);
+
+
+static void emulate_publish(const model_event& event)
+{
+    char topic[64], data[32];
+    snprintf(topic, sizeof(topic), "soilmoisture/%s/touchpad/%u", "0123456789abcdef", event.touch_pad_num);
+    snprintf(data, sizeof(data), "%lu,%lld", (unsigned long)event.touch_value, (long long)1700000000);
+    do_not_optimize(topic);
+    do_not_optimize(data);
+
+    // Busy wait, the outbox work keeps the CPU.
+    const auto until = Clock::now() + PUBLISH_COST;
+    while (Clock::now() < until) { }
+}
+
+
+static void handle_events(HostQueue<model_event>& queue, vector<double>& control_latency_us)
+{
+    while (true) {
+        model_event event = queue.pop();
+        switch (event.kind) {
+        case model_event_kind::control:
+            control_latency_us.push_back(chrono::duration<double, micro>(Clock::now() - event.posted).count());
+            break;
+        case model_event_kind::touch_value:
+            emulate_publish(event);
+            break;
+        case model_event_kind::stop:
+            return;
+        }
+    }
+}
+
+
+static void print_latency(const string& name, vector<double>& latency_us)
+{
+    sort(latency_us.begin(), latency_us.end());
+    auto percentile = [&](double p) {
+        return latency_us.empty() ? 0.0 : latency_us[static_cast<size_t>(p * (latency_us.size() - 1))];
+    };
+    char line[160];
+    snprintf(line, sizeof(line), "%-24s n=%-5zu p50=%8.1f us  p99=%8.1f us  max=%8.1f us",
+             name.c_str(), latency_us.size(), percentile(0.50), percentile(0.99), percentile(1.0));
+    cout << line << endl;
+}
+
+
+static void run_dispatch_model(const string& name, bool use_publisher_task)
+{
+    HostQueue<model_event> event_loop_queue, publisher_queue;
+    HostQueue<model_event>& touch_queue = use_publisher_task ? publisher_queue : event_loop_queue;
+    vector<double> control_latency_us, unused;
+
+    thread event_loop_task(handle_events, ref(event_loop_queue), ref(control_latency_us));
+    thread publisher_task;
+    if (use_publisher_task) {
+        publisher_task = thread(handle_events, ref(publisher_queue), ref(unused));
+    }
+
+    // The sampler: one touch value per pad at the end of every window.
+    atomic<bool> is_running(true);
+    thread sampler_task([&] {
+        auto next_window = Clock::now();
+        while (is_running) {
+            next_window += WINDOW_PERIOD;
+            this_thread::sleep_until(next_window);
+            for (unsigned pad = 1; pad <= TOUCH_PADS; ++pad) {
+                touch_queue.push({model_event_kind::touch_value, Clock::now(), 1000u + pad, static_cast<uint8_t>(pad)});
+            }
+        }
+    });
+
+    // Control events at random times.
+    mt19937 random(42);
+    uniform_int_distribution<int> gap_us(500, 3000);
+    const auto stop_time = Clock::now() + RUN_TIME;
+    while (Clock::now() < stop_time) {
+        this_thread::sleep_for(chrono::microseconds(gap_us(random)));
+        event_loop_queue.push({model_event_kind::control, Clock::now(), 0, 0});
+    }
+
+    is_running = false;
+    sampler_task.join();
+    event_loop_queue.push({model_event_kind::stop, Clock::now(), 0, 0});
+    event_loop_task.join();
+    if (use_publisher_task) {
+        publisher_queue.push({model_event_kind::stop, Clock::now(), 0, 0});
+        publisher_task.join();
+    }
+
+    print_latency(name, control_latency_us);
+}
+
+
+void benchmark_control_event_dispatch()
+{
+    cout << endl << "Control event dispatch latency under publish load ("
+         << TOUCH_PADS << " values every " << WINDOW_PERIOD.count() << " ms, "
+         << PUBLISH_COST.count() << " us each):" << endl;
+
+    run_dispatch_model("  shared event loop", false);
+    run_dispatch_model("  publisher task", true);
+}
+
+
+
+//------------------------------------------------------------------------------
+// Touch value hand-off cost: post plus dispatch of one event.
+//------------------------------------------------------------------------------
+// esp_event_post_to() copies the event data into the loop's queue (under a lock), and the
+//  loop copies it again into a heap allocation for the handlers. The EventChannel fills
+//  a pool slot in place and only passes its index.
+struct touch_value_event {
+    time_t utc_timestamp;
+    int64_t sample_time_us;
+    uint32_t touch_value;
+    uint8_t touch_pad_num;
+};
+
+static volatile uint32_t touch_value_sink;
+
+static void touch_value_handler(void *, int32_t, touch_value_event& event)
+{
+    touch_value_sink = event.touch_value;
+}
+
+
+// The copy path of esp_event_post_to() and esp_event_loop_run(), minus the FreeRTOS queue internals.
+class CopyingEventLoop {
+public:
+    void post(const void *event_data, size_t event_data_size) {
+        lock_guard<mutex> lock(queue_mutex);
+        queue_item &item = items[write_index++ % items.size()];
+        item.data = malloc(event_data_size);
+        memcpy(item.data, event_data, event_data_size);
+    }
+
+    void dispatch_one() {
+        queue_item item;
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            memcpy(&item, &items[read_index++ % items.size()], sizeof(item));
+        }
+        touch_value_handler(nullptr, 0, *static_cast<touch_value_event *>(item.data));
+        free(item.data);
+    }
+
+private:
+    struct queue_item {
+        int32_t event_id;
+        void *data;
+    };
+    mutex queue_mutex;
+    array<queue_item, 16> items {};
+    size_t write_index = 0;
+    size_t read_index = 0;
+};
+
+
+void benchmark_touch_value_hand_off()
+{
+    cout << endl << "Touch value hand-off, post plus dispatch per event:" << endl;
+
+    const unsigned iterations = 2000000;
+    uint32_t touch_value = 0;
+
+    CopyingEventLoop copying_loop;
+    benchmark("  esp_event style copy (queue + heap)", iterations, [&]() {
+        touch_value_event event = {0, 0, ++touch_value, 3};
+        copying_loop.post(&event, sizeof(event));
+        copying_loop.dispatch_one();
+    });
+
+    EventChannel<touch_value_event, 16> channel;
+    channel.register_handler(0, touch_value_handler, nullptr);
+    benchmark("  EventChannel<16> (slot index)", iterations, [&]() {
+        const int slot = channel.acquire();
+        channel[slot].touch_value = ++touch_value;
+        channel[slot].touch_pad_num = 3;
+        channel.post(slot, 0);
+        channel.dispatch_pending();
+    });
+}
+
+
+
+
+//------------------------------------------------------------------------------
+// Touch pad averaging: all lanes with a branch on each, vs only the active lanes.
+//------------------------------------------------------------------------------
+// 15 touch pads (ESP32-S3), 4 of them active as under APP_DEBUG.
+using TouchAverage = FastArrayAverage<uint32_t, uint64_t, 15>;
+static const LaneMask ACTIVE_PADS = 0x001e;
+
+void benchmark_touch_pad_lanes()
+{
+    cout << endl << "Touch pad averaging, read plus accumulate per sample (4 of 15 pads active):" << endl;
+
+    const unsigned iterations = 2000000;
+    array<bool, 15> is_activated {};
+    for_each_lane(ACTIVE_PADS, [&](unsigned lane) { is_activated[lane] = true; });
+    uint32_t raw_value = 0;
+
+    TouchAverage all_average(7);
+    TouchAverage::ValueArrayType all_values;
+    benchmark("  every lane, branch on is_activated", iterations, [&]() {
+        for (size_t lane = 0; lane < all_values.size(); ++lane) {
+            all_values[lane] = is_activated[lane] ? ++raw_value : 0;
+        }
+        all_average.add_values(all_values);
+        if (all_average.is_average_ready()) {
+            all_average.get_average_values(all_values);
+        }
+        do_not_optimize(all_values);
+    });
+
+    TouchAverage masked_average(7);
+    TouchAverage::ValueArrayType masked_values;
+    benchmark("  active lanes only (count trailing zeros)", iterations, [&]() {
+        for_each_lane(ACTIVE_PADS, [&](unsigned lane) {
+            masked_values[lane] = ++raw_value;
+        });
+        masked_average.add_values(masked_values, ACTIVE_PADS);
+        if (masked_average.is_average_ready()) {
+            masked_average.get_average_values(masked_values, ACTIVE_PADS);
+        }
+        do_not_optimize(masked_values);
+    });
+}
+
+
+
+//------------------------------------------------------------------------------
+// Touch pipeline: runtime pad set vs pads fixed at compile time, for each chip family.
+//------------------------------------------------------------------------------
+template<class Pipeline>
+static void run_touch_pipeline(const string& name, LaneMask pads)
+{
+    const unsigned iterations = 2000000;
+    Pipeline pipeline(7);
+    pipeline.set_pads(pads);
+    typename Pipeline::ValueType raw_value = 0;
+    unsigned published = 0;
+
+    benchmark(name, iterations, [&]() {
+        if (pipeline.add_sample([&](unsigned) { return ++raw_value; })) {
+            pipeline.publish_changed(16, false, [&](unsigned, typename Pipeline::ValueType, typename Pipeline::ValueType) {
+                ++published;
+                return true;
+            });
+        }
+        do_not_optimize(pipeline);
+    });
+    do_not_optimize(published);
+}
+
+
+void benchmark_touch_pipeline()
+{
+    cout << endl << "Touch pipeline, read plus accumulate (plus publish every 128th) per sample, 4 pads:" << endl;
+
+    run_touch_pipeline<TouchPipeline<Esp32TouchTraits>>("  ESP32 (16 bit), runtime pads", ACTIVE_PADS);
+    run_touch_pipeline<TouchPipeline<Esp32TouchTraits, ACTIVE_PADS>>("  ESP32 (16 bit), fixed pads", ACTIVE_PADS);
+    run_touch_pipeline<TouchPipeline<Esp32S2S3TouchTraits>>("  ESP32-S2/S3 (32 bit), runtime pads", ACTIVE_PADS);
+    run_touch_pipeline<TouchPipeline<Esp32S2S3TouchTraits, ACTIVE_PADS>>("  ESP32-S2/S3 (32 bit), fixed pads", ACTIVE_PADS);
+}
+
+
+
+//------------------------------------------------------------------------------
+// Filter chains: cost per sample of each chain, and the same chain through virtual stages.
+//------------------------------------------------------------------------------
+using ChainFrame = FilterFrame<uint32_t, 15>;
+using FixedChainFrame = FilterFrame<uint32_t, 15, ACTIVE_PADS>;
+
+template<class Frame>
+struct CountingSink {
+    unsigned *count;
+    void operator()(unsigned, uint32_t) { ++*count; }
+};
+
+template<class Frame>
+using FullChain = FilterPipeline<Frame, BlockAverageStage<Frame, uint64_t>, KalmanStage<Frame>,
+                                 DeadbandStage<Frame>, SinkStage<Frame, CountingSink<Frame>>>;
+
+// One sample of every lane through 'pipeline'.
+template<class Pipeline, class Frame>
+static void process_next_sample(Pipeline& pipeline, Frame& frame, uint32_t& raw_value)
+{
+    frame.for_each([&](unsigned lane) {
+        // A slow ramp with some noise, so the deadband passes some of the values.
+        ++raw_value;
+        frame.values[lane] = 10000 + (raw_value >> 6) + (raw_value * 2654435761u >> 28);
+    });
+    do_not_optimize(pipeline.process(frame));
+}
+
+
+template<class Pipeline, class Frame>
+static void run_filter_chain(const string& name, Pipeline& pipeline, Frame& frame)
+{
+    const unsigned iterations = 2000000;
+    uint32_t raw_value = 0;
+    frame.lanes = ACTIVE_PADS;
+
+    benchmark(name, iterations, [&]() {
+        process_next_sample(pipeline, frame, raw_value);
+    });
+}
+
+
+// The same stages, called through a base class as a list of filters would be.
+struct VirtualStage {
+    virtual ~VirtualStage() { }
+    virtual bool process(ChainFrame& frame) = 0;
+};
+
+template<class Stage>
+struct VirtualStageOf : VirtualStage {
+    Stage stage;
+    VirtualStageOf() = default;
+    explicit VirtualStageOf(Stage stage) : stage(std::move(stage)) { }
+    bool process(ChainFrame& frame) override { return stage.process(frame); }
+};
+
+struct VirtualChain {
+    vector<unique_ptr<VirtualStage>> stages;
+    bool process(ChainFrame& frame) {
+        frame.suppressed = 0;
+        for (auto& stage : stages) {
+            if (!stage->process(frame)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+/*
+The same chain inlined and through virtual stages. A single run of each is easily off by more
+ than the dispatch cost, so after a warm-up they take turns for 'repeats' runs,
+ and the fastest run of each is reported.
+*/
+template<class Pipeline>
+static void compare_filter_chains(const string& name, Pipeline& inlined_pipeline, VirtualChain& virtual_pipeline)
+{
+    const unsigned iterations = 500000;
+    const unsigned repeats = 15;
+    ChainFrame inlined_frame, virtual_frame;
+    inlined_frame.lanes = virtual_frame.lanes = ACTIVE_PADS;
+    uint32_t inlined_raw_value = 0, virtual_raw_value = 0;
+    auto run_inlined = [&]() { process_next_sample(inlined_pipeline, inlined_frame, inlined_raw_value); };
+    auto run_virtual = [&]() { process_next_sample(virtual_pipeline, virtual_frame, virtual_raw_value); };
+
+    time_iterations(iterations, run_inlined);
+    time_iterations(iterations, run_virtual);
+    double inlined_ns = time_iterations(iterations, run_inlined);
+    double virtual_ns = time_iterations(iterations, run_virtual);
+    for (unsigned count = 1; count < repeats; ++count) {
+        inlined_ns = min(inlined_ns, time_iterations(iterations, run_inlined));
+        virtual_ns = min(virtual_ns, time_iterations(iterations, run_virtual));
+    }
+    print_benchmark(name + " (inlined)", inlined_ns);
+    print_benchmark(name + " (virtual)", virtual_ns);
+}
+
+
+void benchmark_filter_chains()
+{
+    cout << endl << "Filter chains, per sample (4 of 15 pads, windows of 128 samples):" << endl;
+
+    unsigned sunk = 0;
+    {
+        ChainFrame frame;
+        FilterPipeline<ChainFrame, BlockAverageStage<ChainFrame, uint64_t>> pipeline;
+        run_filter_chain("  average", pipeline, frame);
+    }
+    {
+        ChainFrame frame;
+        FilterPipeline<ChainFrame, BlockAverageStage<ChainFrame, uint64_t>, EmaStage<ChainFrame, 2>> pipeline;
+        run_filter_chain("  average, EMA", pipeline, frame);
+    }
+    {
+        ChainFrame frame;
+        FilterPipeline<ChainFrame, BlockAverageStage<ChainFrame, uint64_t>, KalmanStage<ChainFrame>> pipeline;
+        run_filter_chain("  average, Kalman", pipeline, frame);
+    }
+    {
+        ChainFrame frame;
+        FilterPipeline<ChainFrame, MedianStage<ChainFrame, 3>, BlockAverageStage<ChainFrame, uint64_t>> pipeline;
+        run_filter_chain("  median of 3, average", pipeline, frame);
+    }
+    {
+        ChainFrame frame;
+        FullChain<ChainFrame> pipeline(BlockAverageStage<ChainFrame, uint64_t>(), KalmanStage<ChainFrame>(),
+                                       DeadbandStage<ChainFrame>(), SinkStage<ChainFrame, CountingSink<ChainFrame>>({&sunk}));
+        run_filter_chain("  average, Kalman, deadband, sink", pipeline, frame);
+    }
+    {
+        FixedChainFrame frame;
+        FullChain<FixedChainFrame> pipeline(BlockAverageStage<FixedChainFrame, uint64_t>(), KalmanStage<FixedChainFrame>(),
+                                            DeadbandStage<FixedChainFrame>(),
+                                            SinkStage<FixedChainFrame, CountingSink<FixedChainFrame>>({&sunk}));
+        run_filter_chain("  ... fixed lanes", pipeline, frame);
+    }
+
+    cout << "Every sample through all the stages (no averager), inlined vs virtual stages, fastest of 15 runs:" << endl;
+    {
+        FilterPipeline<ChainFrame, EmaStage<ChainFrame, 2>, DeadbandStage<ChainFrame>,
+                       SinkStage<ChainFrame, CountingSink<ChainFrame>>>
+            inlined_pipeline(EmaStage<ChainFrame, 2>(), DeadbandStage<ChainFrame>(),
+                             SinkStage<ChainFrame, CountingSink<ChainFrame>>({&sunk}));
+        VirtualChain virtual_pipeline;
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<EmaStage<ChainFrame, 2>>());
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<DeadbandStage<ChainFrame>>());
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<SinkStage<ChainFrame, CountingSink<ChainFrame>>>(
+            SinkStage<ChainFrame, CountingSink<ChainFrame>>({&sunk})));
+        compare_filter_chains("  EMA, deadband, sink", inlined_pipeline, virtual_pipeline);
+    }
+    {
+        FilterPipeline<ChainFrame, MedianStage<ChainFrame, 3>, KalmanStage<ChainFrame>, DeadbandStage<ChainFrame>,
+                       SinkStage<ChainFrame, CountingSink<ChainFrame>>>
+            inlined_pipeline(MedianStage<ChainFrame, 3>(), KalmanStage<ChainFrame>(), DeadbandStage<ChainFrame>(),
+                             SinkStage<ChainFrame, CountingSink<ChainFrame>>({&sunk}));
+        VirtualChain virtual_pipeline;
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<MedianStage<ChainFrame, 3>>());
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<KalmanStage<ChainFrame>>());
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<DeadbandStage<ChainFrame>>());
+        virtual_pipeline.stages.emplace_back(new VirtualStageOf<SinkStage<ChainFrame, CountingSink<ChainFrame>>>(
+            SinkStage<ChainFrame, CountingSink<ChainFrame>>({&sunk})));
+        compare_filter_chains("  median, Kalman, deadband, sink", inlined_pipeline, virtual_pipeline);
+    }
+    do_not_optimize(sunk);
+}
+
+
+
+//------------------------------------------------------------------------------
+// Outlier rejection before the averager, on synthetic impulse noise.
+//------------------------------------------------------------------------------
+// Touch reads of 4 pads: a constant level, Gaussian noise, and 1% impulses (a hand brushing
+//  the probe, a Wi-Fi TX burst), which are a few thousand counts off.
+static const uint32_t TRUE_LEVEL = 20000;
+static const unsigned NOISE_SAMPLES = 1 << 16;
+
+static vector<uint32_t> make_impulse_noise()
+{
+    std::mt19937 random(42);
+    normal_distribution<double> noise(0.0, 20.0);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    uniform_int_distribution<int> impulse(2000, 8000);
+    vector<uint32_t> reads(NOISE_SAMPLES);
+    for (auto& read : reads) {
+        double value = TRUE_LEVEL + noise(random);
+        if (chance(random) < 0.01) {
+            value += (chance(random) < 0.5 ? -1 : 1) * impulse(random);
+        }
+        read = static_cast<uint32_t>(value);
+    }
+    return reads;
+}
+
+
+template<template<class> class OutlierStage>
+static void run_outlier_rejection(const string& name, const vector<uint32_t>& reads)
+{
+    using Pipeline = TouchPipeline<Esp32S2S3TouchTraits, 0, OutlierStage>;
+    const uint32_t deadband = 16;
+    unsigned next_read = 0;
+    auto read = [&](unsigned) { return reads[next_read++ & (NOISE_SAMPLES - 1)]; };
+
+    Pipeline timed_pipeline(7);
+    timed_pipeline.set_pads(ACTIVE_PADS);
+    benchmark(name, 2000000, [&]() {
+        do_not_optimize(timed_pipeline.add_sample(read));
+    });
+
+    // The error of the averages, and how many of them are off by more than the deadband,
+    //  i.e. would be published although the soil did not change.
+    Pipeline pipeline(7);
+    pipeline.set_pads(ACTIVE_PADS);
+    next_read = 0;
+    unsigned averages = 0, off_by_deadband = 0;
+    double total_error = 0, max_error = 0;
+    for (unsigned sample = 0; sample < NOISE_SAMPLES * 8; ++sample) {
+        if (!pipeline.add_sample(read)) {
+            continue;
+        }
+        pipeline.for_each_pad([&](unsigned pad) {
+            const double error = fabs(double(pipeline.get_averages()[pad]) - TRUE_LEVEL);
+            total_error += error;
+            max_error = max(max_error, error);
+            off_by_deadband += (error > deadband);
+            ++averages;
+        });
+    }
+    cout << "      mean error " << fixed << setprecision(1) << total_error / averages
+         << ", max error " << max_error
+         << ", off by more than the deadband: " << off_by_deadband << " of " << averages << endl;
+}
+
+
+template<class Frame> using MedianOf3 = MedianStage<Frame, 3>;
+template<class Frame> using MedianOf5 = MedianStage<Frame, 5>;
+template<class Frame> using TrimmedMeanOf5 = TrimmedMeanStage<Frame, 5, 1>;
+
+void benchmark_outlier_rejection()
+{
+    cout << endl << "Outlier rejection, then averages of 128 reads, per sample (4 pads, 1% impulses):" << endl;
+
+    const vector<uint32_t> reads = make_impulse_noise();
+    run_outlier_rejection<PassStage>("  plain average", reads);
+    run_outlier_rejection<MedianOf3>("  median of 3, average", reads);
+    run_outlier_rejection<MedianOf5>("  median of 5, average", reads);
+    run_outlier_rejection<TrimmedMeanOf5>("  trimmed mean of 5, average", reads);
+}
+
+
+int main()
+{
+    cout << "Run Snippet Benchmarks." << endl;
+
+    benchmark_mqtt_user_properties();
+    benchmark_control_event_dispatch();
+    benchmark_touch_value_hand_off();
+    benchmark_touch_pad_lanes();
+    benchmark_touch_pipeline();
+    benchmark_filter_chains();
+    benchmark_outlier_rejection();
+
+    return 0;
+}
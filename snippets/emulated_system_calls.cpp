@@ -16,6 +16,8 @@ static const unsigned char QUEUE_SIZE = 4;
 using namespace std;
 
 
+bool emulated_system_calls_verbose = true;
+
 thread_local TaskHandle_t threadTaskControlBlock = nullptr;
 
 
@@ -38,7 +40,9 @@ TaskHandle_t getThreadTaskHandle() {
 uint32_t ulTaskNotifyTakeIndexed( UBaseType_t uxIndexToWaitOn, BaseType_t xClearCountOnExit, TickType_t xTicksToWait )
 {
     TaskHandle_t threadTaskHandle = getThreadTaskHandle();
-    cout << "ulTaskNotifyTakeIndexed(...): " << threadTaskHandle->semaphore.debug_str() << endl;
+    if (emulated_system_calls_verbose) {
+        cout << "ulTaskNotifyTakeIndexed(...): " << threadTaskHandle->semaphore.debug_str() << endl;
+    }
     return threadTaskHandle->semaphore.take();
 }
 
@@ -46,7 +50,9 @@ uint32_t ulTaskNotifyTakeIndexed( UBaseType_t uxIndexToWaitOn, BaseType_t xClear
 
 BaseType_t xTaskNotifyGiveIndexed( TaskHandle_t xTaskToNotify, UBaseType_t uxIndexToNotify )
 {
-    cout << "xTaskNotifyGiveIndexed(...): " << xTaskToNotify->semaphore.debug_str() << endl;
+    if (emulated_system_calls_verbose) {
+        cout << "xTaskNotifyGiveIndexed(...): " << xTaskToNotify->semaphore.debug_str() << endl;
+    }
     xTaskToNotify->semaphore.give();
     return pdPASS;
 }
@@ -55,7 +61,9 @@ BaseType_t xTaskNotifyGiveIndexed( TaskHandle_t xTaskToNotify, UBaseType_t uxInd
 
 BaseType_t xTaskNotifyIndexed( TaskHandle_t xTaskToNotify, UBaseType_t uxIndexToNotify, uint32_t ulValue, eNotifyAction eAction )
 {
-    cout << "xTaskNotifyIndexed(...): " << xTaskToNotify->semaphore.debug_str() << endl;
+    if (emulated_system_calls_verbose) {
+        cout << "xTaskNotifyIndexed(...): " << xTaskToNotify->semaphore.debug_str() << endl;
+    }
     xTaskToNotify->semaphore.give(ulValue);
     return pdPASS;
 }
@@ -105,6 +105,10 @@ typedef enum
 
 //...
 
+// Print every emulated system call to std::cout (default: true).
+// Turn it off for tests and benchmarks that make many calls.
+extern bool emulated_system_calls_verbose;
+
 extern void setTaskControlBlock (TaskHandle_t taskControlBlock);
 extern TaskHandle_t getThreadTaskHandle();
 
@@ -0,0 +1 @@
+../top-level-components/secure_esp32_client/main/flat_string_map.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../top-level-components/secure_esp32_client/main/latest_value_slots.hpp
\ No newline at end of file
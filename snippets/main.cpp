@@ -4,6 +4,7 @@
 #define DEBUG
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -13,10 +14,28 @@
 #include <stdexcept>
 #include <thread>
 //#include <utility>
+#include <vector>
 
+#include "adaptive_period.hpp"
+#include "config_arena.hpp"
+#include "config_schema.hpp"
+#include "deadline_scheduler.hpp"
 #include "emulated_system_calls.hpp"
+#include "event_channel.hpp"
 #include "fast_array_average.hpp"
+#include "filter_pipeline.hpp"
+#include "fixed_histogram.hpp"
+#include "flat_string_map.hpp"
+#include "lane_mask.hpp"
+#include "latest_value_slots.hpp"
 #include "lightweight_1p1c_queue.hpp"
+#include "retained_object.hpp"
+#include "settle_detector.hpp"
+#include "sorting_network.hpp"
+#include "tick_timing.hpp"
+#include "token_bucket.hpp"
+#include "touch_pad_config.hpp"
+#include "touch_pipeline.hpp"
 
 
 // Mutex to locally protect std::cout << ...
@@ -311,6 +330,1457 @@ int test_fast_array_average()
 }
 
 
+int test_lane_mask_average()
+{
+    cout << "Starting test_lane_mask_average()." << endl;
+
+    stringstream stream;
+
+    string visited;
+    for_each_lane(0x8000001eu, [&](unsigned lane) { visited += to_string(lane) + " "; });
+    if (visited != "1 2 3 4 31 ") {
+        stream << endl << "for_each_lane: " << visited;
+    }
+    for_each_lane(0, [&](unsigned) { stream << endl << "for_each_lane(0)"; });
+    if (all_lanes(15) != 0x7fff || all_lanes(32) != 0xffffffffu) {
+        stream << endl << "all_lanes";
+    }
+
+    // Lanes 1 and 3 only: lane 0 and 2 are neither accumulated nor written.
+    FastArrayAverage<uint16_t, uint32_t, 4> average(2);
+    FastArrayAverage<uint16_t, uint32_t, 4>::ValueArrayType values = {100, 10, 200, 20};
+    FastArrayAverage<uint16_t, uint32_t, 4>::ValueArrayType result = {7, 7, 7, 7};
+    const LaneMask lanes = 0b1010;
+    for (int count = 0; count < 4; ++count) {
+        values[1] = 10 + count;
+        average.add_values(values, lanes);
+    }
+    average.get_average_values(result, lanes);
+    if (result[0] != 7 || result[1] != 11 || result[2] != 7 || result[3] != 20 || average.is_average_ready()) {
+        stream << endl << "masked average: " << result[0] << " " << result[1] << " " << result[2] << " " << result[3];
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_lane_mask_average(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_lane_mask_average()." << endl << endl;
+    return 0;
+}
+
+
+// The same sequence of samples through a runtime and a fixed pad set, of one chip family.
+template<class ChipTraits>
+void check_touch_pipeline(stringstream& stream, const char *name)
+{
+    TouchPipeline<ChipTraits> runtime_pipeline(2);
+    TouchPipeline<ChipTraits, 0x0012> fixed_pipeline(2);
+    // Touch pad 0 (denoise) and pads the chip doesn't have are dropped.
+    if (runtime_pipeline.set_pads(0x10013) != 0x0012 || fixed_pipeline.set_pads(0x0006) != 0x0012) {
+        stream << endl << name << " set_pads";
+    }
+
+    string runtime_reads, fixed_reads;
+    unsigned sample = 0;
+    for (int count = 0; count < 4; ++count) {
+        ++sample;
+        const bool runtime_ready = runtime_pipeline.add_sample([&](unsigned pad) {
+            runtime_reads += to_string(pad);
+            return typename ChipTraits::ValueType(100 * pad + sample);
+        });
+        const bool fixed_ready = fixed_pipeline.add_sample([&](unsigned pad) {
+            fixed_reads += to_string(pad);
+            return typename ChipTraits::ValueType(100 * pad + sample);
+        });
+        if (runtime_ready != (count == 3) || fixed_ready != (count == 3)) {
+            stream << endl << name << " average ready at " << count;
+        }
+        // The same pads again (e.g. a resume from deep sleep) keep the window going.
+        runtime_pipeline.set_pads(0x0012);
+    }
+    if (runtime_reads != "14141414" || fixed_reads != runtime_reads) {
+        stream << endl << name << " reads: " << runtime_reads << " " << fixed_reads;
+    }
+    // (1 + 2 + 3 + 4) / 4 = 2
+    if (runtime_pipeline.get_averages()[1] != 102 || runtime_pipeline.get_averages()[4] != 402 ||
+        fixed_pipeline.get_averages()[4] != 402) {
+        stream << endl << name << " averages";
+    }
+
+    // The first publish has nothing to compare to, the second one is within the deadband,
+    //  and a failed publish is retried.
+    string published;
+    auto publish = [&](unsigned pad, typename ChipTraits::ValueType value, typename ChipTraits::ValueType) {
+        published += to_string(pad) + "=" + to_string(value) + " ";
+        return pad != 4;
+    };
+    if (runtime_pipeline.count_changed(16) != 2) {
+        stream << endl << name << " count_changed before the first publish";
+    }
+    const auto first = runtime_pipeline.publish_changed(16, false, publish);
+    const auto second = runtime_pipeline.publish_changed(16, false, publish);
+    if (published != "1=102 4=402 4=402 " || first.changed != 2 || first.suppressed != 0
+        || second.changed != 1 || second.suppressed != 1) {
+        stream << endl << name << " publish_changed: " << published << second.changed << second.suppressed;
+    }
+    published.clear();
+    if (runtime_pipeline.count_changed(16) != 1 || runtime_pipeline.count_changed(500) != 0) {
+        stream << endl << name << " count_changed after a failed publish";
+    }
+    const auto forced = runtime_pipeline.publish_changed(16, true, publish);
+    if (forced.changed != 1 || forced.suppressed != 0 || published != "1=102 4=402 ") {
+        stream << endl << name << " forced publish_changed: " << published;
+    }
+
+    // A restarted window (e.g. a force update) drops the samples taken before it.
+    auto add_constant = [&](TouchPipeline<ChipTraits>& pipeline, typename ChipTraits::ValueType value) {
+        return pipeline.add_sample([&](unsigned) { return value; });
+    };
+    add_constant(runtime_pipeline, 900);
+    add_constant(runtime_pipeline, 900);
+    runtime_pipeline.restart_window();
+    bool is_ready = false;
+    for (int count = 0; count < 4; ++count) {
+        is_ready = add_constant(runtime_pipeline, 200);
+        if (is_ready != (count == 3)) {
+            stream << endl << name << " restarted window ready at " << count;
+        }
+    }
+    if (runtime_pipeline.get_averages()[1] != 200 || runtime_pipeline.get_averages()[4] != 200) {
+        stream << endl << name << " restarted window averages";
+    }
+}
+
+
+int test_touch_pipeline()
+{
+    cout << "Starting test_touch_pipeline()." << endl;
+
+    stringstream stream;
+    check_touch_pipeline<Esp32TouchTraits>(stream, "ESP32");
+    check_touch_pipeline<Esp32S2S3TouchTraits>(stream, "ESP32-S2/S3");
+
+    if (!stream.str().empty()) {
+        string msg = "test_touch_pipeline(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_touch_pipeline()." << endl << endl;
+    return 0;
+}
+
+
+
+// Every 0/1 input sorts (so every input does, by the 0-1 principle), and random ones match std::sort.
+template<size_t size>
+void check_sorting_network(stringstream& stream)
+{
+    for (unsigned bits = 0; bits < (1u << size); ++bits) {
+        array<uint8_t, size> values;
+        for (size_t index = 0; index < size; ++index) {
+            values[index] = (bits >> index) & 1;
+        }
+        sort_network(values);
+        if (!is_sorted(values.begin(), values.end())) {
+            stream << endl << "sort_network<" << size << "> 0/1 input 0x" << hex << bits << dec;
+            return;
+        }
+    }
+
+    std::mt19937 random(size);
+    for (int count = 0; count < 1000; ++count) {
+        array<int32_t, size> values;
+        for (auto& value : values) {
+            value = int32_t(random() % 2001) - 1000;
+        }
+        array<int32_t, size> expected = values;
+        sort(expected.begin(), expected.end());
+        if constexpr (size % 2 == 1) {
+            if (median_of(values) != expected[size / 2]) {
+                stream << endl << "median_of<" << size << ">";
+                return;
+            }
+        }
+        sort_network(values);
+        if (values != expected) {
+            stream << endl << "sort_network<" << size << "> random input";
+            return;
+        }
+    }
+}
+
+
+int test_sorting_network()
+{
+    cout << "Starting test_sorting_network()." << endl;
+
+    stringstream stream;
+    check_sorting_network<1>(stream);
+    check_sorting_network<2>(stream);
+    check_sorting_network<3>(stream);
+    check_sorting_network<4>(stream);
+    check_sorting_network<5>(stream);
+    check_sorting_network<6>(stream);
+    check_sorting_network<7>(stream);
+
+    if (trimmed_mean_of<1>(array<uint32_t, 5>{ 7, 1000, 5, 0, 6 }) != 6) {
+        stream << endl << "trimmed_mean_of<1> unsigned";
+    }
+    // Rounded toward zero.
+    if (trimmed_mean_of<1>(array<int32_t, 5>{ -7, 1000, -5, -9000, -6 }) != -6 ||
+        trimmed_mean_of<1>(array<int32_t, 4>{ -1, -2, -100, 100 }) != -1) {
+        stream << endl << "trimmed_mean_of<1> signed";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_sorting_network(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_sorting_network()." << endl << endl;
+    return 0;
+}
+
+
+template<class Frame> using MedianStage3 = MedianStage<Frame, 3>;
+template<class Frame> using Ema2Stage = EmaStage<Frame, 2>;
+
+// Block average (of 2) -> deadband -> sink, on two channels, with runtime or fixed lanes.
+template<class Frame>
+void check_filter_chain(stringstream& stream, const char *name)
+{
+    string sunk;
+    auto sink = [&](unsigned lane, uint32_t value) {
+        sunk += to_string(lane) + "=" + to_string(value) + " ";
+    };
+    FilterPipeline<Frame, BlockAverageStage<Frame, uint64_t>, DeadbandStage<Frame>, SinkStage<Frame, decltype(sink)>>
+        pipeline(BlockAverageStage<Frame, uint64_t>(1), DeadbandStage<Frame>(5), SinkStage<Frame, decltype(sink)>(sink));
+
+    Frame frame;
+    frame.lanes = 0x0006;
+    // Lane 1 moves by 10 then 4 (suppressed), lane 2 by 0 (suppressed) then 6.
+    const uint32_t lane_1[] = { 99, 101, 110, 110, 114, 114 };
+    const uint32_t lane_2[] = { 200, 200, 200, 200, 204, 208 };
+    string passed;
+    for (unsigned count = 0; count < 6; ++count) {
+        frame.values[1] = lane_1[count];
+        frame.values[2] = lane_2[count];
+        passed += pipeline.process(frame) ? "1" : "0";
+    }
+    if (passed != "010101") {
+        stream << endl << name << " the chain did not stop at the averager: " << passed;
+    }
+    if (sunk != "1=100 2=200 1=110 2=206 ") {
+        stream << endl << name << " sunk: " << sunk;
+    }
+    if (frame.suppressed != 0x0002) {
+        stream << endl << name << " suppressed 0x" << hex << frame.suppressed << dec;
+    }
+
+    // After a reset the first values pass the deadband again (the frame still holds the last averages).
+    sunk.clear();
+    pipeline.reset();
+    pipeline.process(frame);
+    pipeline.process(frame);
+    if (sunk != "1=114 2=206 ") {
+        stream << endl << name << " after reset: " << sunk;
+    }
+}
+
+
+int test_filter_pipeline()
+{
+    cout << "Starting test_filter_pipeline()." << endl;
+
+    stringstream stream;
+    check_filter_chain<FilterFrame<uint32_t, 15>>(stream, "runtime lanes");
+    check_filter_chain<FilterFrame<uint32_t, 15, 0x0006>>(stream, "fixed lanes");
+
+    using Frame = FilterFrame<uint32_t, 4>;
+    Frame frame;
+    frame.lanes = 0x0001;
+
+    // EMA (1/4): the first value as is, then a step of 100 moves a quarter of the way each time.
+    FilterPipeline<Frame, EmaStage<Frame, 2>> ema;
+    string ema_values;
+    for (uint32_t value : { 1000, 1100, 1100, 1100 }) {
+        frame.values[0] = value;
+        ema.process(frame);
+        ema_values += to_string(frame.values[0]) + " ";
+    }
+    if (ema_values != "1000 1025 1043 1058 ") {
+        stream << endl << "EMA: " << ema_values;
+    }
+
+    // Median of 3: a single impulse is dropped.
+    FilterPipeline<Frame, MedianStage<Frame, 3>> median;
+    string median_values;
+    for (uint32_t value : { 500, 501, 502, 9000, 503, 504 }) {
+        frame.values[0] = value;
+        median.process(frame);
+        median_values += to_string(frame.values[0]) + " ";
+    }
+    if (median_values != "500 501 501 502 503 504 ") {
+        stream << endl << "median: " << median_values;
+    }
+
+    // Kalman: follows a step, slower than the measurements but without overshoot.
+    FilterPipeline<Frame, KalmanStage<Frame>> kalman;
+    frame.values[0] = 1000;
+    kalman.process(frame);
+    uint32_t prior_value = frame.values[0];
+    bool is_monotonic = (prior_value == 1000);
+    for (int count = 0; count < 50; ++count) {
+        frame.values[0] = 1100;
+        kalman.process(frame);
+        is_monotonic = is_monotonic && frame.values[0] >= prior_value && frame.values[0] <= 1100;
+        prior_value = frame.values[0];
+    }
+    if (!is_monotonic || prior_value < 1095) {
+        stream << endl << "Kalman: " << prior_value;
+    }
+
+    // Trimmed mean of 5 (without the lowest and highest): a single impulse is dropped.
+    FilterPipeline<Frame, TrimmedMeanStage<Frame, 5, 1>> trimmed_mean;
+    string trimmed_mean_values;
+    for (uint32_t value : { 100, 101, 102, 103, 5000, 104, 105 }) {
+        frame.values[0] = value;
+        trimmed_mean.process(frame);
+        trimmed_mean_values += to_string(frame.values[0]) + " ";
+    }
+    if (trimmed_mean_values != "100 101 102 103 102 103 104 ") {
+        stream << endl << "trimmed mean: " << trimmed_mean_values;
+    }
+
+    // A touch pipeline with a median before the averager (it starts over with each window),
+    //  and an EMA after it.
+    TouchPipeline<Esp32S2S3TouchTraits, 0, MedianStage3, Ema2Stage> touch_pipeline(2);
+    touch_pipeline.set_pads(0x0002);
+    string touch_values;
+    for (uint32_t value : { 10, 11, 90, 12, 30, 30, 30, 30 }) {
+        if (touch_pipeline.add_sample([&](unsigned) { return value; })) {
+            touch_values += to_string(touch_pipeline.get_averages()[1]) + " ";
+        }
+    }
+    if (touch_values != "11 15 ") {
+        stream << endl << "touch pipeline: " << touch_values;
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_filter_pipeline(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_filter_pipeline()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_latest_value_slots()
+{
+    cout << "Starting test_latest_value_slots()." << endl;
+
+    LatestValueSlots<int, 4> slots;
+    stringstream stream;
+
+    if (slots.has_pending()) {
+        stream << endl << "new slots should not have pending values";
+    }
+
+    // Pad 1 is updated twice while "saturated", only the latest value is kept.
+    if (slots.store(1, 100)) {
+        stream << endl << "first store(1) should not coalesce";
+    }
+    slots.store(3, 300);
+    if (!slots.store(1, 101)) {
+        stream << endl << "second store(1) should coalesce";
+    }
+    if (slots.store(9, 900)) {
+        stream << endl << "out of range store(9) should be ignored";
+    }
+    if (slots.get_pending_count() != 2) {
+        stream << endl << "expected 2 pending, actual=" << slots.get_pending_count();
+    }
+
+    // Still saturated: nothing is sent and everything stays pending.
+    auto sent_count = slots.drain([](std::size_t, const int&) { return false; });
+    if (sent_count != 0 || slots.get_pending_count() != 2) {
+        stream << endl << "saturated drain: sent=" << sent_count << ", pending=" << slots.get_pending_count();
+    }
+
+    // Capacity is back: the most recently stored value goes out first.
+    std::vector<std::pair<std::size_t, int>> sent;
+    sent_count = slots.drain([&sent](std::size_t index, const int& value) {
+        sent.push_back({index, value});
+        return true;
+    });
+    if (sent_count != 2 || sent.size() != 2 || sent[0] != make_pair<std::size_t, int>(1, 101)
+        || sent[1] != make_pair<std::size_t, int>(3, 300))
+    {
+        stream << endl << "unexpected drain order or values";
+    }
+    if (slots.has_pending()) {
+        stream << endl << "drained slots should not have pending values";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_latest_value_slots(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_latest_value_slots()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_fixed_histogram()
+{
+    cout << "Starting test_fixed_histogram()." << endl;
+
+    using Histogram = FixedHistogram<6>;
+    Histogram histogram;
+    stringstream stream;
+
+    // value -> bucket
+    const std::pair<Histogram::ValueType, std::size_t> expected_buckets[] = {
+        {0, 0}, {1, 1}, {2, 2}, {3, 2}, {4, 3}, {15, 4}, {16, 5}, {1000000, 5}
+    };
+    for (const auto& expected : expected_buckets) {
+        auto actual = Histogram::bucket_index(expected.first);
+        if (actual != expected.second) {
+            stream << endl << "bucket_index(" << expected.first << "): expected=" << expected.second
+                   << ", actual=" << actual;
+        }
+        histogram.add(expected.first);
+    }
+
+    if (histogram.get_count() != 8 || histogram.get_min() != 0 || histogram.get_max() != 1000000) {
+        stream << endl << "count/min/max: " << histogram.get_count()
+               << "/" << histogram.get_min() << "/" << histogram.get_max();
+    }
+
+    char buffer[128];
+    histogram.snprint_json(buffer, sizeof(buffer));
+    const string expected_json = "{\"n\":8,\"min\":0,\"max\":1000000,\"b\":[1,1,2,1,1,2]}";
+    if (expected_json != buffer) {
+        stream << endl << "snprint_json: expected=" << expected_json << ", actual=" << buffer;
+    }
+
+    // Truncation behaves like snprintf(): the full length is returned.
+    char small_buffer[8];
+    int len = histogram.snprint_json(small_buffer, sizeof(small_buffer));
+    if (len != static_cast<int>(expected_json.size()) || string(small_buffer) != expected_json.substr(0, 7)) {
+        stream << endl << "snprint_json truncated: len=" << len << ", buffer=" << small_buffer;
+    }
+
+    // With every bucket in use, max_json_length is only off by the digits short of 10:
+    //  n has 2 (10), min 1 (0), max 10 (UINT32_MAX), and each bucket 1.
+    histogram.add(UINT32_MAX);
+    histogram.add(4);
+    len = histogram.snprint_json(buffer, sizeof(buffer));
+    if (len != static_cast<int>(Histogram::max_json_length - 8 - 9 - 6 * 9)) {
+        stream << endl << "max_json_length " << Histogram::max_json_length << " for: " << buffer;
+    }
+
+    histogram.reset();
+    histogram.snprint_json(buffer, sizeof(buffer));
+    if (string("{\"n\":0,\"min\":0,\"max\":0,\"b\":[]}") != buffer) {
+        stream << endl << "snprint_json after reset: " << buffer;
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_fixed_histogram(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_fixed_histogram()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_flat_string_map()
+{
+    cout << "Starting test_flat_string_map()." << endl;
+
+    using Map = FlatStringMap<3, 32>;
+    Map map;
+    stringstream stream;
+
+    map.insert_or_assign("b", "2");
+    map.insert_or_assign("a", "1");
+    map.insert_or_assign("b", "22"); // the last occurrence is kept.
+    map.insert_or_assign("c", "3");
+
+    if (map.size() != 3 || map.get("a") != "1" || map.get("b") != "22" || map.get("c") != "3") {
+        stream << endl << "unexpected contents";
+    }
+    if (map.exists("d") || map.find("d") != map.end() || !map.get("d").empty()) {
+        stream << endl << "unexpected key 'd'";
+    }
+
+    // Iteration is sorted by key, and values are null terminated.
+    string keys;
+    for (const auto& item : map) {
+        keys += item.first;
+        if (item.second.data()[item.second.size()] != '\0') {
+            stream << endl << "value of '" << item.first << "' is not null terminated";
+        }
+    }
+    if (keys != "abc") {
+        stream << endl << "iteration order: " << keys;
+    }
+
+    // Capacity: too many items, or not enough arena space, are rejected.
+    if (map.insert_or_assign("d", "4")) {
+        stream << endl << "insert beyond max_items should fail";
+    }
+    if (map.insert_or_assign("a", "0123456789012345678901234567890")) {
+        stream << endl << "insert beyond arena_size should fail";
+    }
+    if (map.get("a") != "1") {
+        stream << endl << "a rejected insert should leave the map unchanged";
+    }
+
+    // A real move: the source is left empty and the destination is self contained.
+    Map moved(std::move(map));
+    if (!map.empty() || moved.size() != 3 || moved.get("b") != "22") {
+        stream << endl << "move constructor";
+    }
+    Map copied;
+    copied = moved;
+    moved.clear();
+    if (copied.get("c") != "3") {
+        stream << endl << "copy assignment";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_flat_string_map(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_flat_string_map()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_touch_pad_config()
+{
+    cout << "Starting test_touch_pad_config()." << endl;
+
+    const unsigned touch_pad_max = 15;
+    using Properties = FlatStringMap<8, 128>;
+    stringstream stream;
+
+    // Topics.
+    if (get_device_subtopic("soilmoisture/abc/touchpad/update") != TOUCH_UPDATE_SUBTOPIC
+        || !get_device_subtopic("soilmoisture//touchpad/update").empty()
+        || !get_device_subtopic("other/abc/touchpad/update").empty())
+    {
+        stream << endl << "get_device_subtopic(...)";
+    }
+    if (parse_touch_config_topic("soilmoisture/abc/touchpad/config") != TOUCH_CONFIG_TOPIC_ALL_PADS
+        || parse_touch_config_topic("soilmoisture/abc/touchpad/12/config") != 12
+        || parse_touch_config_topic("soilmoisture/abc/touchpad/x/config") != TOUCH_CONFIG_TOPIC_NONE
+        || parse_touch_config_topic("soilmoisture/abc/touchpad//config") != TOUCH_CONFIG_TOPIC_NONE
+        || parse_touch_config_topic("soilmoisture/abc/touchpad/3") != TOUCH_CONFIG_TOPIC_NONE
+        || parse_touch_config_topic("other/abc/touchpad/config") != TOUCH_CONFIG_TOPIC_NONE)
+    {
+        stream << endl << "parse_touch_config_topic(...)";
+    }
+
+    // All keys, with a hex bitmask.
+    TouchPadConfig config;
+    Properties properties;
+    properties.insert_or_assign("active_pads", "0x001e");
+    properties.insert_or_assign("average_bits", "5");
+    properties.insert_or_assign("long_sample_period", "300");
+    properties.insert_or_assign("deadband", "40");
+    properties.insert_or_assign("publish_mode", "always");
+    const char *error = apply_touch_pad_config(config, properties, touch_pad_max);
+    if (error || config.active_pads != 0x1e || config.average_bits != 5 || config.long_sample_period_sec != 300
+        || config.deadband != 40 || config.publish_mode != TouchPublishMode::always)
+    {
+        stream << endl << "apply_touch_pad_config(...) all keys: " << (error ? error : "");
+    }
+    // 300 is below the default maximum (900), which is kept.
+    if (config.max_long_sample_period_sec != 900) {
+        stream << endl << "max_long_sample_period changed to " << config.max_long_sample_period_sec;
+    }
+
+    // A long_sample_period above the maximum raises it, unless the maximum is given too.
+    Properties period;
+    period.insert_or_assign("long_sample_period", "1200");
+    TouchPadConfig raised = config;
+    if (apply_touch_pad_config(raised, period, touch_pad_max) || raised.max_long_sample_period_sec != 1200) {
+        stream << endl << "long_sample_period=1200 on its own: max " << raised.max_long_sample_period_sec;
+    }
+    period.insert_or_assign("max_long_sample_period", "600");
+    raised = config;
+    if (!apply_touch_pad_config(raised, period, touch_pad_max) || raised != config) {
+        stream << endl << "accepted max_long_sample_period below long_sample_period";
+    }
+    period.insert_or_assign("max_long_sample_period", "1200");
+    if (apply_touch_pad_config(raised, period, touch_pad_max) || raised.long_sample_period_sec != 1200
+        || raised.max_long_sample_period_sec != 1200) {
+        stream << endl << "fixed long_sample_period=1200";
+    }
+
+    // Invalid values leave the config unchanged.
+    const TouchPadConfig before = config;
+    const char *invalid[][2] = {
+        {"active_pads", "0x0001"},        // touch pad 0
+        {"active_pads", "0x8000"},        // beyond touch_pad_max
+        {"average_bits", "11"},
+        {"long_sample_period", "1"},
+        {"max_long_sample_period", "100000"},
+        {"deadband", "-3"},
+        {"publish_mode", "sometimes"},
+    };
+    for (const auto& item : invalid) {
+        Properties bad;
+        bad.insert_or_assign("deadband", "1"); // valid on its own, must not be applied either.
+        bad.insert_or_assign(item[0], item[1]);
+        if (!apply_touch_pad_config(config, bad, touch_pad_max) || config != before) {
+            stream << endl << "accepted " << item[0] << "=" << item[1];
+        }
+    }
+
+    // Single touch pad.
+    Properties channel;
+    channel.insert_or_assign("active", "0");
+    if (apply_touch_pad_channel_config(config, 2, channel, touch_pad_max) || config.is_active(2) || !config.is_active(3)) {
+        stream << endl << "deactivate touch pad 2";
+    }
+    channel.insert_or_assign("active", "1");
+    if (apply_touch_pad_channel_config(config, 9, channel, touch_pad_max) || !config.is_active(9)) {
+        stream << endl << "activate touch pad 9";
+    }
+    if (!apply_touch_pad_channel_config(config, 0, channel, touch_pad_max)
+        || !apply_touch_pad_channel_config(config, touch_pad_max, channel, touch_pad_max))
+    {
+        stream << endl << "activated a touch pad that does not exist";
+    }
+
+    // A new averaging window takes effect from a clean start.
+    FastArrayAverage<unsigned short, unsigned long, 2> average(2);
+    FastArrayAverage<unsigned short, unsigned long, 2>::ValueArrayType values = {4, 8};
+    average.add_values(values);
+    average.set_number_of_bits(1);
+    average.add_values(values);
+    if (average.is_average_ready() || average.sample_size != 2) {
+        stream << endl << "set_number_of_bits(...) must restart the window";
+    }
+    average.add_values(values);
+    const bool is_ready = average.is_average_ready();
+    average.get_average_values(values);
+    if (!is_ready || values[0] != 4 || values[1] != 8) {
+        stream << endl << "average after set_number_of_bits(...)";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_touch_pad_config(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_touch_pad_config()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_tick_timing()
+{
+    cout << "Starting test_tick_timing()." << endl;
+
+    stringstream stream;
+    auto check = [&](const char *name, TickTiming::Tick tick, uint32_t wake_latency, uint32_t skipped) {
+        if (tick.wake_latency != wake_latency || tick.skipped != skipped) {
+            stream << endl << name << ": wake_latency=" << tick.wake_latency << " skipped=" << tick.skipped;
+        }
+    };
+
+    // Ticks due every 100, the handler wakes a little late, and one tick (due at 300) never arrives.
+    TickTiming timing(100);
+    check("first", timing.tick(100, 105), 5, 0);
+    check("second", timing.tick(200, 230), 30, 0);
+    check("after a lost tick", timing.tick(400, 401), 1, 1);
+    // The clock read before the due time (e.g. a coarser clock) is not early, just on time.
+    check("on time", timing.tick(500, 499), 0, 0);
+    if (timing.get_window_count() != 4 || timing.get_span() != 499 - 105 + 100) {
+        stream << endl << "span " << timing.get_span();
+    }
+    timing.start_window();
+    check("next window", timing.tick(700, 700), 0, 1);
+    if (timing.get_window_count() != 1 || timing.get_span() != 100) {
+        stream << endl << "span of one tick " << timing.get_span();
+    }
+
+    // A restart (e.g. the job was stopped until the next batch) is not counted as skipped ticks.
+    timing.restart();
+    if (timing.get_span() != 0) {
+        stream << endl << "span after restart " << timing.get_span();
+    }
+    check("after restart", timing.tick(5000, 5002), 2, 0);
+
+    // Without due times the intervals are measured against the period, jitter is not a skipped tick.
+    TickTiming intervals(1000);
+    check("interval first", intervals.tick(10000), 0, 0);
+    check("interval late", intervals.tick(11040), 40, 0);
+    check("interval early", intervals.tick(11900), 0, 0);
+    check("interval lost", intervals.tick(13950), 50, 1);
+
+    if (!stream.str().empty()) {
+        string msg = "test_tick_timing(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_tick_timing()." << endl << endl;
+    return 0;
+}
+
+
+int test_adaptive_period()
+{
+    cout << "Starting test_adaptive_period()." << endl;
+
+    stringstream stream;
+    auto check = [&](const char *name, const AdaptivePeriod& period, AdaptivePeriod::TimeType expected) {
+        if (period.get() != expected) {
+            stream << endl << name << ": " << period.get() << " != " << expected;
+        }
+    };
+
+    // Stable windows back off exponentially up to the maximum, a change snaps back to the minimum.
+    AdaptivePeriod period(60, 900);
+    check("start", period, 60);
+    const AdaptivePeriod::TimeType backoff[] = {120, 240, 480, 900, 900};
+    for (const auto expected : backoff) {
+        const AdaptivePeriod::TimeType previous = period.get();
+        if (period.update(false) != (expected != previous)) {
+            stream << endl << "update(false) at " << previous << " reported the wrong change";
+        }
+        check("stable", period, expected);
+    }
+    if (!period.update(true) || period.get() != 60 || period.update(true)) {
+        stream << endl << "update(true) " << period.get();
+    }
+
+    // New bounds keep the period within them, reset() starts over at the minimum.
+    period.update(false);
+    period.set_bounds(30, 90);
+    check("clamped to the new maximum", period, 90);
+    period.reset();
+    check("reset", period, 30);
+
+    // Equal bounds fix the period, and a maximum below the minimum is raised to it.
+    period.set_bounds(300, 100);
+    if (period.get_max() != 300 || period.update(false) || period.get() != 300) {
+        stream << endl << "fixed period " << period.get() << " max " << period.get_max();
+    }
+
+    // No overflow near the top of the range.
+    const AdaptivePeriod::TimeType huge = ~AdaptivePeriod::TimeType(0) - 1;
+    period.set_bounds(huge / 2 + 1, huge);
+    period.update(false);
+    check("near overflow", period, huge);
+
+    if (!stream.str().empty()) {
+        string msg = "test_adaptive_period(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_adaptive_period()." << endl << endl;
+    return 0;
+}
+
+
+int test_retained_object()
+{
+    cout << "Starting test_retained_object()." << endl;
+
+    stringstream stream;
+
+    struct State {
+        explicit State(uint32_t first) : values{first, 0, 0} { }
+        std::array<uint32_t, 3> values;
+        uint32_t count = 0;
+    };
+    static_assert(std::is_trivially_default_constructible_v<RetainedObject<State>>,
+                  "The storage must not be touched by the start-up code.");
+
+    // Zeroed, as RTC memory at power-on: a resume is a cold start.
+    static RetainedObject<State> retained;
+    if (retained.is_constructed() || retained.resume_or_construct(true, 7u) || retained.get().values[0] != 7) {
+        stream << endl << "resume of zeroed storage";
+    }
+    retained.get().values[1] = 8;
+    retained.get().count = 2;
+
+    // A wake-up carries on with the object as it was.
+    if (!retained.resume_or_construct(true, 9u) || retained.get().values[0] != 7 || retained.get().values[1] != 8
+        || retained.get().count != 2) {
+        stream << endl << "resume after a wake-up";
+    }
+
+    // Any other boot starts over.
+    if (retained.resume_or_construct(false, 9u) || retained.get().values[0] != 9 || retained.get().values[1] != 0
+        || retained.get().count != 0) {
+        stream << endl << "construct on a cold start";
+    }
+    retained.invalidate();
+    if (retained.is_constructed() || retained.resume_or_construct(true, 5u) || retained.get().values[0] != 5) {
+        stream << endl << "resume after invalidate()";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_retained_object(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_retained_object()." << endl << endl;
+    return 0;
+}
+
+
+int test_settle_detector()
+{
+    cout << "Starting test_settle_detector()." << endl;
+
+    stringstream stream;
+
+    SettleDetector<uint32_t, 4> settle(10, 3);
+    auto expect = [&](unsigned index, bool expected, const char *what) {
+        if (settle.is_settled(index) != expected) {
+            stream << endl << what << ": pad " << index << " is " << (expected ? "not " : "") << "settled";
+        }
+    };
+
+    expect(1, false, "nothing read yet");
+
+    // No measurement yet, then a run within the tolerance of its first read.
+    for (uint32_t value : {0u, 0u, 0u, 0u, 1000u, 1010u, 990u}) {
+        settle.add(1, value);
+    }
+    expect(1, false, "two reads after the first");
+    settle.add(1, 1005);
+    expect(1, true, "three reads after the first");
+    settle.add(1, 1003);
+    expect(1, true, "a fourth read");
+
+    // A slow drift of less than the tolerance per read keeps starting new runs.
+    for (uint32_t value = 2000; value < 2200; value += 8) {
+        settle.add(2, value);
+    }
+    expect(2, false, "drift");
+
+    // A read beyond the tolerance starts over, so does a 0.
+    settle.add(1, 1020);
+    expect(1, false, "jump");
+    for (uint32_t value : {1020u, 1020u, 1020u}) {
+        settle.add(1, value);
+    }
+    expect(1, true, "after the jump");
+    settle.add(1, 0);
+    expect(1, false, "zero read");
+
+    // At least one read after the first, and reset() starts every pad over.
+    SettleDetector<uint32_t, 2> once(0, 0);
+    once.add(0, 5);
+    if (once.is_settled(0)) {
+        stream << endl << "settled_reads 0 settled on the first read";
+    }
+    once.add(0, 5);
+    if (!once.is_settled(0)) {
+        stream << endl << "settled_reads 0 not settled on the second read";
+    }
+    once.reset();
+    if (once.is_settled(0)) {
+        stream << endl << "settled after reset()";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_settle_detector(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_settle_detector()." << endl << endl;
+    return 0;
+}
+
+
+int test_token_bucket()
+{
+    cout << "Starting test_token_bucket()." << endl;
+
+    stringstream stream;
+    TokenBucket bucket(3, 100);
+    int64_t now = 1000;
+
+    // Starts full: a burst of 3, then limited.
+    for (int count = 0; count < 3; ++count) {
+        if (!bucket.try_take(now)) {
+            stream << endl << "burst take " << count;
+        }
+    }
+    if (bucket.try_take(now) || bucket.get_wait_time(now) != 100) {
+        stream << endl << "take beyond the burst";
+    }
+
+    // One token per refill period, and partial periods are carried over.
+    now += 150;
+    if (!bucket.try_take(now) || bucket.try_take(now)) {
+        stream << endl << "one token after 1.5 periods";
+    }
+    now += 50;
+    if (!bucket.try_take(now)) {
+        stream << endl << "the carried over half period was lost";
+    }
+
+    // A long idle time refills to the capacity, never beyond it.
+    now += 100000;
+    if (bucket.get_tokens(now) != 3) {
+        stream << endl << "refill to capacity: " << bucket.get_tokens(now);
+    }
+    // A full bucket doesn't bank time.
+    bucket.try_take(now);
+    if (bucket.get_wait_time(now) != 0 || bucket.get_tokens(now + 99) != 2 || bucket.get_tokens(now + 100) != 3) {
+        stream << endl << "refill after idle";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_token_bucket(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_token_bucket()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_config_arena()
+{
+    cout << "Starting test_config_arena()." << endl;
+
+    using Arena = ConfigArena<4>;
+    using Type = Arena::ValueType;
+    Arena arena;
+    stringstream stream;
+
+    // A fake namespace, as the NVS iterator and reads would see it.
+    const string ssid = "my network\r\n";
+    const string cert = "-----BEGIN CERTIFICATE-----";
+    const int16_t offset = -1234;
+    const uint8_t bits = 7;
+
+    // Pass 1: the keys are iterated in any order, and nothing is read yet.
+    if (!arena.add("ssid", Type::STRING, ssid.size() + 1) ||
+        !arena.add("cert", Type::BLOB, cert.size()) ||
+        !arena.add("offset", Type::SIGNED, sizeof(offset)) ||
+        !arena.add("bits", Type::UNSIGNED, sizeof(bits))) {
+        stream << endl << "add";
+    }
+    if (arena.add("more", Type::UNSIGNED, 1) || arena.find("ssid")) {
+        stream << endl << "add beyond max_entries, or find before load";
+    }
+
+    // Pass 2: one allocation, filled in key order. A failed read drops its key.
+    string read_order;
+    const bool is_loaded = arena.load([&](const char *key, Type, std::byte *buffer, size_t size) {
+        read_order += key[0];
+        const string name = key;
+        if (name == "ssid") {
+            memcpy(buffer, ssid.c_str(), size);
+        } else if (name == "cert") {
+            memcpy(buffer, cert.data(), size);
+        } else if (name == "offset") {
+            memcpy(buffer, &offset, size);
+        } else {
+            return false;
+        }
+        return true;
+    });
+    if (!is_loaded || read_order != "bcos" || arena.size() != 3) {
+        stream << endl << "load: " << read_order << " " << arena.size();
+    }
+    if (arena.bytes_used() != (ssid.size() + 2) + (cert.size() + 1) + (sizeof(offset) + 1) + (sizeof(bits) + 1)) {
+        stream << endl << "bytes_used: " << arena.bytes_used();
+    }
+
+    // Strings are trimmed and null terminated, blobs are null terminated after their size.
+    if (arena.get_str("ssid") == nullptr || string(arena.get_str("ssid")) != "my network" ||
+        arena.find("ssid").size != strlen("my network") + 1) {
+        stream << endl << "ssid";
+    }
+    const Arena::Value blob = arena.get_blob("cert");
+    if (!blob || blob.size != cert.size() || string(reinterpret_cast<const char *>(blob.data)) != cert) {
+        stream << endl << "cert";
+    }
+    if (arena.get_str("cert") != nullptr) {
+        stream << endl << "a blob is not a string";
+    }
+
+    // Integers, sign extended.
+    int32_t offset_value = 0;
+    uint8_t bits_value = 42;
+    if (!arena.get_integer("offset", offset_value) || offset_value != -1234) {
+        stream << endl << "offset: " << offset_value;
+    }
+    if (arena.get_integer("bits", bits_value) || bits_value != 42 || arena.get_integer("ssid", bits_value)) {
+        stream << endl << "a dropped or non integer key";
+    }
+
+    arena.reset();
+    if (arena.loaded() || arena.find("ssid") || arena.bytes_used() != 0) {
+        stream << endl << "reset";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_config_arena(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_config_arena()." << endl << endl;
+    return 0;
+}
+
+
+struct TestSchema {
+    static constexpr ConfigKey<uint8_t> bits{"average_bits", 7, 0, 10};
+    static constexpr ConfigKey<uint16_t> pads{"active_pads", 0x1e, 0, 0x7ffe};
+    static constexpr ConfigKey<uint32_t> period{"long_period_sec", 60, 2, 86400};
+    static constexpr ConfigStrKey server{"sntp_server", "pool.ntp.org"};
+    static constexpr ConfigBlobKey cert{"ca_cert"};
+};
+static_assert(config_schema_is_valid(TestSchema::bits, TestSchema::pads, TestSchema::period,
+                                     TestSchema::server, TestSchema::cert));
+// Caught at compile time: a too long name, a default out of range, a duplicate name.
+static_assert(!config_schema_is_valid(ConfigKey<uint8_t>{"a_key_that_is_too_long", 0, 0, 1}));
+static_assert(!config_schema_is_valid(ConfigKey<uint8_t>{"bits", 11, 0, 10}));
+static_assert(!config_schema_is_valid(TestSchema::bits, ConfigStrKey{"average_bits"}));
+
+
+int test_config_schema()
+{
+    cout << "Starting test_config_schema()." << endl;
+
+    using Arena = ConfigArena<4>;
+    using Type = Arena::ValueType;
+    Arena arena;
+    stringstream stream;
+
+    // "average_bits" is out of range, "active_pads" was stored as a u32, the rest are missing.
+    const uint8_t bits = 12;
+    const uint32_t pads = 0x0006;
+    arena.add("average_bits", Type::UNSIGNED, sizeof(bits));
+    arena.add("active_pads", Type::UNSIGNED, sizeof(pads));
+    arena.load([&](const char *key, Type, std::byte *buffer, size_t size) {
+        if (string(key) == "average_bits") {
+            memcpy(buffer, &bits, size);
+        } else {
+            memcpy(buffer, &pads, size);
+        }
+        return true;
+    });
+
+    uint8_t bits_value = 0;
+    if (read_config(arena, TestSchema::bits, bits_value) != ConfigReadStatus::OUT_OF_RANGE || bits_value != 7) {
+        stream << endl << "out of range: " << unsigned(bits_value);
+    }
+    uint16_t pads_value = 0;
+    if (read_config(arena, TestSchema::pads, pads_value) != ConfigReadStatus::OK || pads_value != 0x0006) {
+        stream << endl << "another width: " << pads_value;
+    }
+    uint32_t period_value = 0;
+    if (read_config(arena, TestSchema::period, period_value) != ConfigReadStatus::MISSING || period_value != 60) {
+        stream << endl << "missing: " << period_value;
+    }
+    const char *server = read_config(arena, TestSchema::server);
+    if (server == nullptr || string(server) != "pool.ntp.org") {
+        stream << endl << "string default";
+    }
+
+    if (TestSchema::period.in_range(1) || !TestSchema::period.in_range(2) || TestSchema::pads.in_range(0x10000)) {
+        stream << endl << "in_range";
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_config_schema(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_config_schema()." << endl << endl;
+    return 0;
+}
+
+
+
+int test_event_channel()
+{
+    cout << "Starting test_event_channel()." << endl;
+
+    stringstream stream;
+
+    //----------------------------------------------------------------
+    // Single task: pool, posting order and handler selection by id.
+    //----------------------------------------------------------------
+    {
+        using Channel = EventChannel<int, 3>;
+        Channel channel;
+        static vector<pair<int32_t, int>> seen_by_id_1, seen_by_any;
+
+        int instance = channel.register_handler(1, [](void *, int32_t event_id, int& data) {
+            seen_by_id_1.push_back({event_id, data});
+        }, nullptr);
+        channel.register_handler(Channel::ANY_ID, [](void *, int32_t event_id, int& data) {
+            seen_by_any.push_back({event_id, data});
+        }, nullptr);
+
+        int a = channel.acquire(), b = channel.acquire(), c = channel.acquire();
+        if (a < 0 || b < 0 || c < 0 || channel.acquire() != -1 || channel.get_free_count() != 0) {
+            stream << endl << "acquire beyond slot_count";
+        }
+        channel[b] = 20;
+        channel.post(b, 1);
+        channel[a] = 10;
+        channel.post(a, 2);
+        channel.release(c);
+
+        if (channel.dispatch_pending() != 2 || channel.get_free_count() != 3) {
+            stream << endl << "dispatch_pending() must dispatch everything and release the slots";
+        }
+        if (seen_by_id_1 != vector<pair<int32_t, int>>{{1, 20}}
+            || seen_by_any != vector<pair<int32_t, int>>{{1, 20}, {2, 10}})
+        {
+            stream << endl << "posting order or handler selection";
+        }
+
+        // The ring wraps around many times.
+        channel.unregister_handler(instance);
+        seen_by_any.clear();
+        for (int count = 0; count < 100; ++count) {
+            channel.post_copy(3, count);
+            channel.post_copy(3, -count);
+            channel.dispatch_pending();
+        }
+        if (seen_by_any.size() != 200 || seen_by_any[198].second != 99 || seen_by_id_1.size() != 1) {
+            stream << endl << "wrap around, or an unregistered handler was called";
+        }
+    }
+
+    //----------------------------------------------------------------
+    // Many producer tasks and one consumer task.
+    //----------------------------------------------------------------
+    {
+        struct Event {
+            unsigned producer;
+            unsigned sequence;
+        };
+        using Channel = EventChannel<Event, 8>;
+        const unsigned producer_count = 3, events_per_producer = 20000;
+        const int32_t VALUE_ID = 1, STOP_ID = 2;
+
+        struct Consumer {
+            unsigned next_sequence[producer_count] = {};
+            unsigned out_of_order = 0;
+            unsigned received = 0;
+            bool is_stopped = false;
+        } consumer;
+
+        Channel channel;
+        channel.register_handler(VALUE_ID, [](void *arg, int32_t, Event& event) {
+            Consumer *consumer = static_cast<Consumer *>(arg);
+            if (event.sequence != consumer->next_sequence[event.producer]) {
+                ++consumer->out_of_order;
+            }
+            consumer->next_sequence[event.producer] = event.sequence + 1;
+            ++consumer->received;
+        }, &consumer);
+        channel.register_handler(STOP_ID, [](void *arg, int32_t, Event&) {
+            static_cast<Consumer *>(arg)->is_stopped = true;
+        }, &consumer);
+
+        emulated_system_calls_verbose = false;
+        struct tskTaskControlBlock consumerTask(0, "Consumer");
+        consumerTask.indexToNotify = 1;
+        channel.set_consumer(&consumerTask, consumerTask.indexToNotify);
+
+        thread consumer_thread([&] {
+            setTaskControlBlock(&consumerTask);
+            while (!consumer.is_stopped) {
+                channel.dispatch(portMAX_DELAY);
+            }
+        });
+
+        vector<thread> producer_threads;
+        for (unsigned producer = 0; producer < producer_count; ++producer) {
+            producer_threads.emplace_back([&channel, producer, events_per_producer] {
+                for (unsigned sequence = 0; sequence < events_per_producer; ++sequence) {
+                    int slot;
+                    while ((slot = channel.acquire()) < 0) {
+                        this_thread::yield();
+                    }
+                    channel[slot] = Event{producer, sequence};
+                    channel.post(slot, VALUE_ID);
+                }
+            });
+        }
+        for (auto &producer_thread : producer_threads) {
+            producer_thread.join();
+        }
+        while (!channel.post_copy(STOP_ID, Event{})) {
+            this_thread::yield();
+        }
+        consumer_thread.join();
+        emulated_system_calls_verbose = true;
+
+        if (consumer.received != producer_count * events_per_producer || consumer.out_of_order != 0) {
+            stream << endl << "multi producer: received=" << consumer.received
+                   << ", out_of_order=" << consumer.out_of_order;
+        }
+        if (channel.get_free_count() != Channel::slot_count) {
+            stream << endl << "multi producer: slots leaked";
+        }
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_event_channel(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_event_channel()." << endl << endl;
+    return 0;
+}
+
+
+
+//----------------------------------------------------------------
+// A virtual time model of the ESP32 client's periodic work, see test_deadline_scheduler().
+//----------------------------------------------------------------
+using ModelScheduler = DeadlineScheduler<4>;
+
+struct model_job_stats {
+    ModelScheduler *scheduler;
+    const int64_t *now;
+    int job;
+    int64_t slack;
+    int64_t period = 0;
+    unsigned runs = 0;
+    int64_t max_lateness = 0;
+
+    void record_run() {
+        ++runs;
+        // The job runs at 'now', and was due one period before its next due time.
+        max_lateness = std::max(max_lateness, *now - (scheduler->get_due(job) - period));
+    }
+};
+
+struct model_sampler {
+    model_job_stats short_stats, long_stats;
+    unsigned samples_in_window = 0;
+    unsigned window_size = 128;
+};
+
+static void model_tick_callback(void *arg)
+{
+    static_cast<model_job_stats *>(arg)->record_run();
+}
+
+static void model_short_sample_callback(void *arg)
+{
+    model_sampler *sampler = static_cast<model_sampler *>(arg);
+    sampler->short_stats.record_run();
+    if (++sampler->samples_in_window == sampler->window_size) {
+        // The averaging window is complete, stop sampling until the next long period.
+        sampler->short_stats.scheduler->stop(sampler->short_stats.job);
+    }
+}
+
+static void model_long_sample_callback(void *arg)
+{
+    model_sampler *sampler = static_cast<model_sampler *>(arg);
+    sampler->long_stats.record_run();
+    if (sampler->window_size) {
+        sampler->samples_in_window = 0;
+        sampler->short_stats.scheduler->start(sampler->short_stats.job, *sampler->short_stats.now + sampler->short_stats.period);
+    }
+}
+
+
+/*
+Run the model for an hour of virtual time, waking only when the scheduler says so.
+'window_size' is the number of short period samples per long period,
+ 0 when the touch sensor hardware does the sampling (ESP32).
+'with_tick' adds the 1 second app timer tick, as it was before it lost its last handler.
+Returns the number of wake-ups.
+*/
+static unsigned run_scheduler_model(unsigned window_size, bool with_slack, bool with_tick,
+                                    model_job_stats &tick_stats, model_sampler &sampler)
+{
+    const int64_t SECOND = 1000000;
+    ModelScheduler scheduler;
+    int64_t now = 0;
+
+    tick_stats = {&scheduler, &now, 0, with_slack ? SECOND / 2 : 0};
+    tick_stats.period = SECOND;
+    tick_stats.job = scheduler.add_job(model_tick_callback, &tick_stats, tick_stats.period, tick_stats.slack);
+
+    sampler = model_sampler();
+    sampler.window_size = window_size;
+    sampler.long_stats = {&scheduler, &now, 0, with_slack ? SECOND : 0};
+    sampler.long_stats.period = 60 * SECOND;
+    sampler.long_stats.job = scheduler.add_job(model_long_sample_callback, &sampler, sampler.long_stats.period, sampler.long_stats.slack);
+    sampler.short_stats = {&scheduler, &now, 0, 0};
+    sampler.short_stats.period = window_size ? SECOND / window_size : SECOND;
+    sampler.short_stats.job = scheduler.add_job(model_short_sample_callback, &sampler, sampler.short_stats.period, 0);
+
+    // The touch pads start sampling after their warm-up, so the long period is out of phase with the tick.
+    if (with_tick) {
+        scheduler.start(tick_stats.job, now + tick_stats.period);
+    }
+    scheduler.start(sampler.long_stats.job, now + sampler.long_stats.period + 300000);
+
+    // The deadlines at exactly one hour are left out, with or without slack.
+    unsigned wakes = 0;
+    const int64_t end = 3600 * SECOND - 1;
+    while (true) {
+        now = scheduler.get_wake_time();
+        if (now > end) {
+            break;
+        }
+        ++wakes;
+        scheduler.run_due(now);
+    }
+    return wakes;
+}
+
+
+int test_deadline_scheduler()
+{
+    cout << "Starting test_deadline_scheduler()." << endl;
+
+    stringstream stream;
+
+    //----------------------------------------------------------------
+    // Heap order, stop/restart and skipped periods.
+    //----------------------------------------------------------------
+    {
+        DeadlineScheduler<4> scheduler;
+        static vector<int> order;
+        int job_a = scheduler.add_job([](void *) { order.push_back(0); }, nullptr, 100);
+        int job_b = scheduler.add_job([](void *) { order.push_back(1); }, nullptr, 30);
+        int job_c = scheduler.add_job([](void *) { order.push_back(2); }, nullptr, 45);
+        scheduler.add_job([](void *) { }, nullptr, 10);
+        if (scheduler.add_job([](void *) { }, nullptr, 10) != -1) {
+            stream << endl << "add_job() beyond max_jobs";
+        }
+
+        if (scheduler.get_wake_time() != DeadlineScheduler<4>::NEVER) {
+            stream << endl << "wake time with no active jobs";
+        }
+        scheduler.start(job_a, 100);
+        scheduler.start(job_b, 30);
+        scheduler.start(job_c, 50);
+        for (int64_t now = scheduler.get_wake_time(); now <= 100; now = scheduler.get_wake_time()) {
+            scheduler.run_due(now);
+        }
+        // b@30 c@50 b@60 b@90 c@95 a@100
+        const vector<int> expected_order = {1, 2, 1, 1, 2, 0};
+        if (order.size() != expected_order.size() || !std::equal(order.begin(), order.end(), expected_order.begin()) ) {
+            stream << endl << "run order:";
+            for (int job : order) {
+                stream << " " << job;
+            }
+        }
+
+        // Stopped jobs don't run, and a restart replaces the due time.
+        order.clear();
+        scheduler.stop(job_b);
+        scheduler.start(job_c, 1000);
+        scheduler.start(job_c, 500);
+        if (scheduler.get_wake_time() != 200 || scheduler.is_active(job_b)) {
+            stream << endl << "wake time after stop: " << scheduler.get_wake_time();
+        }
+        int due_jobs[4];
+        int64_t due_times[4];
+        const size_t due_count = scheduler.collect_due(500, due_jobs, 4, due_times);
+        for (size_t index = 0; index < due_count; ++index) {
+            scheduler.invoke(due_jobs[index]);
+        }
+        if (due_count != 2 || due_times[0] != 200 || due_times[1] != 500) {
+            stream << endl << "due times: " << due_times[0] << " " << due_times[1];
+        }
+        // a runs late for 200, and skips 300, 400 and 500, so its next due is 600.
+        if (order.size() != 2 || scheduler.get_skipped_count() != 3 || scheduler.get_due(job_a) != 600) {
+            stream << endl << "skipped periods: runs=" << order.size() << " skipped=" << scheduler.get_skipped_count()
+                   << " due=" << scheduler.get_due(job_a);
+        }
+    }
+
+    //----------------------------------------------------------------
+    // Wake-ups per hour of the ESP32 client's periodic work, in virtual time:
+    //  the long sample period (60 s) and the short sample period (1 s / 128 samples,
+    //  stopped after each averaging window), with and without the 1 second app tick.
+    //----------------------------------------------------------------
+    {
+        model_job_stats tick_stats;
+        model_sampler sampler;
+
+        // Every job run is a wake-up with a separate esp_timer per job.
+        // The touch sensor hardware samples (ESP32): the long period rides along with a tick.
+        const unsigned hardware_ticked_wakes = run_scheduler_model(0, true, true, tick_stats, sampler);
+        const unsigned hardware_runs = tick_stats.runs + sampler.long_stats.runs;
+        const unsigned hardware_wakes = run_scheduler_model(0, true, false, tick_stats, sampler);
+        cout << "  hardware sampling, wake-ups per hour: " << hardware_runs << " separate timers, "
+             << hardware_ticked_wakes << " scheduled with the tick, " << hardware_wakes << " without" << endl;
+        if (hardware_ticked_wakes != 3599 || hardware_wakes != 59 || tick_stats.runs != 0 || sampler.long_stats.runs != 59) {
+            stream << endl << "hardware sampling wakes: " << hardware_ticked_wakes << " " << hardware_wakes;
+        }
+
+        // The short period timer samples (ESP32-S2/S3).
+        const unsigned sampling_wakes = run_scheduler_model(128, true, false, tick_stats, sampler);
+        if (sampling_wakes != 59 * 129 || sampler.short_stats.runs != 59 * 128 || sampler.short_stats.max_lateness != 0) {
+            stream << endl << "timer sampling wakes without the tick: " << sampling_wakes;
+        }
+
+        // With the tick, the slack coalesces wake-ups.
+        const unsigned separate_wakes = run_scheduler_model(128, false, true, tick_stats, sampler);
+        const unsigned separate_runs = tick_stats.runs + sampler.long_stats.runs + sampler.short_stats.runs;
+        const unsigned coalesced_wakes = run_scheduler_model(128, true, true, tick_stats, sampler);
+        const unsigned coalesced_runs = tick_stats.runs + sampler.long_stats.runs + sampler.short_stats.runs;
+        cout << "  timer sampling, wake-ups per hour: " << coalesced_runs << " separate timers, "
+             << separate_wakes << " scheduled with the tick without slack, " << coalesced_wakes << " with slack, "
+             << sampling_wakes << " without the tick" << endl;
+
+        // Nothing is lost, every job runs within its slack, and the samples are on time.
+        if (coalesced_runs != separate_runs || tick_stats.runs != 3599 || sampler.long_stats.runs != 59 || sampler.short_stats.runs != 59 * 128) {
+            stream << endl << "job runs: " << coalesced_runs << " vs " << separate_runs;
+        }
+        if (tick_stats.max_lateness > tick_stats.slack || sampler.long_stats.max_lateness > sampler.long_stats.slack
+                || sampler.short_stats.max_lateness != 0) {
+            stream << endl << "lateness: tick=" << tick_stats.max_lateness << " long=" << sampler.long_stats.max_lateness
+                   << " short=" << sampler.short_stats.max_lateness;
+        }
+        if (separate_wakes != separate_runs || coalesced_wakes >= separate_wakes) {
+            stream << endl << "no wake-ups coalesced: " << coalesced_wakes << " vs " << separate_wakes;
+        }
+    }
+
+    if (!stream.str().empty()) {
+        string msg = "test_deadline_scheduler(): " + stream.str();
+        throw std::runtime_error(msg);
+    }
+
+    cout << "Finished test_deadline_scheduler()." << endl << endl;
+    return 0;
+}
+
+
 
 int main()
 {
@@ -319,6 +1789,23 @@ int main()
     //test_lightweight_1p1c_queue();
     //test_lightweight_queue();
     test_fast_array_average();
+    test_lane_mask_average();
+    test_touch_pipeline();
+    test_sorting_network();
+    test_filter_pipeline();
+    test_latest_value_slots();
+    test_fixed_histogram();
+    test_flat_string_map();
+    test_touch_pad_config();
+    test_token_bucket();
+    test_config_arena();
+    test_config_schema();
+    test_event_channel();
+    test_deadline_scheduler();
+    test_tick_timing();
+    test_adaptive_period();
+    test_retained_object();
+    test_settle_detector();
 
     return 0;
 }
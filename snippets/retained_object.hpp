@@ -0,0 +1 @@
+../top-level-components/secure_esp32_client/main/retained_object.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../top-level-components/secure_esp32_client/main/sorting_network.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../top-level-components/secure_esp32_client/main/touch_pipeline.hpp
\ No newline at end of file
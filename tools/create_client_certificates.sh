@@ -104,6 +104,11 @@ do
            -CAcreateserial -out mosq_client.crt \
            ${DAYS_VALID_OPTION} ${PASS_IN_OPTION}
 
+    # DER copies of the MQTT Client certificate and key for the NVS (see nonvolatile_storage.csv).
+    # They are smaller than PEM and are parsed without base64 decoding.
+    openssl x509 -in mosq_client.crt -outform DER -out mosq_client.der
+    openssl pkey -in mosq_client.key -outform DER -out mosq_client.key.der
+
     #-------------------------------------------------------------------------------
     # Generate the MQTT Android private key
     openssl genrsa -out mosq_android.key 2048
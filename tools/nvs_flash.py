@@ -14,6 +14,11 @@ phy_init,data,phy,0xf000,4K,
 factory,app,factory,0x10000,1M,
 ...
 
+The certificates and key in nonvolatile_storage.csv are DER (PEM still works).
+For certificates created before the scripts made DER copies, convert them first with:
+  python3 nvs_flash.py --pem-to-der /project/certificates/mosq_ca.crt /project/certificates/mosq_ca.der
+(one pair of files per run) and then:
+
 $IDF_PATH/components/nvs_flash/nvs_partition_generator/nvs_partition_gen.py \
  generate /project/private/nonvolatile_storage.csv /project/private/nvs_partition.bin 0x3000
 
@@ -28,10 +33,36 @@ esptool.py --chip esp32 -p /dev/ttyACM0 -b 460800 --before=default_reset --after
 
 """
 
-# Before anything else, make sure that the parttool module is imported.
+import base64
 import sys
 import os
 
+
+def pem_to_der(pem_filename, der_filename):
+    """
+    Convert a PEM certificate or (unencrypted) key to DER:
+    DER is the base64 decoded body between the first "-----BEGIN" and "-----END" lines.
+    """
+    with open(pem_filename, 'r') as pem_file:
+        lines = pem_file.read().splitlines()
+    begin = next(index for index, line in enumerate(lines) if line.startswith('-----BEGIN'))
+    end = next(index for index, line in enumerate(lines) if line.startswith('-----END') and index > begin)
+    body = lines[begin + 1:end]
+    if 'ENCRYPTED' in lines[begin] or any(':' in line for line in body):
+        raise ValueError(f'{pem_filename} is encrypted, decrypt it first (e.g. openssl pkey).')
+    der = base64.b64decode(''.join(body))
+    with open(der_filename, 'wb') as der_file:
+        der_file.write(der)
+    print(f'{pem_filename} ({os.path.getsize(pem_filename)} bytes) -> {der_filename} ({len(der)} bytes)')
+
+
+if len(sys.argv) == 4 and sys.argv[1] == '--pem-to-der':
+    pem_to_der(sys.argv[2], sys.argv[3])
+    sys.exit(0)
+
+
+# Before anything else, make sure that the parttool module is imported.
+
 idf_path = os.environ["IDF_PATH"]  # get value of IDF_PATH from environment
 parttool_dir = os.path.join(idf_path, "components", "partition_table")  # parttool.py lives in $IDF_PATH/components/partition_table
 
@@ -93,6 +93,8 @@ openssl req -new -x509 -extensions v3_ca -keyout mosq_ca.key -out mosq_ca.crt \
        -subj "${REGION}/O=ca.${DOMAIN}/OU=ca/CN=${HOSTNAME}/emailAddress=${EMAIL}" \
        ${DAYS_VALID_OPTION} ${PASS_OUT_OPTION}
 openssl x509 -in mosq_ca.crt -noout -text
+# ... and a DER copy of the certificate for the ESP32 clients' NVS (see nonvolatile_storage.csv).
+openssl x509 -in mosq_ca.crt -outform DER -out mosq_ca.der
 
 
 #-------------------------------------------------------------------------------
@@ -33,7 +33,7 @@ class KalmanFilter_1D {
 public:
     using ValueType = float; // ?? double ??
     KalmanFilter_1D() { }
-    virtual ~KalmanFilter_1D() { }
+    ~KalmanFilter_1D() { }
 
     void setInitialValues(
             ValueType initialEstimate,
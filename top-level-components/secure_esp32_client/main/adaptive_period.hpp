@@ -0,0 +1,70 @@
+// adaptive_period.hpp
+
+#ifndef _ADAPTIVE_PERIOD_HPP_
+#define _ADAPTIVE_PERIOD_HPP_
+
+#include <cstdint>
+
+
+/*
+A sampling period that follows how much the samples change, between 'min_period' and 'max_period'
+ (in any unit, e.g. microseconds):
+
+  AdaptivePeriod period(60, 900);
+  if (period.update(changed)) {   // at the end of each window.
+      ... reschedule with period.get() ...
+  }
+
+ - A window that changed snaps the period back to 'min_period', so a change is followed closely.
+ - Each window that did not change doubles the period, up to 'max_period'. So a stable signal backs
+   off exponentially, e.g. 60, 120, 240, 480, 900, 900, ...
+ - With 'min_period' == 'max_period' the period is fixed.
+
+It starts at 'min_period'. It is trivially copyable (e.g. to keep it across deep sleep).
+
+NOTE:
+ - NOT thread safe. The caller must serialize access if it is shared between Tasks.
+*/
+class AdaptivePeriod {
+public:
+    using TimeType = uint64_t;
+
+    AdaptivePeriod(TimeType min_period, TimeType max_period) { set_bounds(min_period, max_period); }
+
+    // 'max_period' is raised to 'min_period' if it is lower. The period is kept within the new bounds.
+    void set_bounds(TimeType new_min_period, TimeType new_max_period) {
+        min_period = new_min_period > 0 ? new_min_period : 1;
+        max_period = new_max_period > min_period ? new_max_period : min_period;
+        period = period < min_period ? min_period : (period > max_period ? max_period : period);
+    }
+
+    // Start over at 'min_period'.
+    void reset() { period = min_period; }
+
+    TimeType get() const { return period; }
+    TimeType get_min() const { return min_period; }
+    TimeType get_max() const { return max_period; }
+
+
+    // 'changed' is whether the last window changed. Returns true if the period changed.
+    bool update(bool changed) {
+        const TimeType previous = period;
+        if (changed) {
+            period = min_period;
+        } else {
+            // Doubling past 'max_period' (or overflowing) stops at 'max_period'.
+            period = (period > max_period / 2) ? max_period : period * 2;
+        }
+        return period != previous;
+    }
+
+
+private:
+    TimeType min_period = 1;
+    TimeType max_period = 1;
+    TimeType period = 1;
+};
+
+
+
+#endif // _ADAPTIVE_PERIOD_HPP_
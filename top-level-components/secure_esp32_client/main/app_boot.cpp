@@ -0,0 +1,233 @@
+/*
+app_boot.cpp
+*/
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_attr.h"
+#include "esp_bit_defs.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "app_boot.h"
+
+
+static const char *LOG_TAG = "app_boot";
+
+// The short names used in the JSON output, in app_boot_stage_t order.
+static const char *const STAGE_NAMES[] = {
+    "nvs",
+    "netif",
+    "wifi",
+    "sntp",
+    "touch",
+    "mqtt",
+    "first",
+};
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == APP_BOOT_STAGE_MAX,
+              "STAGE_NAMES must match app_boot_stage_t");
+
+// One bit per stage, set when the stage is done.
+static EventGroupHandle_t boot_event_group = NULL;
+
+// The done times of one boot, kept in RTC memory across deep sleep.
+// Times are in milliseconds, NOT_DONE for a stage that was not done (e.g. the device went back to sleep first).
+struct app_boot_record {
+    static const uint32_t NOT_DONE = UINT32_MAX;
+    uint32_t boot_number;
+    uint32_t wakeup_cause;
+    uint32_t awake_ms;      // from boot to deep sleep, NOT_DONE if it did not go to sleep (e.g. a reset).
+    uint32_t warm_up_ms;    // see app_boot_touch_warm_up(), NOT_DONE if not done.
+    bool is_warm_up_settled;
+    uint32_t done_ms[APP_BOOT_STAGE_MAX];
+};
+
+// 'boot_history[boot_number % CONFIG_APP_BOOT_HISTORY_SIZE]' is this boot's record.
+// All are (zero) initialized at power-on, and retained across deep sleep.
+RTC_DATA_ATTR static uint32_t boot_number;
+RTC_DATA_ATTR static app_boot_record boot_history[CONFIG_APP_BOOT_HISTORY_SIZE];
+// The boots that ended in deep sleep, and their total time awake (see app_boot_sleep()).
+RTC_DATA_ATTR static uint32_t sleep_count;
+RTC_DATA_ATTR static uint64_t total_awake_ms;
+
+// 'boot_lock' protects everything below (and 'boot_history').
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t stage_begin_us[APP_BOOT_STAGE_MAX];
+static int64_t stage_done_us[APP_BOOT_STAGE_MAX];
+static app_boot_record *current_record = NULL;
+
+
+
+void app_boot_init()
+{
+    for (size_t index = 0; index < APP_BOOT_STAGE_MAX; ++index) {
+        stage_begin_us[index] = -1;
+        stage_done_us[index] = -1;
+    }
+
+    ++boot_number;
+    current_record = &boot_history[boot_number % CONFIG_APP_BOOT_HISTORY_SIZE];
+    current_record->boot_number = boot_number;
+    current_record->wakeup_cause = esp_sleep_get_wakeup_cause();
+    current_record->awake_ms = app_boot_record::NOT_DONE;
+    current_record->warm_up_ms = app_boot_record::NOT_DONE;
+    current_record->is_warm_up_settled = false;
+    for (auto &done_ms : current_record->done_ms) {
+        done_ms = app_boot_record::NOT_DONE;
+    }
+
+    boot_event_group = xEventGroupCreate();
+    assert(boot_event_group);
+}
+
+
+void app_boot_stage_begin(app_boot_stage_t stage)
+{
+    const int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&boot_lock);
+    if (stage_begin_us[stage] < 0) {
+        stage_begin_us[stage] = now;
+    }
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+
+void app_boot_stage_done(app_boot_stage_t stage)
+{
+    const int64_t now = esp_timer_get_time();
+    bool is_first = false;
+    int64_t begin_us;
+    taskENTER_CRITICAL(&boot_lock);
+    if (stage_done_us[stage] < 0) {
+        stage_done_us[stage] = now;
+        current_record->done_ms[stage] = static_cast<uint32_t>(now / 1000);
+        is_first = true;
+    }
+    begin_us = stage_begin_us[stage];
+    taskEXIT_CRITICAL(&boot_lock);
+
+    if (is_first) {
+        ESP_LOGI(LOG_TAG, "Boot stage '%s' done at %lld ms (took %lld ms).", STAGE_NAMES[stage],
+                 (long long)(now / 1000), (long long)(begin_us < 0 ? -1 : (now - begin_us) / 1000));
+        xEventGroupSetBits(boot_event_group, BIT(stage));
+    }
+}
+
+
+bool app_boot_is_done(app_boot_stage_t stage)
+{
+    return xEventGroupGetBits(boot_event_group) & BIT(stage);
+}
+
+
+bool app_boot_wait(app_boot_stage_t stage, TickType_t ticks_to_wait)
+{
+    const EventBits_t bits = xEventGroupWaitBits(boot_event_group, BIT(stage), pdFALSE, pdTRUE, ticks_to_wait);
+    return bits & BIT(stage);
+}
+
+
+void app_boot_touch_warm_up(uint32_t warm_up_ms, bool is_settled)
+{
+    taskENTER_CRITICAL(&boot_lock);
+    current_record->warm_up_ms = warm_up_ms;
+    current_record->is_warm_up_settled = is_settled;
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+
+uint32_t app_boot_sleep()
+{
+    // NOTE: esp_timer starts with the application, so the ROM and 2nd stage bootloader time is not included.
+    const uint32_t awake_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    taskENTER_CRITICAL(&boot_lock);
+    current_record->awake_ms = awake_ms;
+    ++sleep_count;
+    total_awake_ms += awake_ms;
+    taskEXIT_CRITICAL(&boot_lock);
+    return awake_ms;
+}
+
+
+
+int app_boot_snprint_json(char *buffer, size_t size)
+{
+    int64_t begin_us[APP_BOOT_STAGE_MAX];
+    int64_t done_us[APP_BOOT_STAGE_MAX];
+    app_boot_record history[CONFIG_APP_BOOT_HISTORY_SIZE];
+    uint32_t sleeps;
+    uint64_t awake_ms;
+    app_boot_record record;
+    taskENTER_CRITICAL(&boot_lock);
+    for (size_t index = 0; index < APP_BOOT_STAGE_MAX; ++index) {
+        begin_us[index] = stage_begin_us[index];
+        done_us[index] = stage_done_us[index];
+    }
+    memcpy(history, boot_history, sizeof(history));
+    sleeps = sleep_count;
+    awake_ms = total_awake_ms;
+    record = *current_record;
+    taskEXIT_CRITICAL(&boot_lock);
+
+    int total = 0;
+    auto append = [&](int num_of_characters) {
+        if (num_of_characters < 0) {
+            total = -1;
+        } else if (total >= 0) {
+            total += num_of_characters;
+        }
+    };
+    auto remaining = [&]() -> size_t {
+        return (total >= 0 && static_cast<size_t>(total) < size) ? size - total : 0;
+    };
+    auto position = [&]() -> char * {
+        return remaining() ? buffer + total : nullptr;
+    };
+    auto to_ms = [](int64_t time_us) -> long long {
+        return time_us < 0 ? -1 : time_us / 1000;
+    };
+    auto or_not_done = [](uint32_t time_ms) -> long long {
+        return time_ms == app_boot_record::NOT_DONE ? -1LL : (long long)time_ms;
+    };
+
+    append(snprintf(position(), remaining(), "{\"n\":%" PRIu32 ",\"wake\":%" PRIu32 ",\"sleeps\":%" PRIu32
+                    ",\"awake_ms\":%llu,\"warm_up\":[%lld,%d],\"names\":[",
+                    record.boot_number, record.wakeup_cause, sleeps, (unsigned long long)awake_ms,
+                    or_not_done(record.warm_up_ms), record.is_warm_up_settled ? 1 : 0));
+    for (size_t index = 0; index < APP_BOOT_STAGE_MAX; ++index) {
+        append(snprintf(position(), remaining(), index ? ",\"%s\"" : "\"%s\"", STAGE_NAMES[index]));
+    }
+
+    append(snprintf(position(), remaining(), "],\"cur\":["));
+    for (size_t index = 0; index < APP_BOOT_STAGE_MAX; ++index) {
+        append(snprintf(position(), remaining(), index ? ",[%lld,%lld]" : "[%lld,%lld]",
+                        to_ms(begin_us[index]), to_ms(done_us[index])));
+    }
+
+    // The previous boots, newest first. Records of boots before the power-on (boot_number 0) are skipped.
+    append(snprintf(position(), remaining(), "],\"hist\":["));
+    bool is_first = true;
+    for (uint32_t age = 1; age < CONFIG_APP_BOOT_HISTORY_SIZE && age < boot_number; ++age) {
+        const app_boot_record &previous = history[(boot_number - age) % CONFIG_APP_BOOT_HISTORY_SIZE];
+        if (previous.boot_number != boot_number - age) {
+            break;
+        }
+        append(snprintf(position(), remaining(), is_first ? "{\"n\":%" PRIu32 ",\"wake\":%" PRIu32 ",\"awake\":%lld,\"warm_up\":[%lld,%d],\"done\":["
+                                                           : ",{\"n\":%" PRIu32 ",\"wake\":%" PRIu32 ",\"awake\":%lld,\"warm_up\":[%lld,%d],\"done\":[",
+                        previous.boot_number, previous.wakeup_cause, or_not_done(previous.awake_ms),
+                        or_not_done(previous.warm_up_ms), previous.is_warm_up_settled ? 1 : 0));
+        for (size_t index = 0; index < APP_BOOT_STAGE_MAX; ++index) {
+            append(snprintf(position(), remaining(), index ? ",%lld" : "%lld", or_not_done(previous.done_ms[index])));
+        }
+        append(snprintf(position(), remaining(), "]}"));
+        is_first = false;
+    }
+    append(snprintf(position(), remaining(), "]}"));
+    return total;
+}
@@ -0,0 +1,91 @@
+/*
+app_boot.h
+*/
+
+#ifndef _APP_BOOT_H_
+#define _APP_BOOT_H_
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The boot is a small dependency graph of stages, rather than one serial sequence:
+
+    Wi-Fi ──┬──> SNTP ───────────┐
+            └──> MQTT connect    ├──> first touch reading
+    touch warm-up ───────────────┘
+
+Each stage marks its own begin and done, and a stage that depends on others waits for them
+ with app_boot_wait(). So e.g. the touch filters warm up while Wi-Fi associates and the time
+ is synchronized, and the MQTT subscriptions are made as soon as the client is connected.
+
+The begin and done time of every stage (since boot, from esp_timer_get_time()) is reported
+ once the first touch reading has been published, see app_boot_snprint_json().
+The done times are also kept in RTC memory for the last CONFIG_APP_BOOT_HISTORY_SIZE boots,
+ so the boots after waking from deep sleep can be compared with each other.
+ So is the time each boot was awake, from boot to deep sleep (see app_deep_sleep.h).
+*/
+typedef enum {
+    APP_BOOT_STAGE_NVS,             // app_main() started, until the NVS flash is initialized.
+    APP_BOOT_STAGE_NETIF,           // until esp_netif is initialized.
+    APP_BOOT_STAGE_WIFI,            // Wi-Fi station started, until it has an IP address.
+    APP_BOOT_STAGE_SNTP,            // until the time is synchronized (or gave up).
+    APP_BOOT_STAGE_TOUCH_WARM_UP,   // until the touch filters are ready.
+    APP_BOOT_STAGE_MQTT_CONNECT,    // MQTT client started, until the first MQTT_EVENT_CONNECTED.
+    APP_BOOT_STAGE_FIRST_READING,   // first sampling window started, until its value is published (see app_publisher.cpp).
+
+    APP_BOOT_STAGE_MAX
+} app_boot_stage_t;
+
+// Call once, first thing in app_main().
+extern void app_boot_init(void);
+
+// Only the first call per stage counts, so e.g. reconnects don't change the boot times.
+extern void app_boot_stage_begin(app_boot_stage_t stage);
+extern void app_boot_stage_done(app_boot_stage_t stage);
+
+extern bool app_boot_is_done(app_boot_stage_t stage);
+
+// Wait up to 'ticks_to_wait' for 'stage' to be done. Returns true if it is.
+extern bool app_boot_wait(app_boot_stage_t stage, TickType_t ticks_to_wait);
+
+// Call once the touch filters have warmed up: 'warm_up_ms' from the touch sensor start, until they
+//  settled (or until the upper bound, 'is_settled' false). Kept in RTC memory with the boot.
+extern void app_boot_touch_warm_up(uint32_t warm_up_ms, bool is_settled);
+
+// Call right before deep sleep: records the time awake (since boot) in RTC memory.
+// Returns that time, in milliseconds.
+extern uint32_t app_boot_sleep(void);
+
+/*
+Format the boot stages as a compact JSON object, e.g.
+  {"n":12,"wake":4,"sleeps":11,"awake_ms":24310,"warm_up":[640,1],"names":["nvs","netif","wifi","sntp","touch","mqtt","first"],
+   "cur":[[280,301],[301,305],[312,2950],[2951,3420],[330,1001],[2952,4210],[1010,6370]],
+   "hist":[{"n":11,"wake":4,"awake":1840,"warm_up":[590,1],"done":[296,300,-1,-1,920,-1,-1]},...]}
+where:
+  "n" is the boot number (counted since power-on) and "wake" the esp_sleep_wakeup_cause_t (0 = not a wake-up).
+  "sleeps" and "awake_ms" are the number of boots that ended in deep sleep since power-on, and their total time awake.
+  "warm_up" is the [time_ms, settled] of the touch warm-up, see app_boot_touch_warm_up(). settled is 0 if it
+   timed out.
+  "cur" is the [begin_ms, done_ms] of every stage of this boot, in "names" order.
+  "hist" is the time awake, the touch warm-up and the done_ms of every stage of the previous boots still in RTC memory, newest first.
+Stages not begun or not done yet, the time awake of a boot that did not end in deep sleep, and a touch
+ warm-up not done, are -1.
+Return value is the same as snprintf(...).
+*/
+extern int app_boot_snprint_json(char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_BOOT_H_
@@ -6,6 +6,7 @@ app_config.cpp
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "nvs.h"
 
 #include "app_config.hpp"
 
@@ -13,17 +14,99 @@ static const char *LOG_TAG = "app_config";
 
 
 
+template<typename T>
+static esp_err_t read_integer(nvs::NVSHandle &nvs_handle, const char *key, std::byte *buffer)
+{
+    T value;
+    const esp_err_t err = nvs_handle.get_item(key, value);
+    if (err == ESP_OK) {
+        memcpy(buffer, &value, sizeof(value));
+    }
+    return err;
+}
+
+
+static esp_err_t read_integer(nvs::NVSHandle &nvs_handle, const char *key, bool is_signed, std::byte *buffer, size_t size)
+{
+    switch (size) {
+    case 1: return is_signed ? read_integer<int8_t>(nvs_handle, key, buffer) : read_integer<uint8_t>(nvs_handle, key, buffer);
+    case 2: return is_signed ? read_integer<int16_t>(nvs_handle, key, buffer) : read_integer<uint16_t>(nvs_handle, key, buffer);
+    case 4: return is_signed ? read_integer<int32_t>(nvs_handle, key, buffer) : read_integer<uint32_t>(nvs_handle, key, buffer);
+    case 8: return is_signed ? read_integer<int64_t>(nvs_handle, key, buffer) : read_integer<uint64_t>(nvs_handle, key, buffer);
+    default: return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+}
+
+
+
 //------------------------------------------------------------------------------
 // AppConfig
 //------------------------------------------------------------------------------
-AppConfig::AppConfig(const char *nvs_namespace) : nvs_namespace(nvs_namespace) {
+AppConfig::AppConfig(const char *nvs_namespace, LoadMode load_mode) : nvs_namespace(nvs_namespace) {
     esp_err_t err = ESP_OK;
     // nvs_handle is automatically closed on desctruction.
     nvs_handle = nvs::open_nvs_handle(nvs_namespace, NVS_READONLY, &err);
     if (err != ESP_OK) {
         ESP_LOGW(LOG_TAG, "Warning (%s) opening NVS handle for namespace '%s'!",
                  esp_err_to_name(err), nvs_namespace);
+        return;
+    }
+
+    if (load_mode == LoadMode::BULK) {
+        load_namespace();
+        // Everything is in the arena now, the handle is not needed anymore.
+        nvs_handle.reset();
+    }
+}
+
+
+
+/**
+  Copy every value of the namespace into 'arena'.
+  The namespace is iterated once to size the arena, which is then allocated once and filled in.
+*/
+void AppConfig::load_namespace()
+{
+    nvs_iterator_t iterator = nullptr;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, nvs_namespace, NVS_TYPE_ANY, &iterator);
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(iterator, &info);
+
+        size_t size = 0;
+        Arena::ValueType value_type;
+        if (info.type == NVS_TYPE_STR || info.type == NVS_TYPE_BLOB) {
+            value_type = (info.type == NVS_TYPE_STR) ? Arena::ValueType::STRING : Arena::ValueType::BLOB;
+            nvs_handle->get_item_size(info.type == NVS_TYPE_STR ? nvs::ItemType::SZ : nvs::ItemType::BLOB,
+                                      info.key, size);
+        } else {
+            // The low nibble of the integer types is their size, and 0x10 is set for the signed ones.
+            value_type = (info.type & 0x10) ? Arena::ValueType::SIGNED : Arena::ValueType::UNSIGNED;
+            size = info.type & 0x0f;
+        }
+        if (!arena.add(info.key, value_type, size)) {
+            ESP_LOGE(LOG_TAG, "Error - too many keys in namespace '%s', '%s' is ignored!", nvs_namespace, info.key);
+        }
+        err = nvs_entry_next(&iterator);
     }
+    nvs_release_iterator(iterator);
+
+    const bool is_loaded = arena.load([this](const char *key, Arena::ValueType type, std::byte *buffer, size_t size) {
+        switch (type) {
+        case Arena::ValueType::STRING:
+            return nvs_handle->get_string(key, reinterpret_cast<char *>(buffer), size) == ESP_OK;
+        case Arena::ValueType::BLOB:
+            return nvs_handle->get_blob(key, buffer, size) == ESP_OK;
+        default:
+            return read_integer(*nvs_handle, key, type == Arena::ValueType::SIGNED, buffer, size) == ESP_OK;
+        }
+    });
+    if (!is_loaded) {
+        ESP_LOGE(LOG_TAG, "Error - out of memory loading namespace '%s'!", nvs_namespace);
+        return;
+    }
+    ESP_LOGI(LOG_TAG, "Loaded %u keys (%u bytes) from namespace '%s'.",
+             (unsigned)arena.size(), (unsigned)arena.bytes_used(), nvs_namespace);
 }
 
 
@@ -130,14 +213,11 @@ AppConfig::ConfigStr AppConfig::get_blob_as_str(const char *key)
 }
 
 
-/**
-// Uncomment if needed...
-// TODO: data length must also be returned!
-
-AppConfig::ConfigBlob AppConfig::get_blob(const char *key)
+AppConfig::ConfigBlob AppConfig::get_blob(const char *key, size_t &size)
 {
     esp_err_t err;
     ConfigBlob null_result; // Default return value is an null unique_ptr.
+    size = 0;
 
     if (!nvs_handle) {
         ESP_LOGW(LOG_TAG, "Warning - get_blob(%s) - NVS handle not opened for namespace '%s'!", key, nvs_namespace);
@@ -161,13 +241,13 @@ AppConfig::ConfigBlob AppConfig::get_blob(const char *key)
     // Read the previously saved value if available.
     ConfigBlob buffer;
     if (required_size > 0) {
-        //TODO: remove the concept of "null terminator" for this BLOB!
-        // Add 1 to guarantee a null terminator.
+        // Add 1 for a null terminator, so that text (e.g. PEM) blobs can be used as strings.
         buffer = ConfigBlob( new ConfigBlob_T[required_size + 1] );
         err = nvs_handle->get_blob(key, buffer.get(), required_size);
         if (err == ESP_OK) {
             // DO NOT log 'buffer' here because it may contain sensitive information.
             buffer[required_size] = ConfigBlob_T(0); // Guarantee a null terminator.
+            size = required_size;
         } else {
             return null_result;
         }
@@ -175,4 +255,95 @@ AppConfig::ConfigBlob AppConfig::get_blob(const char *key)
 
     return buffer;
 }
-**/
+
+
+
+//------------------------------------------------------------------------------
+// Schema typed values
+//------------------------------------------------------------------------------
+void AppConfig::log_read_status(ConfigReadStatus status, std::string_view key)
+{
+    if (status == ConfigReadStatus::OUT_OF_RANGE) {
+        ESP_LOGW(LOG_TAG, "Warning - '%s':'%.*s' is out of range, using the default!",
+                 nvs_namespace, (int)key.size(), key.data());
+    }
+}
+
+
+const char *AppConfig::get(const ConfigStrKey &key, ValueCache &cache)
+{
+    if (is_bulk_loaded()) {
+        return read_config(arena, key);
+    }
+    if (!cache.is_read) {
+        // The name is a literal, so it is null terminated.
+        ConfigStr str = get_str(key.name.data());
+        cache.data.reset(reinterpret_cast<ConfigBlob_T *>(str.release()));
+        cache.is_read = true;
+    }
+    return cache.data ? reinterpret_cast<const char *>(cache.data.get()) : key.default_value;
+}
+
+
+AppConfig::ConfigBlobView AppConfig::get(const ConfigBlobKey &key, ValueCache &cache)
+{
+    if (is_bulk_loaded()) {
+        return arena.get_blob(key.name);
+    }
+    if (!cache.is_read) {
+        cache.data = get_blob(key.name.data(), cache.size);
+        cache.is_read = true;
+    }
+    ConfigBlobView view;
+    view.data = cache.data.get();
+    view.size = cache.size;
+    return view;
+}
+
+
+
+nvs::NVSHandle *AppConfig::open_write_handle(esp_err_t &err)
+{
+    err = ESP_OK;
+    if (!write_handle) {
+        write_handle = nvs::open_nvs_handle(nvs_namespace, NVS_READWRITE, &err);
+        if (err != ESP_OK) {
+            ESP_LOGE(LOG_TAG, "Error (%s) opening NVS namespace '%s' for writing!", esp_err_to_name(err), nvs_namespace);
+            write_handle.reset();
+        }
+    }
+    return write_handle.get();
+}
+
+
+esp_err_t AppConfig::set(const ConfigStrKey &key, const char *value)
+{
+    if (!value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err;
+    nvs::NVSHandle *handle = open_write_handle(err);
+    return handle ? handle->set_string(key.name.data(), value) : err;
+}
+
+
+esp_err_t AppConfig::set(const ConfigBlobKey &key, const void *data, size_t size)
+{
+    esp_err_t err;
+    nvs::NVSHandle *handle = open_write_handle(err);
+    return handle ? handle->set_blob(key.name.data(), data, size) : err;
+}
+
+
+esp_err_t AppConfig::commit()
+{
+    if (!write_handle) {
+        return ESP_OK;  // nothing was written.
+    }
+    const esp_err_t err = write_handle->commit();
+    if (err != ESP_OK) {
+        ESP_LOGE(LOG_TAG, "Error (%s) committing NVS namespace '%s'!", esp_err_to_name(err), nvs_namespace);
+    }
+    write_handle.reset();
+    return err;
+}
@@ -6,20 +6,74 @@ app_config.hpp
 
 #include <memory>
 #include "nvs_handle.hpp"
+#include "config_arena.hpp"
+#include "config_schema.hpp"
 
 
 //------------------------------------------------------------------------------
+/*
+An NVS namespace of configuration values, in one of two modes:
+
+ - LoadMode::BULK (the default) iterates the namespace once, in the constructor, and copies every
+   value into one contiguous arena (see config_arena.hpp). The NVS handle is closed right away,
+   and the getters return views into the arena, which stay valid for the lifetime of the object.
+
+ - LoadMode::ON_DEMAND keeps the NVS handle open, and each getter reads its own value into
+   its own buffer the first time it is called.
+
+The values are typed by a schema (see config_schema.hpp), and CONFIG_VALUE(SCHEMA, KEY) generates
+ the get_KEY() and set_KEY(...) of each key. The getters return the default of a key
+ that is missing or out of range.
+
+The setters write back to NVS, through an NVS_READWRITE handle that is opened by the first one
+ and closed by commit(). They reject out of range values with ESP_ERR_INVALID_ARG.
+The getters keep returning the values that were loaded, a new config object sees the written ones.
+*/
 class AppConfig {
 public:
     virtual ~AppConfig() { }
 
-protected:
+    enum class LoadMode { BULK, ON_DEMAND };
+
+    // The most keys in one namespace, in LoadMode::BULK.
+    static const std::size_t max_keys = 16;
+    using Arena = ConfigArena<max_keys>;
+
     using ConfigStr_T  = char;
     using ConfigBlob_T = std::byte;
     using ConfigStr  = std::unique_ptr< ConfigStr_T[] >;
     using ConfigBlob = std::unique_ptr< ConfigBlob_T[] >;
+    using ConfigBlobView = Arena::Value;  // 'data' is nullptr if the key is missing.
 
-    AppConfig(const char *nvs_namespace);
+    template<typename T>
+    T get(const ConfigKey<T> &key);
+
+    // 'value' is not deduced, so that e.g. an int can be written to a u8 key.
+    template<typename T>
+    esp_err_t set(const ConfigKey<T> &key, typename ConfigKey<T>::value_type value);
+    esp_err_t set(const ConfigStrKey &key, const char *value);
+    esp_err_t set(const ConfigBlobKey &key, const void *data, size_t size);
+
+    // Commit the values written by the setters, and close the NVS_READWRITE handle.
+    esp_err_t commit();
+
+protected:
+    AppConfig(const char *nvs_namespace, LoadMode load_mode = LoadMode::BULK);
+
+    // The buffer of a string or blob value in LoadMode::ON_DEMAND.
+    struct ValueCache {
+        ConfigBlob data;
+        size_t size = 0;
+        bool is_read = false;
+    };
+
+    template<typename T>
+    T get(const ConfigKey<T> &key, ValueCache &) { return get(key); }
+    const char *get(const ConfigStrKey &key, ValueCache &cache);
+    ConfigBlobView get(const ConfigBlobKey &key, ValueCache &cache);
+
+    bool is_bulk_loaded() const { return arena.loaded(); }
+    const Arena& get_arena() const { return arena; }
 
     ConfigStr get_str(const char *key);
 
@@ -29,93 +83,146 @@ protected:
     // TODO: get the actual maximum string size and reference the URL.
     ConfigStr get_blob_as_str(const char *key);
 
-    // Uncomment if needed...
-    // ConfigBlob get_blob(const char *key);
+    // 'size' is set to the size of the blob. A null terminator is added after it (not included in 'size').
+    ConfigBlob get_blob(const char *key, size_t &size);
 
 private:
     std::unique_ptr<nvs::NVSHandle> nvs_handle;
+    std::unique_ptr<nvs::NVSHandle> write_handle;
     const char *nvs_namespace;
+    Arena arena;
+
+    void load_namespace();
+    nvs::NVSHandle *open_write_handle(esp_err_t &err);
+    void log_read_status(ConfigReadStatus status, std::string_view key);
 };
 
 
 
+template<typename T>
+T AppConfig::get(const ConfigKey<T> &key)
+{
+    T value = key.default_value;
+    if (is_bulk_loaded()) {
+        log_read_status(read_config(arena, key, value), key.name);
+    } else if (nvs_handle) {
+        // The name is a literal, so it is null terminated.
+        T stored;
+        if (nvs_handle->get_item(key.name.data(), stored) == ESP_OK) {
+            if (key.in_range(stored)) {
+                value = stored;
+            } else {
+                log_read_status(ConfigReadStatus::OUT_OF_RANGE, key.name);
+            }
+        }
+    }
+    return value;
+}
+
+
+template<typename T>
+esp_err_t AppConfig::set(const ConfigKey<T> &key, typename ConfigKey<T>::value_type value)
+{
+    if (!key.in_range(value)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err;
+    nvs::NVSHandle *handle = open_write_handle(err);
+    return handle ? handle->set_item(key.name.data(), value) : err;
+}
+
+
+
 //------------------------------------------------------------------------------
 /**
-The macro GET_CONFIG_STR(app_uuid) will generate something like:
+The macro CONFIG_VALUE(WifiSchema, ssid) will generate something like:
 
-const char *get_app_uuid() {
-    if (!app_uuid) {
-        app_uuid = get_str("app_uuid");
-    }
-    return app_uuid.get();
+const char *get_ssid() {
+    // The stored value, or WifiSchema::ssid.default_value.
+    return get(WifiSchema::ssid, ssid_cache);
+}
+esp_err_t set_ssid(const char *value) {
+    return set(WifiSchema::ssid, value);
 }
 */
-#define GET_CONFIG_STR(KEY)                 \
-public:                                     \
-    const char *get_##KEY() {               \
-        if (!KEY) {                         \
-            KEY = get_str(#KEY);            \
-        }                                   \
-        return KEY.get();                   \
-    }                                       \
-private:                                    \
-    ConfigStr KEY;
-
-
-#define GET_CONFIG_BLOB_AS_STR(KEY)         \
-public:                                     \
-    const char *get_##KEY() {               \
-        if (!KEY) {                         \
-            KEY = get_blob_as_str(#KEY);    \
-        }                                   \
-        return KEY.get();                   \
-    }                                       \
-private:                                    \
-    ConfigStr KEY;
+#define CONFIG_VALUE(SCHEMA, KEY)                               \
+public:                                                         \
+    auto get_##KEY() {                                          \
+        return get(SCHEMA::KEY, KEY##_cache);                   \
+    }                                                           \
+    template<typename... Values>                                \
+    esp_err_t set_##KEY(Values... values) {                     \
+        return set(SCHEMA::KEY, values...);                     \
+    }                                                           \
+private:                                                        \
+    ValueCache KEY##_cache;
 
 
 
 //------------------------------------------------------------------------------
+struct GlobalSchema {
+    static constexpr const char *nvs_namespace = "global";
+    static constexpr ConfigStrKey app_uuid{"app_uuid"};
+    // nullptr: the SNTP server of menuconfig (see app_sntp_sync_time.h).
+    static constexpr ConfigStrKey sntp_server{"sntp_server"};
+};
+static_assert(config_schema_is_valid(GlobalSchema::app_uuid, GlobalSchema::sntp_server));
+
 class GlobalConfig: public AppConfig {
 public:
-    GlobalConfig() : AppConfig("global") { }
+    GlobalConfig() : AppConfig(GlobalSchema::nvs_namespace) { }
     // const char *get_app_uuid();
     // const char *get_sntp_server();
-    GET_CONFIG_STR(app_uuid)
-    GET_CONFIG_STR(sntp_server)
+    CONFIG_VALUE(GlobalSchema, app_uuid)
+    CONFIG_VALUE(GlobalSchema, sntp_server)
 };
 
 
 
 //------------------------------------------------------------------------------
+struct WifiSchema {
+    static constexpr const char *nvs_namespace = "wifi";
+    static constexpr ConfigStrKey ssid{"ssid"};
+    static constexpr ConfigStrKey password{"password"};
+};
+static_assert(config_schema_is_valid(WifiSchema::ssid, WifiSchema::password));
+
 class WifiConfig: public AppConfig {
 public:
-    WifiConfig() : AppConfig("wifi") { }
+    WifiConfig() : AppConfig(WifiSchema::nvs_namespace) { }
     // const char *get_ssid();
     // const char *get_password();
-    GET_CONFIG_STR(ssid)
-    GET_CONFIG_STR(password)
+    CONFIG_VALUE(WifiSchema, ssid)
+    CONFIG_VALUE(WifiSchema, password)
 };
 
 
 
 //------------------------------------------------------------------------------
+// The certificates and key may be PEM or DER, see app_tls_credentials.h.
+struct MqttSchema {
+    static constexpr const char *nvs_namespace = "mqtt";
+    static constexpr ConfigStrKey broker_url{"broker_url"};
+    static constexpr ConfigBlobKey ca_cert{"ca_cert"};
+    static constexpr ConfigBlobKey client_cert{"client_cert"};
+    static constexpr ConfigBlobKey client_key{"client_key"};
+};
+static_assert(config_schema_is_valid(MqttSchema::broker_url, MqttSchema::ca_cert,
+                                     MqttSchema::client_cert, MqttSchema::client_key));
+
 class MqttConfig: public AppConfig {
 public:
-    MqttConfig() : AppConfig("mqtt") { }
+    MqttConfig() : AppConfig(MqttSchema::nvs_namespace) { }
     // const char *get_broker_url();
-    // const char *get_ca_cert();
-    // const char *get_client_cert();
-    // const char *get_client_key();
-    GET_CONFIG_STR(broker_url)
-    GET_CONFIG_BLOB_AS_STR(ca_cert)
-    GET_CONFIG_BLOB_AS_STR(client_cert)
-    GET_CONFIG_BLOB_AS_STR(client_key)
+    // ConfigBlobView get_ca_cert();
+    // ConfigBlobView get_client_cert();
+    // ConfigBlobView get_client_key();
+    CONFIG_VALUE(MqttSchema, broker_url)
+    CONFIG_VALUE(MqttSchema, ca_cert)
+    CONFIG_VALUE(MqttSchema, client_cert)
+    CONFIG_VALUE(MqttSchema, client_key)
 };
 
 
 
-#undef GET_CONFIG_STR
-#undef GET_PRIVATE_CONFIG_BLOB_AS_STR
-
 #endif // _CONFIG_HPP_
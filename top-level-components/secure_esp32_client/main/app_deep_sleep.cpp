@@ -0,0 +1,84 @@
+/*
+app_deep_sleep.cpp
+*/
+
+#include <cinttypes>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_bit_defs.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "sdkconfig.h"
+
+#include "app_boot.h"
+#include "app_deep_sleep.h"
+
+
+static const char *LOG_TAG = "app_deep_sleep";
+
+#define NETWORK_REQUESTED_BIT BIT0
+
+static EventGroupHandle_t deep_sleep_event_group = NULL;
+// Set once by app_deep_sleep_init().
+static bool is_wake_up = false;
+
+
+
+void app_deep_sleep_init()
+{
+#if CONFIG_APP_DEEP_SLEEP
+    // Nothing else wakes the device from deep sleep on the RTC timer.
+    is_wake_up = (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER);
+#endif
+
+    deep_sleep_event_group = xEventGroupCreate();
+    assert(deep_sleep_event_group);
+    if (!is_wake_up) {
+        // A normal boot brings the network up right away.
+        xEventGroupSetBits(deep_sleep_event_group, NETWORK_REQUESTED_BIT);
+    } else {
+        ESP_LOGI(LOG_TAG, "Woken from deep sleep, the network waits for the sampler.");
+    }
+}
+
+
+bool app_deep_sleep_is_wake_up()
+{
+    return is_wake_up;
+}
+
+
+void app_deep_sleep_request_network()
+{
+    if (!app_deep_sleep_is_network_requested()) {
+        ESP_LOGI(LOG_TAG, "Network requested.");
+        xEventGroupSetBits(deep_sleep_event_group, NETWORK_REQUESTED_BIT);
+    }
+}
+
+
+bool app_deep_sleep_is_network_requested()
+{
+    return xEventGroupGetBits(deep_sleep_event_group) & NETWORK_REQUESTED_BIT;
+}
+
+
+bool app_deep_sleep_wait_for_network_request(TickType_t ticks_to_wait)
+{
+    const EventBits_t bits = xEventGroupWaitBits(deep_sleep_event_group, NETWORK_REQUESTED_BIT,
+                                                 pdFALSE, pdTRUE, ticks_to_wait);
+    return bits & NETWORK_REQUESTED_BIT;
+}
+
+
+void app_deep_sleep_start(uint64_t sleep_us)
+{
+    const uint32_t awake_ms = app_boot_sleep();
+    ESP_LOGI(LOG_TAG, "Awake for %" PRIu32 " ms, deep sleep for %llu ms.",
+             awake_ms, (unsigned long long)(sleep_us / 1000));
+
+    // Wi-Fi is stopped by esp_deep_sleep_start() itself.
+    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(sleep_us));
+    esp_deep_sleep_start();
+}
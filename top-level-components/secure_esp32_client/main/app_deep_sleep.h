@@ -0,0 +1,57 @@
+/*
+app_deep_sleep.h
+*/
+
+#ifndef _APP_DEEP_SLEEP_H_
+#define _APP_DEEP_SLEEP_H_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Deep sleep duty cycling, for battery powered nodes (CONFIG_APP_DEEP_SLEEP):
+
+    RTC timer wake-up ──> touch warm-up ──> sampling window ──┬──────────────────────────────> deep sleep
+                                                               └──> Wi-Fi, MQTT, publish ──────> deep sleep
+
+ - The sampler decides at the end of its window (see app_touch_pads.cpp). When there is something
+   to publish it calls app_deep_sleep_request_network(), and app_main() carries on with Wi-Fi and MQTT.
+   Otherwise the device goes straight back to sleep, and the network is never brought up.
+ - Any other boot (power-on, reset, ...) is a normal boot: the network is brought up right away,
+   and the device goes to sleep after its first sampling window.
+ - What must survive the sleep is kept in RTC memory (RTC_DATA_ATTR), e.g. the touch pad pipeline.
+ - The time awake of each boot, from boot to sleep, is kept in the boot history (see app_boot_sleep()).
+
+Without CONFIG_APP_DEEP_SLEEP no boot is a wake-up, and the network is always requested.
+*/
+
+// Call once in app_main(), after app_boot_init().
+extern void app_deep_sleep_init(void);
+
+// True if this boot is a wake-up from app_deep_sleep_start().
+extern bool app_deep_sleep_is_wake_up(void);
+
+// Called by the sampler when this wake-up has something to publish. Harmless if already requested.
+extern void app_deep_sleep_request_network(void);
+extern bool app_deep_sleep_is_network_requested(void);
+
+// Wait up to 'ticks_to_wait' for the network to be requested. Returns true if it is.
+extern bool app_deep_sleep_wait_for_network_request(TickType_t ticks_to_wait);
+
+// Record the time awake, and sleep until the RTC timer wakes the device 'sleep_us' from now.
+// Does not return.
+extern void app_deep_sleep_start(uint64_t sleep_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_DEEP_SLEEP_H_
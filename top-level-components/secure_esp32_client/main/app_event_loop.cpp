@@ -0,0 +1,240 @@
+/* app_event_loop.cpp
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "app_event_loop.h"
+#include "app_metrics.h"
+#include "fixed_histogram.hpp"
+
+
+static const char* LOG_TAG = "app_event_loop";
+
+
+//------------------------------------------------------------------------------
+// Instrumentation.
+//------------------------------------------------------------------------------
+// Every event is posted (by app_event_loop_post) inside an envelope that carries its post time.
+// A loop level handler, registered before any other, runs first for every event and records
+//  the post-to-dispatch latency, so it also covers events that have no handler of their own.
+struct app_event_envelope {
+    int64_t post_time_us;
+    uint32_t event_data_size;
+    uint8_t event_data[APP_EVENT_LOOP_MAX_EVENT_DATA_SIZE];
+};
+
+// Events posted and not dispatched yet, including producers waiting for room in the queue.
+static std::atomic<int32_t> queue_depth(0);
+static std::atomic<int32_t> queue_high_water_mark(0);
+
+#define MAX_POST_TIMEOUT_EVENTS APP_EVENT_LOOP_MAX_POST_TIMEOUT_EVENTS
+struct post_timeout_entry {
+    esp_event_base_t event_base;
+    int32_t event_id;
+    uint32_t count;
+};
+
+// 'stats_lock' protects everything below.
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static FixedHistogram<20> dispatch_latency_us;
+static_assert(FixedHistogram<20>::max_json_length == 56 + 11 * 20, "See APP_EVENT_LOOP_JSON_MAX_LENGTH.");
+static post_timeout_entry post_timeouts[MAX_POST_TIMEOUT_EVENTS];
+static size_t post_timeout_event_count = 0;
+
+
+
+static void record_post_timeout(esp_event_base_t event_base, int32_t event_id)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    size_t index = 0;
+    while (index < post_timeout_event_count &&
+           !(post_timeouts[index].event_base == event_base && post_timeouts[index].event_id == event_id)) {
+        ++index;
+    }
+    if (index == post_timeout_event_count && index < MAX_POST_TIMEOUT_EVENTS) {
+        post_timeouts[index] = {event_base, event_id, 0};
+        ++post_timeout_event_count;
+    }
+    if (index < post_timeout_event_count) {
+        ++post_timeouts[index].count;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+
+static void instrumentation_handler(void *handler_args, esp_event_base_t base, int32_t id, void *event_data)
+{
+    const app_event_envelope *envelope = static_cast<const app_event_envelope *>(event_data);
+    const int64_t latency_us = esp_timer_get_time() - envelope->post_time_us;
+    queue_depth.fetch_sub(1, std::memory_order_relaxed);
+
+    taskENTER_CRITICAL(&stats_lock);
+    dispatch_latency_us.add(static_cast<uint32_t>(latency_us));
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+
+
+//------------------------------------------------------------------------------
+// Handlers see the original event data, not the envelope.
+//------------------------------------------------------------------------------
+#define MAX_APP_EVENT_HANDLERS 8
+struct app_event_handler_registration {
+    esp_event_handler_t event_handler;
+    void *event_handler_arg;
+};
+static app_event_handler_registration handler_registrations[MAX_APP_EVENT_HANDLERS];
+static std::atomic<size_t> handler_registration_count(0);
+
+
+static void unwrap_envelope_handler(void *handler_args, esp_event_base_t base, int32_t id, void *event_data)
+{
+    const app_event_handler_registration *registration = static_cast<const app_event_handler_registration *>(handler_args);
+    app_event_envelope *envelope = static_cast<app_event_envelope *>(event_data);
+    registration->event_handler(
+            registration->event_handler_arg, base, id,
+            envelope->event_data_size ? envelope->event_data : NULL
+    );
+}
+
+
+esp_err_t app_event_loop_handler_register(
+        esp_event_loop_handle_t event_loop_handle,
+        esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    const size_t index = handler_registration_count.fetch_add(1);
+    if (index >= MAX_APP_EVENT_HANDLERS) {
+        ESP_LOGE(LOG_TAG, "Too many app event handlers, increase MAX_APP_EVENT_HANDLERS.");
+        return ESP_ERR_NO_MEM;
+    }
+
+    handler_registrations[index] = {event_handler, event_handler_arg};
+    return esp_event_handler_instance_register_with(
+            event_loop_handle, event_base, event_id,
+            unwrap_envelope_handler, &handler_registrations[index], NULL
+    );
+}
+
+
+
+esp_err_t app_event_loop_post(
+        esp_event_loop_handle_t event_loop_handle,
+        esp_event_base_t event_base, int32_t event_id,
+        const void *event_data, size_t event_data_size,
+        TickType_t ticks_to_wait)
+{
+    if (event_data_size > APP_EVENT_LOOP_MAX_EVENT_DATA_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    app_event_envelope envelope;
+    envelope.event_data_size = event_data_size;
+    if (event_data_size) {
+        memcpy(envelope.event_data, event_data, event_data_size);
+    }
+    // Only the used part of the envelope is copied into the event queue.
+    const size_t envelope_size = offsetof(app_event_envelope, event_data) + event_data_size;
+
+    const int32_t depth = queue_depth.fetch_add(1, std::memory_order_relaxed) + 1;
+    int32_t high_water_mark = queue_high_water_mark.load(std::memory_order_relaxed);
+    while (depth > high_water_mark &&
+           !queue_high_water_mark.compare_exchange_weak(high_water_mark, depth, std::memory_order_relaxed)) {
+    }
+
+    envelope.post_time_us = esp_timer_get_time();
+    esp_err_t err = esp_event_post_to(event_loop_handle, event_base, event_id, &envelope, envelope_size, ticks_to_wait);
+    if (err != ESP_OK) {
+        queue_depth.fetch_sub(1, std::memory_order_relaxed);
+        if (err == ESP_ERR_TIMEOUT) {
+            record_post_timeout(event_base, event_id);
+        }
+    }
+    return err;
+}
+
+
+
+int app_event_loop_snprint_json(char *buffer, size_t size)
+{
+    int total = 0;
+    auto append = [&](int num_of_characters) {
+        if (num_of_characters < 0) {
+            total = -1;
+        } else if (total >= 0) {
+            total += num_of_characters;
+        }
+    };
+    auto remaining = [&]() -> size_t {
+        return (total >= 0 && static_cast<size_t>(total) < size) ? size - total : 0;
+    };
+    auto position = [&]() -> char * {
+        return remaining() ? buffer + total : nullptr;
+    };
+
+    // Copy under the lock and format outside of it.
+    taskENTER_CRITICAL(&stats_lock);
+    const FixedHistogram<20> latency_us = dispatch_latency_us;
+    post_timeout_entry timeouts[MAX_POST_TIMEOUT_EVENTS];
+    const size_t timeout_event_count = post_timeout_event_count;
+    memcpy(timeouts, post_timeouts, sizeof(timeouts));
+    taskEXIT_CRITICAL(&stats_lock);
+
+    append(snprintf(position(), remaining(), "{\"q\":%d,\"depth\":%" PRId32 ",\"hwm\":%" PRId32 ",\"post_to\":{",
+                    CONFIG_APP_EVENT_LOOP_QUEUE_SIZE,
+                    queue_depth.load(std::memory_order_relaxed),
+                    queue_high_water_mark.load(std::memory_order_relaxed)));
+    for (size_t index = 0; index < timeout_event_count; ++index) {
+        append(snprintf(position(), remaining(), index ? ",\"%.32s/%" PRId32 "\":%" PRIu32 : "\"%.32s/%" PRId32 "\":%" PRIu32,
+                        timeouts[index].event_base, timeouts[index].event_id, timeouts[index].count));
+    }
+    append(snprintf(position(), remaining(), "},\"lat_us\":"));
+    append(latency_us.snprint_json(position(), remaining()));
+    append(snprintf(position(), remaining(), "}"));
+    return total;
+}
+
+
+
+esp_err_t create_app_event_loop(esp_event_loop_handle_t *event_loop_handle)
+{
+    ESP_LOGI(LOG_TAG, "Creating app event loop.");
+
+    esp_event_loop_args_t event_loop_args = {
+        .queue_size = CONFIG_APP_EVENT_LOOP_QUEUE_SIZE,
+        .task_name = "app_event_loop_task", // task will be created
+        .task_priority = uxTaskPriorityGet(NULL),
+        .task_stack_size = 3072,
+        .task_core_id = tskNO_AFFINITY
+    };
+
+    esp_err_t err_result = esp_event_loop_create(&event_loop_args, event_loop_handle);
+    //ESP_ERROR_CHECK(err_result);
+    if (err_result == ESP_OK) {
+        app_metrics_register_task(xTaskGetHandle(event_loop_args.task_name));
+
+        // Loop level handlers run before the base and event level ones,
+        //  and this is the first one, so it sees every event first.
+        err_result = esp_event_handler_instance_register_with(
+                *event_loop_handle, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID,
+                instrumentation_handler, NULL, NULL
+        );
+    }
+
+    ESP_LOGI(LOG_TAG, "App event loop created.");
+    return err_result;
+}
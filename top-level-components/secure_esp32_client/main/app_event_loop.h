@@ -6,6 +6,7 @@ app_event_loop.h
 #define _APP_EVENT_LOOP_H_
 
 
+#include <stddef.h>
 #include "esp_check.h"
 #include "esp_event.h"
 #include "esp_event_base.h"
@@ -15,8 +16,49 @@ app_event_loop.h
 extern "C" {
 #endif
 
+// The largest event data that can be posted with app_event_loop_post().
+#define APP_EVENT_LOOP_MAX_EVENT_DATA_SIZE 32
+
+/*
+The app event loop is instrumented to size its queue (CONFIG_APP_EVENT_LOOP_QUEUE_SIZE)
+ from data instead of guessing: the queue depth high water mark, the post timeouts
+ per event and the post-to-dispatch latency. See app_event_loop_snprint_json().
+
+NOTE:
+ - All events must be posted with app_event_loop_post() and all handlers registered with
+   app_event_loop_handler_register(). Not with the esp_event_... functions directly.
+*/
 extern esp_err_t create_app_event_loop(esp_event_loop_handle_t *event_loop_handle);
 
+// Same as esp_event_post_to(...), plus the instrumentation.
+extern esp_err_t app_event_loop_post(
+        esp_event_loop_handle_t event_loop_handle,
+        esp_event_base_t event_base, int32_t event_id,
+        const void *event_data, size_t event_data_size,
+        TickType_t ticks_to_wait);
+
+// Same as esp_event_handler_instance_register_with(...), but can not be unregistered.
+extern esp_err_t app_event_loop_handler_register(
+        esp_event_loop_handle_t event_loop_handle,
+        esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler, void *event_handler_arg);
+
+// The post timeouts are counted for up to this many different events.
+#define APP_EVENT_LOOP_MAX_POST_TIMEOUT_EVENTS 8
+
+// The longest app_event_loop_snprint_json() output, without the nul: every post timeout event in use,
+//  and every latency bucket (20) in use, with every number at its widest.
+#define APP_EVENT_LOOP_JSON_MAX_LENGTH (66 + 58 * APP_EVENT_LOOP_MAX_POST_TIMEOUT_EVENTS + 12 + (56 + 11 * 20))
+
+/*
+Format the instrumentation as a compact JSON object, e.g.
+  {"q":5,"depth":0,"hwm":3,"post_to":{"APP_TOUCH_EVENTS/1":2},"lat_us":{"n":..,"min":..,"max":..,"b":[...]}}
+'depth' counts producers still waiting for room in the queue, so 'hwm' can be larger than 'q'.
+The event base names are cut to 32 characters.
+Return value is the same as snprintf(...).
+*/
+extern int app_event_loop_snprint_json(char *buffer, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,16 +17,21 @@ extern "C" {
 ESP_EVENT_DECLARE_BASE(APP_TOUCH_EVENTS);
 enum {
     // Events generated by and sent from the "Touch Pads" module.
-    // DEPRECATED
+    // DEPRECATED: the touch values now go straight to the publisher task (see app_publisher.h),
+    //             but the payload below is still what they carry.
     APP_TOUCH_VALUE_CHANGE_EVENT,
 
     // Events to be sent to the "Touch Pads" module.
-    APP_TOUCH_FORCE_UPDATE,  //TODO: needs to be implemented.
+    // Start a sampling window now and publish every active touch pad at its end.
+    // Rate limited (see CONFIG_APP_TOUCH_FORCE_UPDATE_BURST), no payload.
+    APP_TOUCH_FORCE_UPDATE,
 };
 
 typedef struct {
     time_t utc_timestamp;
+    int64_t sample_time_us; // esp_timer_get_time() when the value was sampled.
     uint32_t touch_value;
+    uint32_t sample_period_sec; // the sampling period the value was taken under (see app_touch_pads.cpp).
     uint8_t touch_pad_num;
 } app_touch_value_change_event_payload;
 
@@ -20,11 +20,15 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 
+#include "app_boot.h"
 #include "app_config.hpp"
+#include "app_deep_sleep.h"
 #include "app_event_loop.h"
 #include "app_mqtt50.h"
+#include "app_publisher.h"
+#include "app_scheduler.h"
 #include "app_sntp_sync_time.h"
-#include "app_timer.h"
+#include "app_tls_credentials.h"
 #include "app_touch_pads.h"
 #include "app_wifi_station.h"
 #include "app_globals.h"
@@ -43,20 +47,34 @@ static globalTaskNotifyParams mqtt_startup_notify;
 
 
 
+static void sntp_sync_time_task(void *pvParameters)
+{
+    app_sntp_sync_time(static_cast<const char *>(pvParameters));
+    vTaskDelete(NULL);
+}
+
+
+
 extern "C" void app_main(void)
 {
     esp_err_t ret;
 
+    app_boot_init();
+    app_deep_sleep_init();
+
     ESP_LOGI(LOG_TAG, "[APP] Startup..");
     ESP_LOGI(LOG_TAG, "[APP] Free memory: %" PRIu32 " bytes", esp_get_free_heap_size());
     ESP_LOGI(LOG_TAG, "[APP] IDF version: %s", esp_get_idf_version());
 
     esp_log_level_set("*", ESP_LOG_INFO);
     esp_log_level_set("Secure_Soil_Moisture", ESP_LOG_VERBOSE);
+    esp_log_level_set("app_boot", ESP_LOG_INFO);
+    esp_log_level_set("app_deep_sleep", ESP_LOG_INFO);
     esp_log_level_set("app_event_loop", ESP_LOG_VERBOSE);
     esp_log_level_set("app_mqtt", ESP_LOG_VERBOSE);
+    esp_log_level_set("app_publisher", ESP_LOG_DEBUG);
+    esp_log_level_set("app_scheduler", ESP_LOG_DEBUG);
     esp_log_level_set("app_sntp_sync_time", ESP_LOG_VERBOSE);
-    esp_log_level_set("app_timer", ESP_LOG_DEBUG);
     esp_log_level_set("app_touch_pads", ESP_LOG_DEBUG);
     esp_log_level_set("app_wifi_station", ESP_LOG_VERBOSE);
 
@@ -68,16 +86,35 @@ extern "C" void app_main(void)
     esp_log_level_set("OUTBOX", ESP_LOG_DEBUG);
 
     // Initialize NVS
+    app_boot_stage_begin(APP_BOOT_STAGE_NVS);
     ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
       ESP_ERROR_CHECK(nvs_flash_erase());
       ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    app_boot_stage_done(APP_BOOT_STAGE_NVS);
 
+    app_boot_stage_begin(APP_BOOT_STAGE_NETIF);
     ESP_ERROR_CHECK(esp_netif_init());
+    app_boot_stage_done(APP_BOOT_STAGE_NETIF);
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(create_app_event_loop(&app_event_loop_handle));
+    app_scheduler_init();
+
+    // The publisher channel handlers must be registered before the touch pads start posting values.
+    app_publisher_init();
+
+    //-------------------------------------------------------------------
+    // The boot is a dependency graph of stages (see app_boot.h).
+    //-------------------------------------------------------------------
+    // The touch pads go first: their filters warm up while Wi-Fi associates
+    //  and the time is synchronized, and sampling starts once both are done.
+    app_read_touch_pads_init(app_event_loop_handle);
+
+    // After a deep sleep wake-up the network is only brought up if the sampling window has
+    //  something to publish, otherwise the sampler puts the device back to sleep first (see app_deep_sleep.h).
+    app_deep_sleep_wait_for_network_request(portMAX_DELAY);
 
     // To be more efficient with stack and memory use
     //  create separate scopes for configuration and initialization variables.
@@ -90,20 +127,23 @@ extern "C" void app_main(void)
     }
 
     // The memory held by 'globalConfig' and 'mqttConfig' are needed for
-    //  the start-up of the task that runs the mqtt client code and
-    //  must not go out-of-soope too soon. See 'ulTaskNotifyTakeIndexed(...)' below.
+    //  the start-up of the tasks that run the SNTP and mqtt client code and
+    //  must not go out-of-soope too soon. See the waits below.
     GlobalConfig globalConfig;
-    app_sntp_sync_time( globalConfig.get_sntp_server() );
 
+    // SNTP and the MQTT connection only depend on Wi-Fi, so they run side by side.
+    xTaskCreate(sntp_sync_time_task, "app_sntp", 1024*4, (void *)globalConfig.get_sntp_server(), uxTaskPriorityGet(NULL), NULL);
+#if CONFIG_MBEDTLS_HAVE_TIME_DATE
+    // Unless the TLS handshake checks the certificate validity dates against the clock.
+    app_boot_wait(APP_BOOT_STAGE_SNTP, portMAX_DELAY);
+#endif
+
+    // Before 'mqttConfig', so that the two copies of the "mqtt" namespace are not in memory at the same time.
+    ESP_ERROR_CHECK(app_tls_credentials_load());
     MqttConfig mqttConfig;
     mqtt_startup_notify.taskToNotify = xTaskGetCurrentTaskHandle();
     mqtt_startup_notify.indexToNotify = MQTT_INDEX_TO_NOTIFY;
-    esp_mqtt_client_handle_t client = app_mqtt50_init(
-            mqttConfig.get_broker_url(),
-            mqttConfig.get_ca_cert(),
-            mqttConfig.get_client_cert(),
-            mqttConfig.get_client_key()
-    );
+    esp_mqtt_client_handle_t client = app_mqtt50_init(mqttConfig.get_broker_url());
     app_mqtt50_start(
             &mqtt_startup_notify,
             app_event_loop_handle,
@@ -112,13 +152,13 @@ extern "C" void app_main(void)
             client
     );
 
-    app_timer_init(app_event_loop_handle);
-    app_read_touch_pads_init(app_event_loop_handle);
-
     // Block until the MQTT client has "started".
     // This in mainly needed to prevent 'mqttConfig' from going out of scope and its memory released.
     // The memory held by 'mqttConfig' is needed for the start-up of the other task that runs the mqtt client code.
     ESP_LOGW(LOG_TAG, "Waiting for the mqtt client start up...");
     ulTaskNotifyTakeIndexed(mqtt_startup_notify.indexToNotify, pdTRUE, (TickType_t)0xffff);
     ESP_LOGW(LOG_TAG, "Done waiting for the mqtt client start up.");
+
+    // The SNTP task uses the server name held by 'globalConfig'.
+    app_boot_wait(APP_BOOT_STAGE_SNTP, portMAX_DELAY);
 }
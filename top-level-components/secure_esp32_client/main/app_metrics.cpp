@@ -0,0 +1,180 @@
+/*
+app_metrics.cpp
+*/
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "app_event_loop.h"
+#include "app_metrics.h"
+#include "fixed_histogram.hpp"
+
+
+// The longest of 'names', see APP_METRICS_MAX_NAME_LENGTH.
+template<std::size_t count>
+static constexpr std::size_t max_name_length(const char *const (&names)[count])
+{
+    std::size_t max_length = 0;
+    for (const char *name : names) {
+        std::size_t length = 0;
+        while (name[length]) {
+            ++length;
+        }
+        max_length = length > max_length ? length : max_length;
+    }
+    return max_length;
+}
+
+
+// The short names used in the JSON output, in app_metric_counter_t order.
+static constexpr const char *COUNTER_NAMES[] = {
+    "pub",
+    "supp",
+    "coal",
+    "post_to",
+    "fu_lim",
+    "ob_full",
+    "enq_err",
+    "mqtt_conn",
+    "mqtt_disc",
+    "wifi_retry",
+    "wifi_scan",
+    "tls_resume_try",
+    "tls_full",
+    "wakes",
+    "sched_skip",
+    "tick_skip",
+};
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == APP_METRIC_COUNTER_MAX,
+              "COUNTER_NAMES must match app_metric_counter_t");
+static_assert(max_name_length(COUNTER_NAMES) <= APP_METRICS_MAX_NAME_LENGTH, "See APP_METRICS_JSON_MAX_SIZE.");
+
+// Counters don't order any other memory, so relaxed atomics are all that's needed.
+static std::atomic<uint32_t> counters[APP_METRIC_COUNTER_MAX];
+
+static std::atomic<TaskHandle_t> tasks[APP_METRICS_MAX_TASKS];
+
+// The short names used in the JSON output, in app_metric_histogram_t order.
+static constexpr const char *HISTOGRAM_NAMES[] = {
+    "wifi_reconn_ms",
+    "tls_ms",
+    "wake_us",
+    "handler_us",
+    "window_ms",
+};
+static_assert(sizeof(HISTOGRAM_NAMES) / sizeof(HISTOGRAM_NAMES[0]) == APP_METRIC_HISTOGRAM_MAX,
+              "HISTOGRAM_NAMES must match app_metric_histogram_t");
+static_assert(max_name_length(HISTOGRAM_NAMES) <= APP_METRICS_MAX_NAME_LENGTH, "See APP_METRICS_JSON_MAX_SIZE.");
+
+using MetricHistogram_t = FixedHistogram<16>;
+static_assert(MetricHistogram_t::max_json_length == 56 + 11 * 16, "See APP_METRICS_JSON_MAX_SIZE.");
+
+// 'histogram_lock' protects 'histograms'.
+static portMUX_TYPE histogram_lock = portMUX_INITIALIZER_UNLOCKED;
+static MetricHistogram_t histograms[APP_METRIC_HISTOGRAM_MAX];
+
+
+
+void app_metrics_increment(app_metric_counter_t counter)
+{
+    counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void app_metrics_add(app_metric_counter_t counter, uint32_t value)
+{
+    counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+
+uint32_t app_metrics_get(app_metric_counter_t counter)
+{
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+
+
+void app_metrics_record(app_metric_histogram_t histogram, uint32_t value)
+{
+    taskENTER_CRITICAL(&histogram_lock);
+    histograms[histogram].add(value);
+    taskEXIT_CRITICAL(&histogram_lock);
+}
+
+
+
+void app_metrics_register_task(TaskHandle_t task)
+{
+    if (!task) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+
+    for (auto &slot : tasks) {
+        TaskHandle_t expected = nullptr;
+        if (slot.compare_exchange_strong(expected, task) || expected == task) {
+            return;
+        }
+    }
+}
+
+
+
+int app_metrics_snprint_json(char *buffer, size_t size)
+{
+    int total = 0;
+    auto append = [&](int num_of_characters) {
+        if (num_of_characters < 0) {
+            total = -1;
+        } else if (total >= 0) {
+            total += num_of_characters;
+        }
+    };
+    auto remaining = [&]() -> size_t {
+        return (total >= 0 && static_cast<size_t>(total) < size) ? size - total : 0;
+    };
+    auto position = [&]() -> char * {
+        return remaining() ? buffer + total : nullptr;
+    };
+
+    append(snprintf(position(), remaining(), "{\"up\":%lld,\"heap\":%" PRIu32 ",\"heap_min\":%" PRIu32 ",\"c\":{",
+                    (long long)(esp_timer_get_time() / 1000000),
+                    esp_get_free_heap_size(),
+                    esp_get_minimum_free_heap_size()));
+
+    for (size_t index = 0; index < APP_METRIC_COUNTER_MAX; ++index) {
+        append(snprintf(position(), remaining(), index ? ",\"%s\":%" PRIu32 : "\"%s\":%" PRIu32,
+                        COUNTER_NAMES[index], counters[index].load(std::memory_order_relaxed)));
+    }
+
+    append(snprintf(position(), remaining(), "},\"stack\":{"));
+    bool is_first = true;
+    for (auto &slot : tasks) {
+        TaskHandle_t task = slot.load();
+        if (!task) {
+            break;
+        }
+        // NOTE: on ESP-IDF the stack high water mark is in bytes.
+        append(snprintf(position(), remaining(), is_first ? "\"%s\":%u" : ",\"%s\":%u",
+                        pcTaskGetName(task), (unsigned)uxTaskGetStackHighWaterMark(task)));
+        is_first = false;
+    }
+
+    append(snprintf(position(), remaining(), "},\"h\":{"));
+    for (size_t index = 0; index < APP_METRIC_HISTOGRAM_MAX; ++index) {
+        // Copy under the lock and format outside of it.
+        taskENTER_CRITICAL(&histogram_lock);
+        const MetricHistogram_t histogram = histograms[index];
+        taskEXIT_CRITICAL(&histogram_lock);
+
+        append(snprintf(position(), remaining(), index ? ",\"%s\":" : "\"%s\":", HISTOGRAM_NAMES[index]));
+        append(histogram.snprint_json(position(), remaining()));
+    }
+    append(snprintf(position(), remaining(), "},\"loop\":"));
+    append(app_event_loop_snprint_json(position(), remaining()));
+    append(snprintf(position(), remaining(), "}"));
+    return total;
+}
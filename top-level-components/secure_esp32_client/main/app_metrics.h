@@ -0,0 +1,101 @@
+/*
+app_metrics.h
+*/
+
+#ifndef _APP_METRICS_H_
+#define _APP_METRICS_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "app_event_loop.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//------------------------------------------------------------------------------
+// Device health counters.
+// They only ever go up (wrapping at 2^32) and are never reset,
+//  so the receiver computes rates from the difference between two reports.
+//------------------------------------------------------------------------------
+typedef enum {
+    APP_METRIC_TOUCH_PUBLISHED,             // touch values put in the MQTT outbox.
+    APP_METRIC_TOUCH_SUPPRESSED,            // averaged touch values within the deadband (not posted).
+    APP_METRIC_TOUCH_COALESCED,             // touch values replaced by a newer one while the outbox was full.
+    APP_METRIC_TOUCH_POST_TIMEOUT,          // touch values not handed to the publisher task, its channel was full.
+    APP_METRIC_TOUCH_FORCE_UPDATE_LIMITED,  // APP_TOUCH_FORCE_UPDATE requests dropped by the rate limit.
+    APP_METRIC_MQTT_OUTBOX_FULL,            // esp_mqtt_client_enqueue() returned -2.
+    APP_METRIC_MQTT_ENQUEUE_FAILED,         // esp_mqtt_client_enqueue() returned -1.
+    APP_METRIC_MQTT_CONNECTED,              // MQTT (re)connects.
+    APP_METRIC_MQTT_DISCONNECTED,
+    APP_METRIC_WIFI_RECONNECTS,             // Wi-Fi station reconnect attempts.
+    APP_METRIC_WIFI_FULL_SCANS,             // Wi-Fi connects that fell back from the cached AP to a full scan.
+    APP_METRIC_TLS_RESUME_ATTEMPTS,         // TLS handshakes offering the last session ticket (see app_tls_transport.h).
+    APP_METRIC_TLS_FULL_HANDSHAKES,         // TLS handshakes without one.
+    APP_METRIC_SCHEDULER_WAKES,             // app scheduler wake-ups (see app_scheduler.h).
+    APP_METRIC_SCHEDULER_SKIPPED,           // periodic job runs skipped because they fell a whole period behind.
+    APP_METRIC_TOUCH_SKIPPED_TICKS,         // touch sample ticks that never reached the sampler (see tick_timing.hpp).
+
+    APP_METRIC_COUNTER_MAX
+} app_metric_counter_t;
+
+
+// Cheap enough for hot paths (a relaxed atomic add), and callable from any task.
+extern void app_metrics_increment(app_metric_counter_t counter);
+extern void app_metrics_add(app_metric_counter_t counter, uint32_t value);
+extern uint32_t app_metrics_get(app_metric_counter_t counter);
+
+
+//------------------------------------------------------------------------------
+// Device health histograms (see fixed_histogram.hpp).
+// Like the counters they are never reset.
+//------------------------------------------------------------------------------
+typedef enum {
+    APP_METRIC_HISTOGRAM_WIFI_RECONNECT_MS, // Wi-Fi link lost, until the station has an IP address again.
+    APP_METRIC_HISTOGRAM_TLS_HANDSHAKE_MS,  // MQTT broker TCP connect and TLS handshake.
+    APP_METRIC_HISTOGRAM_TOUCH_WAKE_US,     // touch sampler wake-up, after the sample tick was due.
+    APP_METRIC_HISTOGRAM_TOUCH_HANDLER_US,  // touch sampler work per sample tick (plus the post at the end of a window).
+    APP_METRIC_HISTOGRAM_TOUCH_WINDOW_MS,   // time covered by each averaging window (1000 ms when on time).
+
+    APP_METRIC_HISTOGRAM_MAX
+} app_metric_histogram_t;
+
+// Callable from any task (it takes a spinlock for a few instructions).
+extern void app_metrics_record(app_metric_histogram_t histogram, uint32_t value);
+
+// Include the stack high water mark of 'task' in the metrics, for up to APP_METRICS_MAX_TASKS tasks.
+// NULL is the calling task. Registering the same task again is harmless.
+#define APP_METRICS_MAX_TASKS 8
+extern void app_metrics_register_task(TaskHandle_t task);
+
+/*
+Format all counters and gauges (uptime, free heap, minimum free heap, and the stack
+high water mark of every registered task) as a compact JSON object, e.g.
+  {"up":300,"heap":81234,"heap_min":70312,"c":{"pub":42,...},"stack":{"app_event_loop_task":812,...},
+   "h":{"wifi_reconn_ms":{"n":2,...},...},"loop":{...}}
+"h" are the histograms, see FixedHistogram::snprint_json().
+"loop" is the app event loop instrumentation, see app_event_loop_snprint_json().
+Return value is the same as snprintf(...).
+*/
+extern int app_metrics_snprint_json(char *buffer, size_t size);
+
+// The longest app_metrics_snprint_json() output, nul included: every number at its widest, names of up to
+//  APP_METRICS_MAX_NAME_LENGTH characters, every task registered, and every histogram bucket (16) in use.
+#define APP_METRICS_MAX_NAME_LENGTH 15
+#define APP_METRICS_JSON_MAX_SIZE (72 + (APP_METRICS_MAX_NAME_LENGTH + 14) * APP_METRIC_COUNTER_MAX \
+                                   + 11 + (configMAX_TASK_NAME_LEN + 14) * APP_METRICS_MAX_TASKS \
+                                   + 7 + (APP_METRICS_MAX_NAME_LENGTH + 4 + 56 + 11 * 16) * APP_METRIC_HISTOGRAM_MAX \
+                                   + 9 + APP_EVENT_LOOP_JSON_MAX_LENGTH + 2)
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_METRICS_H_
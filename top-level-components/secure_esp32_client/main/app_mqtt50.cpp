@@ -6,22 +6,32 @@ app_mqtt50.cpp
 
 #include "freertos/FreeRTOS.h"
 //#include "freertos/task.h"
+#include "driver/touch_pad.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 //#include "esp_system.h"
 #include "mqtt_client.h"
 
+#include "app_boot.h"
+#include "app_event_loop.h"
 #include "app_events.h"
+#include "app_metrics.h"
 #include "app_mqtt50.h"
+#include "app_publisher.h"
+#include "app_touch_pads.h"
 
 
 static const char *LOG_TAG = "app_mqtt";
 
+ESP_EVENT_DEFINE_BASE(APP_MQTT_EVENTS);
+
 static const esp_mqtt_event_id_t APP_EVENT_ANY_ID = static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID);
 
-struct mqtt_publish_params {
-    esp_mqtt_client_handle_t mqtt_client;
-    const char *device_id;
-};
+// The app event loop only carries control events (e.g. APP_TOUCH_FORCE_UPDATE),
+//  the touch values and device statistics are published by the publisher task (see app_publisher.h).
+static esp_event_loop_handle_t app_event_loop_handle = NULL;
+// Set by app_mqtt50_start(), before the client is started.
+static std::string subscribe_device_id;
 
 
 
@@ -90,6 +100,113 @@ static void mqtt_startup_handler(void *handler_args, esp_event_base_t base, int3
 
 
 
+
+
+/*
+Handle the ".../touchpad/update" message (the payload is ignored).
+The request is handed to the "Touch Pads" module, which rate limits it.
+*/
+static void handle_touch_pad_update(std::string_view topic)
+{
+    if (get_device_subtopic(topic) != TOUCH_UPDATE_SUBTOPIC) {
+        return;
+    }
+
+    esp_err_t err = app_event_loop_post(
+            app_event_loop_handle,
+            APP_TOUCH_EVENTS, APP_TOUCH_FORCE_UPDATE,
+            NULL, 0,
+            10 / portTICK_PERIOD_MS
+    );
+    if (err != ESP_OK) {
+        ESP_LOGW(LOG_TAG, "APP_TOUCH_FORCE_UPDATE not posted (%s).", esp_err_to_name(err));
+    }
+}
+
+
+
+/*
+Handle the ".../touchpad/config" and ".../touchpad/<n>/config" messages.
+The settings are carried as MQTT5 user properties (see touch_pad_config.hpp),
+ and are applied on top of the latest touch pad config.
+*/
+static void handle_touch_pad_config(std::string_view topic, const MqttUserProperties& properties)
+{
+    const int touch_pad_num = parse_touch_config_topic(topic);
+    if (touch_pad_num == TOUCH_CONFIG_TOPIC_NONE) {
+        return;
+    }
+
+    TouchPadConfig config = app_touch_pads_get_config();
+    const char *error;
+    if (touch_pad_num == TOUCH_CONFIG_TOPIC_ALL_PADS) {
+        error = apply_touch_pad_config(config, properties.get_user_properties(), TOUCH_PAD_MAX);
+    } else {
+        error = apply_touch_pad_channel_config(config, touch_pad_num, properties.get_user_properties(), TOUCH_PAD_MAX);
+    }
+
+    if (error) {
+        ESP_LOGW(LOG_TAG, "Rejected touch pad config '%.*s': %s", (int)topic.size(), topic.data(), error);
+        return;
+    }
+    app_touch_pads_set_config(config);
+}
+
+
+
+/*
+Subscribe to this device's topics.
+Called on every MQTT_EVENT_CONNECTED, so the subscriptions are made as soon as the client
+ is connected, and are made again after a reconnect (e.g. when the broker lost the session).
+*/
+static void subscribe_to_device_topics(esp_mqtt_client_handle_t client)
+{
+    const char *device_id = subscribe_device_id.c_str();
+    //TODO: make 'qos' a configurable value.
+    const int qos = 0;
+    int rslt;
+    std::ostringstream sstr;
+    std::string topic_str;
+
+    // sstr.str("");
+    // sstr.clear();
+    sstr << "soilmoisture/" << device_id << "/touchpad/config";
+    topic_str = sstr.str();
+
+    rslt = esp_mqtt_client_subscribe(client, topic_str.c_str(), qos);
+    if (rslt >= 0) {
+        ESP_LOGI(LOG_TAG, "Subscribed to '%s'.", topic_str.c_str());
+    } else {
+        ESP_LOGI(LOG_TAG, "FAILED to subscribe to '%s'.", topic_str.c_str());
+    }
+
+    sstr.str("");
+    sstr.clear();
+    sstr << "soilmoisture/" << device_id << "/touchpad/+/config";
+    topic_str = sstr.str();
+
+    rslt = esp_mqtt_client_subscribe(client, topic_str.c_str(), qos);
+    if (rslt >= 0) {
+        ESP_LOGI(LOG_TAG, "Subscribed to '%s'.", topic_str.c_str());
+    } else {
+        ESP_LOGI(LOG_TAG, "FAILED to subscribe to '%s'.", topic_str.c_str());
+    }
+
+    sstr.str("");
+    sstr.clear();
+    sstr << "soilmoisture/" << device_id << "/" << TOUCH_UPDATE_SUBTOPIC;
+    topic_str = sstr.str();
+
+    rslt = esp_mqtt_client_subscribe(client, topic_str.c_str(), qos);
+    if (rslt >= 0) {
+        ESP_LOGI(LOG_TAG, "Subscribed to '%s'.", topic_str.c_str());
+    } else {
+        ESP_LOGI(LOG_TAG, "FAILED to subscribe to '%s'.", topic_str.c_str());
+    }
+}
+
+
+
 /*
  * @brief Event handler registered to receive MQTT events
  *
@@ -103,24 +220,28 @@ static void mqtt_startup_handler(void *handler_args, esp_event_base_t base, int3
 static void mqtt5_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     ESP_LOGD(LOG_TAG, "Event dispatched from event loop base=%s, event_id=%" PRIi32, base, event_id);
-    ESP_LOGD(LOG_TAG, "free heap size is %" PRIu32 ", minimum %" PRIu32,
-             esp_get_free_heap_size(),
-             esp_get_minimum_free_heap_size()
-    );
+    // NOTE: the heap usage is part of the device stats (see publish_device_stats()).
 
     esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(event_data);
 
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_BEFORE_CONNECT:
         ESP_LOGD(LOG_TAG, "MQTT_EVENT_BEFORE_CONNECT");
+        // This handler runs on the MQTT client task.
+        app_metrics_register_task(NULL);
         break;
 
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(LOG_TAG, "MQTT_EVENT_CONNECTED");
+        app_metrics_increment(APP_METRIC_MQTT_CONNECTED);
+        app_boot_stage_done(APP_BOOT_STAGE_MQTT_CONNECT);
+        subscribe_to_device_topics(event->client);
+        app_publisher_notify_connected();
         break;
 
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(LOG_TAG, "MQTT_EVENT_DISCONNECTED");
+        app_metrics_increment(APP_METRIC_MQTT_DISCONNECTED);
         // print_user_property(event->property->user_property);
         break;
 
@@ -135,6 +256,8 @@ static void mqtt5_event_handler(void *handler_args, esp_event_base_t base, int32
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGI(LOG_TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
         // print_user_property(event->property->user_property);
+        app_publisher_record_published(event->msg_id);
+        app_publisher_notify_outbox_ready();
         break;
 
     case MQTT_EVENT_DATA:
@@ -148,8 +271,12 @@ static void mqtt5_event_handler(void *handler_args, esp_event_base_t base, int32
         {
             MqttUserProperties properties(event->property->user_property);
             for (const auto& prop : properties.get_user_properties()) {
-                ESP_LOGI(LOG_TAG, "User Property: key=%s, value=%s", prop.first.c_str(), prop.second.c_str());
+                ESP_LOGI(LOG_TAG, "User Property: key=%.*s, value=%.*s",
+                         (int)prop.first.size(), prop.first.data(),
+                         (int)prop.second.size(), prop.second.data());
             }
+            handle_touch_pad_config(std::string_view(event->topic, event->topic_len), properties);
+            handle_touch_pad_update(std::string_view(event->topic, event->topic_len));
         }
         break;
 
@@ -173,77 +300,6 @@ static void mqtt5_event_handler(void *handler_args, esp_event_base_t base, int32
 
 
 
-/*
-Handle Touch Pad messages coming from the app queue
-and send them out as MQTT messages.
-*/
-static void app_touch_value_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
-{
-    struct mqtt_publish_params *mqtt_publish_params = static_cast<struct mqtt_publish_params *>(handler_args);
-    app_touch_value_change_event_payload *payload = static_cast<app_touch_value_change_event_payload *>(event_data);
-
-
-    // JUST TESTING!
-    if (payload->touch_pad_num == 1) {
-        ESP_LOGI(LOG_TAG, "post - [%u] %lu", payload->touch_pad_num, payload->touch_value);
-    }
-
-
-    const char *topic_str_fmt = "soilmoisture/%s/touchpad/%u";
-    const char *data_str_fmt =  "%lu,%lld";
-
-    // MQTT Topic
-    // soilmoisture/<device-id>/{analog,touchpad}/<sensor-id>
-    // The Message is the sensor's numeric value formatted as a string.
-    // touch_pad_num is 8 bits  ... 2^8 = 256 (i.e. 3 characters)
-    // MQTT Data
-    // touch_value if 16 bits   ... 2^16 = 65536 (i.e. 5 characters)
-    // touch_value if 32 bits   ... 2^32 = 4294967296 (i.e. 10 characters)
-    // utc_timestamp is 64 bits ... 2^64 ~ 18,446,744,073,709,600,000 (i.e. 20 characters)
-    const unsigned device_id_strlen = strlen(mqtt_publish_params->device_id);
-    const unsigned touch_pad_num_strlen = 3;
-    const unsigned touch_value_strlen = 10;
-    const unsigned timestamp_strlen = 20;
-
-    // Calculate the length of each formatted string,
-    //... and always add 1 for the null terminator.
-    const unsigned topic_strlen = strlen(topic_str_fmt)-4 + device_id_strlen + touch_pad_num_strlen + 1;
-    const unsigned data_strlen = strlen(data_str_fmt)-6 + touch_value_strlen + timestamp_strlen + 1;
-
-    char topic[topic_strlen];
-    char data[data_strlen];
-    int num_of_characters;
-    num_of_characters = snprintf(topic, topic_strlen, topic_str_fmt,
-                                 mqtt_publish_params->device_id, payload->touch_pad_num);
-    num_of_characters = snprintf(data, data_strlen, data_str_fmt,
-                                 payload->touch_value, payload->utc_timestamp);
-
-    //TODO: test 'num_of_characters' and handle error situation as necessary.
-
-    // https://docs.espressif.com/projects/esp-idf/en/stable/esp32/api-reference/protocols/mqtt.html#_CPPv416esp_mqtt_event_t
-    // int esp_mqtt_client_enqueue(
-    //     esp_mqtt_client_handle_t client,
-    //     const char *topic,
-    //     const char *data, int len,
-    //     int qos, int retain, bool store
-    // )
-    // Returns message_id if queued successfully, -1 on failure, -2 in case of full outbox.
-    int msg_id = esp_mqtt_client_enqueue(mqtt_publish_params->mqtt_client, topic, data,0, 0,0,true);
-    if (msg_id == -1) {
-        // Failure.
-        ESP_LOGE(LOG_TAG, "FAILURE: esp_mqtt_client_enqueue(): %s, %s", topic, data);
-    } else if (msg_id == -2) {
-        // Outbox Full.
-        ESP_LOGE(LOG_TAG, "OUTBOX FULL: esp_mqtt_client_enqueue(): %s, %s", topic, data);
-    } else {
-        // JUST TESTING!
-        if (payload->touch_pad_num == 1) {
-            ESP_LOGV(LOG_TAG, "MQTT ENQUEUED: msg_id:%d, %s, %s", msg_id, topic, data);
-        }
-    }
-}
-
-
 
 /*
   Important:
@@ -259,6 +315,8 @@ void app_mqtt50_start(
 ) {
     esp_err_t err;
 
+    app_event_loop_handle = event_loop;
+
     // The mqtt_startup_handler is only used to Notify the main thread that the mqtt task
     //  has either successfully started or errored out and that this task will no longer
     //  be accessing the memory allocated to the config arguments pass in to this function.
@@ -273,6 +331,10 @@ void app_mqtt50_start(
         ESP_LOGE(LOG_TAG, "esp_mqtt_client_register_event(...,mqtt5_event_handler): %s!", esp_err_to_name(err));
     }
 
+    // Used by subscribe_to_device_topics() on the MQTT task, so set before the client is started.
+    subscribe_device_id = device_id;
+
+    app_boot_stage_begin(APP_BOOT_STAGE_MQTT_CONNECT);
     err = esp_mqtt_client_start(client);
     if (err != ESP_OK) {
         // MQTT Client failed to start!
@@ -305,66 +367,11 @@ void app_mqtt50_start(
     }
 
 
-    //TODO: write code to determine the better wait condition.
-    // Wait 5 seconds to fully connect before subscribing.
-    const TickType_t xdelay = 5000 / portTICK_PERIOD_MS;
-    vTaskDelay(xdelay);
-
-
     //-------------------------------------------------------------------
-    // Subscribe to MQTT Topics.
+    // Start publishing the Touch Pad values queued up by the sampler.
     //-------------------------------------------------------------------
-    {
-        //TODO: make 'qos' a configurable value.
-        const int qos = 0;
-        int rslt;
-        std::ostringstream sstr;
-        std::string topic_str;
-
-        // sstr.str("");
-        // sstr.clear();
-        sstr << "soilmoisture/" << device_id << "/touchpad/config";
-        topic_str = sstr.str();
-
-        rslt = esp_mqtt_client_subscribe(client, topic_str.c_str(), qos);
-        if (rslt >= 0) {
-            ESP_LOGI(LOG_TAG, "Subscribed to '%s'.", topic_str.c_str());
-        } else {
-            ESP_LOGI(LOG_TAG, "FAILED to subscribe to '%s'.", topic_str.c_str());
-        }
-
-        sstr.str("");
-        sstr.clear();
-        sstr << "soilmoisture/" << device_id << "/touchpad/+/config";
-        topic_str = sstr.str();
-
-        rslt = esp_mqtt_client_subscribe(client, topic_str.c_str(), qos);
-        if (rslt >= 0) {
-            ESP_LOGI(LOG_TAG, "Subscribed to '%s'.", topic_str.c_str());
-        } else {
-            ESP_LOGI(LOG_TAG, "FAILED to subscribe to '%s'.", topic_str.c_str());
-        }
+    err = app_publisher_start(client, device_id);
+    if (err != ESP_OK) {
+        ESP_LOGE(LOG_TAG, "app_publisher_start(): %s!", esp_err_to_name(err));
     }
-
-    //-------------------------------------------------------------------
-    // Start listening for Touch Pad messages coming from the app queue.
-    //-------------------------------------------------------------------
-    const size_t device_id_strlen = strlen(device_id);
-    char *buffer = static_cast<char *>(malloc(device_id_strlen + 1));
-    strncpy(buffer, device_id, device_id_strlen);
-    buffer[device_id_strlen] = '\0';
-
-    // 'mqtt_publish_params' must be static because it must survive after this function returns.
-    static struct mqtt_publish_params mqtt_publish_params;
-    mqtt_publish_params.mqtt_client = client;
-    mqtt_publish_params.device_id = buffer;
-
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(
-            event_loop,
-            APP_TOUCH_EVENTS,
-            APP_TOUCH_VALUE_CHANGE_EVENT,
-            app_touch_value_handler,
-            &mqtt_publish_params,
-            NULL
-    ));
 }
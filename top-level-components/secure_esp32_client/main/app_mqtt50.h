@@ -15,12 +15,8 @@ extern "C" {
 #endif
 
 // function defined in app_mqtt50_init.c
-extern esp_mqtt_client_handle_t app_mqtt50_init(
-        const char *broker_url,
-        const char *ca_cert,
-        const char *client_cert,
-        const char *client_key
-);
+// The TLS credentials must already be loaded, see app_tls_credentials_load().
+extern esp_mqtt_client_handle_t app_mqtt50_init(const char *broker_url);
 
 // function defined in app_mqtt50.cpp
 extern void app_mqtt50_start(
@@ -38,19 +34,25 @@ extern void app_mqtt50_start(
 
 
 #ifdef __cplusplus
-#include <map>
-#include <string>
+#include "flat_string_map.hpp"
 
 /**
 Given 'mqtt5_user_property_handle_t user_property',
 extract the User Properties keys and values
-and store them in an std:map<string,string>.
+and store them in a fixed capacity FlatStringMap (no heap allocation).
 If a key occurs more than once then the last occurrence is kept.
-Properties with either a blank key or blank value are ignored.
+Properties with either a blank key or blank value are ignored,
+as are properties beyond 'max_items' or that don't fit in 'arena_size' bytes.
+
+NOTE: esp_mqtt5_client_get_user_property() itself strdup()s every key and value.
+      Those short lived copies are freed here immediately, in the order they were allocated,
+      so that nothing is left behind to fragment the heap.
 */
 class MqttUserProperties {
 public:
-    using properties_map = std::map<std::string, std::string>;
+    static const std::size_t max_items = 8;
+    static const std::size_t arena_size = 256;
+    using properties_map = FlatStringMap<max_items, arena_size>;
 
     MqttUserProperties()
     { }
@@ -67,13 +69,11 @@ public:
             return;
         }
 
-        esp_mqtt5_user_property_item_t *user_property_item;
-        user_property_item = static_cast<esp_mqtt5_user_property_item_t *>(
-                malloc(prop_count * sizeof(esp_mqtt5_user_property_item_t))
-        );
-        if (!user_property_item) {
-            //TODO: log an appropriate message.
-            return;
+        // esp_mqtt5_client_get_user_property() returns at most 'prop_count' items,
+        //  so size the item array from it, but keep it on the stack and bounded.
+        esp_mqtt5_user_property_item_t user_property_item[max_items];
+        if (prop_count > max_items) {
+            prop_count = max_items;
         }
 
         esp_err_t err = esp_mqtt5_client_get_user_property(user_property, user_property_item, &prop_count);
@@ -82,72 +82,46 @@ public:
                 const char *key = user_property_item[i].key;
                 const char *value = user_property_item[i].value;
                 if (key && *key && value && *value) {
-                    user_properties.insert({key, value});
+                    user_properties.insert_or_assign(key, value);
                 }
-                if (key) {
-                    free((void*)key);
+            }
+            for (uint8_t i = 0; i < prop_count; ++i) {
+                if (user_property_item[i].key) {
+                    free((void*)user_property_item[i].key);
                 }
-                if (value) {
-                    free((void*)value);
+                if (user_property_item[i].value) {
+                    free((void*)user_property_item[i].value);
                 }
             }
         } else {
             // err = ESP_FAIL or ESP_ERR_NO_MEM
             //TODO: log an appropriate message.
-            // make sure 'user_property_item' get freed just below!
-        }
-        free(user_property_item);
-    }
-
-    MqttUserProperties(const MqttUserProperties& other) : user_properties(other.user_properties)
-    { }
-
-    MqttUserProperties(MqttUserProperties&& other) noexcept : user_properties(other.user_properties)
-    { }
-
-    virtual ~MqttUserProperties()
-    { }
-
-
-    // see https://en.cppreference.com/w/cpp/language/operators
-    MqttUserProperties& operator=(const MqttUserProperties& other) {
-        if (this == &other) {
-            return *this;
         }
-        user_properties = other.user_properties;
-        return *this;
     }
 
-    MqttUserProperties& operator=(MqttUserProperties&& other) {
-        if (this == &other) {
-            return *this;
-        }
-        user_properties = other.user_properties;
-        //user_properties = std::move(other.user_properties);
-        return *this;
-    }
+    MqttUserProperties(const MqttUserProperties& other) = default;
+    MqttUserProperties(MqttUserProperties&& other) noexcept = default;
+    MqttUserProperties& operator=(const MqttUserProperties& other) = default;
+    MqttUserProperties& operator=(MqttUserProperties&& other) noexcept = default;
 
 
-    const properties_map& get_user_properties() {
+    const properties_map& get_user_properties() const {
         return user_properties;
     }
 
-    properties_map::iterator find(const properties_map::key_type& key) {
+    properties_map::const_iterator find(std::string_view key) const {
         return user_properties.find(key);
     }
 
-    bool exists(const properties_map::key_type& key) {
-        return user_properties.find(key) != user_properties.end();
+    bool exists(std::string_view key) const {
+        return user_properties.exists(key);
     }
 
-    properties_map::mapped_type& operator[](const properties_map::key_type& key) {
-        return user_properties[key];
+    // Returns an empty view if 'key' does not exist.
+    std::string_view operator[](std::string_view key) const {
+        return user_properties.get(key);
     }
 
-    // properties_map::mapped_type& operator[](properties_map::key_type&& key) {
-    //     return user_properties[key];
-    // }
-
 private:
     properties_map user_properties;
 };
@@ -5,8 +5,13 @@ app_mqtt50_init.c
 //#include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 #include "mqtt_client.h"
+#include "sdkconfig.h"
 
 #include "app_mqtt50.h"
+#include "app_tls_credentials.h"
+#if CONFIG_APP_MQTT_TLS_SESSION_RESUMPTION
+#include "app_tls_transport.h"
+#endif
 
 
 static const char *LOG_TAG = "app_mqtt_init";
@@ -59,12 +64,8 @@ static esp_mqtt5_disconnect_property_config_t disconnect_property = {
 
 
 
-esp_mqtt_client_handle_t app_mqtt50_init(
-        const char *broker_url,
-        const char *ca_cert,
-        const char *client_cert,
-        const char *client_key
-) {
+esp_mqtt_client_handle_t app_mqtt50_init(const char *broker_url)
+{
     ESP_LOGD(LOG_TAG, "app_mqtt50_init(...)");
 
     esp_mqtt5_connection_property_config_t connect_property = {
@@ -84,13 +85,8 @@ esp_mqtt_client_handle_t app_mqtt50_init(
 
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = broker_url,
-        .broker.verification.certificate = ca_cert,
-        .credentials = {
-          .authentication = {
-            .certificate = client_cert,
-            .key = client_key,
-          },
-        },
+        // The CA certificate, client certificate and key are already parsed (see app_tls_credentials.h).
+        .broker.verification.crt_bundle_attach = app_tls_credentials_attach,
         .session.keepalive = 120, //seconds
         .session.disable_keepalive = false,
         .session.protocol_ver = MQTT_PROTOCOL_V_5,
@@ -102,6 +98,11 @@ esp_mqtt_client_handle_t app_mqtt50_init(
         //.network.disable_auto_reconnect = true,
     };
 
+#if CONFIG_APP_MQTT_TLS_SESSION_RESUMPTION
+    // Replaces the client's own mqtts transport.
+    mqtt_cfg.network.transport = app_tls_transport_init();
+#endif
+
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
 
     // Set connection properties and user properties 
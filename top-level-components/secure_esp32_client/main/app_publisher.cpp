@@ -0,0 +1,692 @@
+/*
+app_publisher.cpp
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/touch_pad.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+
+#include "app_boot.h"
+#include "app_deep_sleep.h"
+#include "app_metrics.h"
+#include "app_publisher.h"
+#include "event_channel.hpp"
+#include "fixed_histogram.hpp"
+#include "latest_value_slots.hpp"
+#include "retained_object.hpp"
+
+
+static const char *LOG_TAG = "app_publisher";
+
+
+struct mqtt_publish_params {
+    esp_mqtt_client_handle_t mqtt_client;
+    const char *device_id;
+};
+
+// While the MQTT outbox is full, the latest value of each touch pad is held here
+//  (one slot per pad) instead of being dropped.
+// These slots are only ever accessed from the publisher task.
+using PendingTouchValues_t = LatestValueSlots<app_touch_value_change_event_payload, TOUCH_PAD_MAX>;
+static PendingTouchValues_t pending_touch_values;
+
+// With deep sleep the touch values must be acknowledged before the device sleeps:
+//  an empty outbox only means a QoS 0 message was written to the socket, it can still be lost
+//  when Wi-Fi is torn down. A QoS 1 message stays in the outbox until the broker acknowledged it.
+#if CONFIG_APP_DEEP_SLEEP
+static const int TOUCH_VALUE_QOS = 1;
+#else
+static const int TOUCH_VALUE_QOS = CONFIG_APP_MQTT_TOUCH_VALUE_QOS;
+#endif
+
+// Set (on the publisher task) when esp_mqtt_client_enqueue() reports a full outbox,
+//  and read (on the MQTT task) to decide if the publisher task needs to be woken up.
+static std::atomic<bool> outbox_saturated(false);
+
+
+//------------------------------------------------------------------------------
+// Publish latency and loss instrumentation.
+//------------------------------------------------------------------------------
+// Every touch value message carries a per-device sequence number in the MQTT5 user property "seq",
+//  so that lost messages show up as gaps on the receiving side (see python_tools/sequence_loss_checker.py).
+// The numbers run on across deep sleep (CONFIG_APP_DEEP_SLEEP, in RTC memory). Any other boot starts over at 0
+//  under a new random "epoch" (user property), so the receiver tells a restart apart from lost or late messages.
+// Resumed by app_publisher_init(), and then only accessed from the publisher task.
+struct PublisherSequence {
+    explicit PublisherSequence(uint32_t epoch) : epoch(epoch) { }
+
+    uint32_t epoch;
+    uint32_t next_number = 0;
+};
+#if CONFIG_APP_DEEP_SLEEP
+RTC_DATA_ATTR static RetainedObject<PublisherSequence> sequence;
+#else
+static RetainedObject<PublisherSequence> sequence;
+#endif
+
+// Latencies are in milliseconds. The last bucket holds everything >= 2^14 ms (~16 seconds).
+using LatencyHistogram_t = FixedHistogram<16>;
+
+// The longest publish_latency_stats() output, nul included: "seq" (10 digits) and "qos" (1 digit),
+//  the names of the 3 histograms, and the histograms at their widest.
+static constexpr size_t LATENCY_STATS_JSON_MAX_SIZE = 104 + 3 * LatencyHistogram_t::max_json_length;
+
+// Messages waiting for MQTT_EVENT_PUBLISHED, keyed by msg_id.
+// Only QoS > 0 messages get a unique msg_id and a MQTT_EVENT_PUBLISHED.
+// Messages that are never acknowledged are simply overwritten by newer ones.
+struct inflight_message {
+    int msg_id = -1;
+    int64_t sample_time_us = 0;
+    int64_t enqueue_time_us = 0;
+};
+#define INFLIGHT_MESSAGE_MAX 16
+
+// 'latency_lock' protects everything below.
+// Enqueuing happens on the publisher task while MQTT_EVENT_PUBLISHED is handled on the MQTT task.
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+static inflight_message inflight_messages[INFLIGHT_MESSAGE_MAX];
+static unsigned inflight_next_index = 0;
+static LatencyHistogram_t sample_to_enqueue_ms, enqueue_to_published_ms, sample_to_published_ms;
+
+
+static inline uint32_t elapsed_ms(int64_t from_us, int64_t to_us)
+{
+    return to_us > from_us ? static_cast<uint32_t>((to_us - from_us + 500) / 1000) : 0;
+}
+
+
+static void record_enqueued(int msg_id, int qos, int64_t sample_time_us)
+{
+    const int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&latency_lock);
+    sample_to_enqueue_ms.add(elapsed_ms(sample_time_us, now_us));
+    if (qos > 0) {
+        inflight_message &inflight = inflight_messages[inflight_next_index];
+        inflight.msg_id = msg_id;
+        inflight.sample_time_us = sample_time_us;
+        inflight.enqueue_time_us = now_us;
+        inflight_next_index = (inflight_next_index + 1) % INFLIGHT_MESSAGE_MAX;
+    }
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+
+// Set once by app_publisher_start(), before the publisher task is created.
+static struct mqtt_publish_params publisher_params;
+
+
+//------------------------------------------------------------------------------
+// APP_BOOT_STAGE_FIRST_READING is done once the first touch value of this boot is published: acknowledged
+//  by the broker (QoS 1), or with QoS 0 (never acknowledged) once it is enqueued on a connected client.
+// A value enqueued while MQTT is not connected yet only waits in the outbox.
+//------------------------------------------------------------------------------
+static std::atomic<bool> is_first_reading_enqueued(false);
+// Only meaningful with QoS 1, set right after the first touch value is enqueued.
+static std::atomic<int> first_reading_msg_id(-1);
+
+static void wake_publisher_task();
+
+// Called on the publisher task or the MQTT task, whichever sees it first.
+static void first_reading_published()
+{
+    if (app_boot_is_done(APP_BOOT_STAGE_FIRST_READING)) {
+        return;
+    }
+    app_boot_stage_done(APP_BOOT_STAGE_FIRST_READING);
+    // The boot stats are published by the publisher task, which may have nothing else to do for a while.
+    wake_publisher_task();
+}
+
+
+// Called on the publisher task.
+static void record_first_reading_enqueued(int msg_id, int qos)
+{
+    if (is_first_reading_enqueued) {
+        return;
+    }
+    first_reading_msg_id = msg_id;
+    is_first_reading_enqueued = true;
+    if (qos == 0 && app_boot_is_done(APP_BOOT_STAGE_MQTT_CONNECT)) {
+        first_reading_published();
+    }
+}
+
+
+void app_publisher_notify_connected()
+{
+    // app_boot_stage_done(APP_BOOT_STAGE_MQTT_CONNECT) was called first, see record_first_reading_enqueued().
+    if (TOUCH_VALUE_QOS == 0 && is_first_reading_enqueued) {
+        first_reading_published();
+    }
+    app_publisher_notify_outbox_ready();
+}
+
+
+// Called on the MQTT task.
+void app_publisher_record_published(int msg_id)
+{
+    if (TOUCH_VALUE_QOS > 0 && is_first_reading_enqueued && msg_id == first_reading_msg_id) {
+        first_reading_published();
+    }
+
+    const int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&latency_lock);
+    for (auto &inflight : inflight_messages) {
+        if (inflight.msg_id == msg_id) {
+            enqueue_to_published_ms.add(elapsed_ms(inflight.enqueue_time_us, now_us));
+            sample_to_published_ms.add(elapsed_ms(inflight.sample_time_us, now_us));
+            inflight.msg_id = -1;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+
+
+// Set once the boot stages have been published. Only accessed by the publisher task.
+static bool is_boot_reported = false;
+
+
+/*
+Format a touch value as an MQTT message and put it in the MQTT outbox.
+Returns message_id if queued successfully, -1 on failure, -2 in case of full outbox.
+*/
+static int enqueue_touch_value(
+        const struct mqtt_publish_params *mqtt_publish_params,
+        const app_touch_value_change_event_payload *payload
+) {
+    const char *topic_str_fmt = "soilmoisture/%s/touchpad/%u";
+    const char *data_str_fmt =  "%lu,%lld";
+
+    // MQTT Topic
+    // soilmoisture/<device-id>/{analog,touchpad}/<sensor-id>
+    // The Message is the sensor's numeric value formatted as a string.
+    // touch_pad_num is 8 bits  ... 2^8 = 256 (i.e. 3 characters)
+    // MQTT Data
+    // touch_value if 16 bits   ... 2^16 = 65536 (i.e. 5 characters)
+    // touch_value if 32 bits   ... 2^32 = 4294967296 (i.e. 10 characters)
+    // utc_timestamp is 64 bits ... 2^64 ~ 18,446,744,073,709,600,000 (i.e. 20 characters)
+    const unsigned device_id_strlen = strlen(mqtt_publish_params->device_id);
+    const unsigned touch_pad_num_strlen = 3;
+    const unsigned touch_value_strlen = 10;
+    const unsigned timestamp_strlen = 20;
+
+    // Calculate the length of each formatted string,
+    //... and always add 1 for the null terminator.
+    const unsigned topic_strlen = strlen(topic_str_fmt)-4 + device_id_strlen + touch_pad_num_strlen + 1;
+    const unsigned data_strlen = strlen(data_str_fmt)-6 + touch_value_strlen + timestamp_strlen + 1;
+
+    char topic[topic_strlen];
+    char data[data_strlen];
+    int num_of_characters;
+    num_of_characters = snprintf(topic, topic_strlen, topic_str_fmt,
+                                 mqtt_publish_params->device_id, payload->touch_pad_num);
+    num_of_characters = snprintf(data, data_strlen, data_str_fmt,
+                                 payload->touch_value, payload->utc_timestamp);
+
+    //TODO: test 'num_of_characters' and handle error situation as necessary.
+
+    // https://docs.espressif.com/projects/esp-idf/en/stable/esp32/api-reference/protocols/mqtt.html#_CPPv416esp_mqtt_event_t
+    // int esp_mqtt_client_enqueue(
+    //     esp_mqtt_client_handle_t client,
+    //     const char *topic,
+    //     const char *data, int len,
+    //     int qos, int retain, bool store
+    // )
+    // Attach the sequence number as the MQTT5 user properties "epoch" and "seq",
+    //  and the sampling period (in seconds) as "period".
+    // The publish property is copied into the message when it is enqueued,
+    //  after which the user property list is deleted and the publish property cleared
+    //  so that no other message (e.g. stats) inherits it.
+    PublisherSequence &seq = sequence.get();
+    char epoch_str[9];
+    snprintf(epoch_str, sizeof(epoch_str), "%08" PRIx32, seq.epoch);
+    char seq_str[11];
+    snprintf(seq_str, sizeof(seq_str), "%" PRIu32, seq.next_number);
+    char period_str[11];
+    snprintf(period_str, sizeof(period_str), "%" PRIu32, payload->sample_period_sec);
+    esp_mqtt5_user_property_item_t user_properties[] = {
+        { "epoch", epoch_str },
+        { "seq", seq_str },
+        { "period", period_str },
+    };
+    esp_mqtt5_publish_property_config_t publish_property = {};
+    esp_mqtt5_client_set_user_property(&publish_property.user_property, user_properties,
+                                       sizeof(user_properties) / sizeof(user_properties[0]));
+    esp_mqtt5_client_set_publish_property(mqtt_publish_params->mqtt_client, &publish_property);
+
+    // Returns message_id if queued successfully, -1 on failure, -2 in case of full outbox.
+    const int qos = TOUCH_VALUE_QOS;
+    int msg_id = esp_mqtt_client_enqueue(mqtt_publish_params->mqtt_client, topic, data,0, qos,0,true);
+
+    esp_mqtt5_client_delete_user_property(publish_property.user_property);
+    publish_property.user_property = NULL;
+    esp_mqtt5_client_set_publish_property(mqtt_publish_params->mqtt_client, &publish_property);
+
+    if (msg_id >= 0) {
+        // Only messages that made it into the outbox use up a sequence number,
+        //  so any gap seen by the receiver is a message lost after this point.
+        ++seq.next_number;
+        record_enqueued(msg_id, qos, payload->sample_time_us);
+        app_metrics_increment(APP_METRIC_TOUCH_PUBLISHED);
+        record_first_reading_enqueued(msg_id, qos);
+    }
+
+    if (msg_id == -1) {
+        // Failure.
+        app_metrics_increment(APP_METRIC_MQTT_ENQUEUE_FAILED);
+        ESP_LOGE(LOG_TAG, "FAILURE: esp_mqtt_client_enqueue(): %s, %s", topic, data);
+    } else if (msg_id == -2) {
+        // Outbox Full.
+        app_metrics_increment(APP_METRIC_MQTT_OUTBOX_FULL);
+        ESP_LOGD(LOG_TAG, "OUTBOX FULL: esp_mqtt_client_enqueue(): %s, %s", topic, data);
+    } else {
+        // JUST TESTING!
+        if (payload->touch_pad_num == 1) {
+            ESP_LOGV(LOG_TAG, "MQTT ENQUEUED: msg_id:%d, %s, %s", msg_id, topic, data);
+        }
+    }
+
+    return msg_id;
+}
+
+
+
+/*
+Send out the pending (coalesced) touch values, most recently stored first,
+until they are all sent or the outbox is full again.
+*/
+static void drain_pending_touch_values(const struct mqtt_publish_params *mqtt_publish_params)
+{
+    if (!pending_touch_values.has_pending()) {
+        return;
+    }
+
+    std::size_t sent_count = pending_touch_values.drain(
+        [mqtt_publish_params](std::size_t, const app_touch_value_change_event_payload& payload) {
+            // Only a full outbox keeps the value pending, a failure (-1) is not retried.
+            return enqueue_touch_value(mqtt_publish_params, &payload) != -2;
+        }
+    );
+
+    if (!pending_touch_values.has_pending()) {
+        outbox_saturated.store(false, std::memory_order_relaxed);
+    }
+    ESP_LOGD(LOG_TAG, "Drained %u pending touch values, %u still pending.",
+             (unsigned)sent_count, (unsigned)pending_touch_values.get_pending_count());
+}
+
+
+
+/*
+Send out a touch value coming from the sampler as an MQTT message.
+*/
+static void publish_touch_value(
+        const struct mqtt_publish_params *mqtt_publish_params,
+        const app_touch_value_change_event_payload *payload
+) {
+    // JUST TESTING!
+    if (payload->touch_pad_num == 1) {
+        ESP_LOGI(LOG_TAG, "post - [%u] %lu", payload->touch_pad_num, payload->touch_value);
+    }
+
+    // Older pending values go out before this one so that the outbox can't end up
+    //  holding an older value of a touch pad after its newer value.
+    drain_pending_touch_values(mqtt_publish_params);
+
+    if (!pending_touch_values.has_pending()) {
+        int msg_id = enqueue_touch_value(mqtt_publish_params, payload);
+        if (msg_id != -2) {
+            return;
+        }
+    }
+
+    // The outbox is (still) full. Keep only the latest value of this touch pad
+    //  until the outbox has capacity again.
+    outbox_saturated.store(true, std::memory_order_relaxed);
+    if (pending_touch_values.store(payload->touch_pad_num, *payload)) {
+        app_metrics_increment(APP_METRIC_TOUCH_COALESCED);
+        ESP_LOGD(LOG_TAG, "OUTBOX FULL: touch pad %u value coalesced.", payload->touch_pad_num);
+    } else {
+        ESP_LOGW(LOG_TAG, "OUTBOX FULL: touch pad %u value pending.", payload->touch_pad_num);
+    }
+}
+
+
+
+/*
+Publish the latency statistics gathered since the last time they were published,
+as compact JSON, to "soilmoisture/<device-id>/stats/latency".
+*/
+static void publish_latency_stats(const struct mqtt_publish_params *mqtt_publish_params)
+{
+    LatencyHistogram_t to_enqueue, to_published, total;
+
+    taskENTER_CRITICAL(&latency_lock);
+    to_enqueue = sample_to_enqueue_ms;
+    to_published = enqueue_to_published_ms;
+    total = sample_to_published_ms;
+    sample_to_enqueue_ms.reset();
+    enqueue_to_published_ms.reset();
+    sample_to_published_ms.reset();
+    taskEXIT_CRITICAL(&latency_lock);
+
+    // 'data' is static to keep it off of the publisher task's stack.
+    // This function is only ever called from that one task.
+    static char data[LATENCY_STATS_JSON_MAX_SIZE];
+    int len = snprintf(data, sizeof(data), "{\"seq\":%" PRIu32 ",\"qos\":%d,\"sample_to_enqueue_ms\":",
+                       sequence.get().next_number, TOUCH_VALUE_QOS);
+    len += to_enqueue.snprint_json(data + len, sizeof(data) - len);
+    len += snprintf(data + len, sizeof(data) - len, ",\"enqueue_to_published_ms\":");
+    len += to_published.snprint_json(data + len, sizeof(data) - len);
+    len += snprintf(data + len, sizeof(data) - len, ",\"sample_to_published_ms\":");
+    len += total.snprint_json(data + len, sizeof(data) - len);
+    len += snprintf(data + len, sizeof(data) - len, "}");
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(data)) {
+        ESP_LOGE(LOG_TAG, "publish_latency_stats(): stats truncated!");
+        return;
+    }
+
+    char topic[96];
+    snprintf(topic, sizeof(topic), "soilmoisture/%s/stats/latency", mqtt_publish_params->device_id);
+
+    int msg_id = esp_mqtt_client_enqueue(mqtt_publish_params->mqtt_client, topic, data,len, 0,0,true);
+    if (msg_id < 0) {
+        ESP_LOGW(LOG_TAG, "publish_latency_stats(): esp_mqtt_client_enqueue() = %d", msg_id);
+    } else {
+        ESP_LOGD(LOG_TAG, "%s %s", topic, data);
+    }
+}
+
+
+
+/*
+Publish the boot stages (see app_boot.h), as compact JSON, to "soilmoisture/<device-id>/stats/boot".
+Called once, right after the first touch reading has been published.
+*/
+static void publish_boot_stats(const struct mqtt_publish_params *mqtt_publish_params)
+{
+    // 'data' is static to keep it off of the publisher task's stack.
+    // This function is only ever called from that one task.
+    // Up to about 112 characters per boot in the RTC history.
+    static char data[256 + 112 * CONFIG_APP_BOOT_HISTORY_SIZE];
+    int len = app_boot_snprint_json(data, sizeof(data));
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(data)) {
+        ESP_LOGE(LOG_TAG, "publish_boot_stats(): stats truncated!");
+        return;
+    }
+
+    char topic[96];
+    snprintf(topic, sizeof(topic), "soilmoisture/%s/stats/boot", mqtt_publish_params->device_id);
+
+    int msg_id = esp_mqtt_client_enqueue(mqtt_publish_params->mqtt_client, topic, data,len, 0,0,true);
+    if (msg_id < 0) {
+        ESP_LOGW(LOG_TAG, "publish_boot_stats(): esp_mqtt_client_enqueue() = %d", msg_id);
+    } else {
+        ESP_LOGI(LOG_TAG, "%s %s", topic, data);
+    }
+}
+
+
+static void publish_boot_stats_once(const struct mqtt_publish_params *mqtt_publish_params)
+{
+    if (!is_boot_reported && app_boot_is_done(APP_BOOT_STAGE_FIRST_READING)) {
+        is_boot_reported = true;
+        publish_boot_stats(mqtt_publish_params);
+    }
+}
+
+
+
+/*
+Publish the device metrics (see app_metrics.h), as compact JSON, to "soilmoisture/<device-id>/stats".
+*/
+static void publish_device_stats(const struct mqtt_publish_params *mqtt_publish_params)
+{
+    // 'data' is static to keep it off of the publisher task's stack.
+    // This function is only ever called from that one task.
+    static char data[APP_METRICS_JSON_MAX_SIZE];
+    int len = app_metrics_snprint_json(data, sizeof(data));
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(data)) {
+        ESP_LOGE(LOG_TAG, "publish_device_stats(): stats truncated!");
+        return;
+    }
+
+    char topic[96];
+    snprintf(topic, sizeof(topic), "soilmoisture/%s/stats", mqtt_publish_params->device_id);
+
+    int msg_id = esp_mqtt_client_enqueue(mqtt_publish_params->mqtt_client, topic, data,len, 0,0,true);
+    if (msg_id < 0) {
+        ESP_LOGW(LOG_TAG, "publish_device_stats(): esp_mqtt_client_enqueue() = %d", msg_id);
+    } else {
+        ESP_LOGD(LOG_TAG, "%s %s", topic, data);
+    }
+}
+
+
+
+//------------------------------------------------------------------------------
+// Publisher task and its input channel.
+//------------------------------------------------------------------------------
+// All of the MQTT publishing (formatting, outbox work and statistics) is done on this one task,
+//  so that a slow esp_mqtt_client_enqueue() never delays the control events on the app event loop.
+// The sampler fills a channel slot in place and only the slot index is passed to the publisher task.
+enum {
+    PUBLISHER_TOUCH_VALUE_EVENT,   // from the sampler, see app_publisher_post_touch_value().
+    PUBLISHER_OUTBOX_READY_EVENT,  // see app_publisher_notify_outbox_ready() and wake_publisher_task(). No payload.
+    PUBLISHER_STATS_EVENT,         // see app_publisher_publish_stats(). No payload.
+};
+
+using PublisherChannel_t = EventChannel<app_touch_value_change_event_payload, CONFIG_APP_PUBLISHER_QUEUE_SIZE>;
+static PublisherChannel_t publisher_channel;
+static const UBaseType_t publisherTask_IndexToNotify = 1;
+// Set by the publisher task once it has started.
+static std::atomic<bool> is_publisher_started(false);
+
+
+esp_err_t app_publisher_post_touch_value(time_t utc_timestamp, int64_t sample_time_us, uint8_t touch_pad_num,
+                                         uint32_t touch_value, uint32_t sample_period_sec)
+{
+    const int slot = publisher_channel.acquire();
+    if (slot < 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    app_touch_value_change_event_payload &payload = publisher_channel[slot];
+    payload.utc_timestamp = utc_timestamp;
+    payload.sample_time_us = sample_time_us;
+    payload.touch_value = touch_value;
+    payload.sample_period_sec = sample_period_sec;
+    payload.touch_pad_num = touch_pad_num;
+    publisher_channel.post(slot, PUBLISHER_TOUCH_VALUE_EVENT);
+    return ESP_OK;
+}
+
+
+/*
+Called on the MQTT task when the outbox may have capacity again.
+The pending touch values are drained on the publisher task,
+so that 'pending_touch_values' is only ever accessed from that one task.
+*/
+void app_publisher_notify_outbox_ready()
+{
+    if (!outbox_saturated.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    // Do not block the MQTT task. If the channel is full then the pending values
+    //  will be drained by the next touch value anyway.
+    const int slot = publisher_channel.acquire();
+    if (slot < 0) {
+        ESP_LOGD(LOG_TAG, "Outbox ready not posted, the publisher channel is full.");
+        return;
+    }
+    publisher_channel.post(slot, PUBLISHER_OUTBOX_READY_EVENT);
+}
+
+
+// Have the publisher task run its housekeeping (drain the pending values, publish the boot stats).
+// Never blocks: if the channel is full, the publisher task has work queued anyway.
+static void wake_publisher_task()
+{
+    const int slot = publisher_channel.acquire();
+    if (slot >= 0) {
+        publisher_channel.post(slot, PUBLISHER_OUTBOX_READY_EVENT);
+    }
+}
+
+
+
+void app_publisher_publish_stats()
+{
+    const int slot = publisher_channel.acquire();
+    if (slot < 0) {
+        ESP_LOGW(LOG_TAG, "Stats not published, the publisher channel is full.");
+        return;
+    }
+    publisher_channel.post(slot, PUBLISHER_STATS_EVENT);
+}
+
+
+
+bool app_publisher_is_idle()
+{
+    if (!is_publisher_started) {
+        return false;
+    }
+    // A slot is only released once its handlers have run, and the pending values keep the outbox saturated.
+    if (publisher_channel.get_free_count() != PublisherChannel_t::slot_count
+        || outbox_saturated.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    return esp_mqtt_client_get_outbox_size(publisher_params.mqtt_client) == 0;
+}
+
+
+void app_publisher_disconnect()
+{
+    if (!is_publisher_started) {
+        return;
+    }
+    // DISCONNECT is sent before the connection is closed, so the broker sees a clean disconnect
+    //  rather than a lost connection.
+    esp_mqtt_client_disconnect(publisher_params.mqtt_client);
+    esp_mqtt_client_stop(publisher_params.mqtt_client);
+}
+
+
+
+static void touch_value_handler(void *handler_arg, int32_t event_id, app_touch_value_change_event_payload& payload)
+{
+    const struct mqtt_publish_params *mqtt_publish_params = static_cast<const struct mqtt_publish_params *>(handler_arg);
+    publish_touch_value(mqtt_publish_params, &payload);
+    publish_boot_stats_once(mqtt_publish_params);
+}
+
+
+static void outbox_ready_handler(void *handler_arg, int32_t event_id, app_touch_value_change_event_payload&)
+{
+    const struct mqtt_publish_params *mqtt_publish_params = static_cast<const struct mqtt_publish_params *>(handler_arg);
+    drain_pending_touch_values(mqtt_publish_params);
+    publish_boot_stats_once(mqtt_publish_params);
+}
+
+
+static void stats_handler(void *handler_arg, int32_t event_id, app_touch_value_change_event_payload&)
+{
+    const struct mqtt_publish_params *mqtt_publish_params = static_cast<const struct mqtt_publish_params *>(handler_arg);
+    publish_device_stats(mqtt_publish_params);
+    publish_latency_stats(mqtt_publish_params);
+}
+
+
+
+static void publisher_task(void *pvParameters)
+{
+    app_metrics_register_task(NULL);
+    const struct mqtt_publish_params *mqtt_publish_params = &publisher_params;
+
+    // The touch values posted before now have been waiting in their slots.
+    publisher_channel.set_consumer(xTaskGetCurrentTaskHandle(), publisherTask_IndexToNotify);
+    is_publisher_started = true;
+    ESP_LOGI(LOG_TAG, "Publisher started.");
+
+    const int64_t stats_interval_us = static_cast<int64_t>(CONFIG_APP_STATS_PUBLISH_INTERVAL_SEC) * 1000000;
+    int64_t next_stats_us = esp_timer_get_time() + stats_interval_us;
+
+    while (true) {
+        const int64_t now_us = esp_timer_get_time();
+        if (now_us >= next_stats_us) {
+            publish_device_stats(mqtt_publish_params);
+            publish_latency_stats(mqtt_publish_params);
+            next_stats_us += stats_interval_us;
+            if (next_stats_us <= now_us) {
+                next_stats_us = now_us + stats_interval_us;
+            }
+        }
+
+        // Sleep until the next event, or until the stats are due.
+        const TickType_t ticks_to_wait = pdMS_TO_TICKS((next_stats_us - now_us) / 1000) + 1;
+        publisher_channel.dispatch(ticks_to_wait);
+    }
+}
+
+
+
+void app_publisher_init()
+{
+    // The sequence carries on after a deep sleep wake-up, any other boot starts a new epoch.
+    sequence.resume_or_construct(app_deep_sleep_is_wake_up(), esp_random());
+
+    publisher_channel.register_handler(PUBLISHER_TOUCH_VALUE_EVENT, touch_value_handler, &publisher_params);
+    publisher_channel.register_handler(PUBLISHER_OUTBOX_READY_EVENT, outbox_ready_handler, &publisher_params);
+    publisher_channel.register_handler(PUBLISHER_STATS_EVENT, stats_handler, &publisher_params);
+}
+
+
+esp_err_t app_publisher_start(esp_mqtt_client_handle_t client, const char *device_id)
+{
+    // The publisher task keeps its own copy of 'device_id'.
+    const size_t device_id_strlen = strlen(device_id);
+    char *buffer = static_cast<char *>(malloc(device_id_strlen + 1));
+    if (!buffer) {
+        ESP_LOGE(LOG_TAG, "Could not copy the device id!");
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(buffer, device_id, device_id_strlen);
+    buffer[device_id_strlen] = '\0';
+
+    publisher_params.mqtt_client = client;
+    publisher_params.device_id = buffer;
+
+#if CONFIG_APP_PUBLISHER_TASK_CORE < 0
+    const BaseType_t core_id = tskNO_AFFINITY;
+#else
+    const BaseType_t core_id = CONFIG_APP_PUBLISHER_TASK_CORE;
+#endif
+    BaseType_t rslt = xTaskCreatePinnedToCore(
+            publisher_task, "app_publisher",
+            CONFIG_APP_PUBLISHER_TASK_STACK_SIZE, NULL,
+            CONFIG_APP_PUBLISHER_TASK_PRIORITY,
+            NULL, core_id
+    );
+    if (rslt != pdPASS) {
+        ESP_LOGE(LOG_TAG, "Could not create the publisher task!");
+        publisher_params.device_id = NULL;
+        free(buffer);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,67 @@
+/*
+app_publisher.h
+*/
+
+#ifndef _APP_PUBLISHER_H_
+#define _APP_PUBLISHER_H_
+
+
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_event.h"
+#include "mqtt_client.h"
+#include "app_events.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The publisher task owns all MQTT publishing of touch values and device statistics.
+It has its own priority, core affinity and input channel (see "menuconfig"),
+ so the app event loop is left for control events only.
+*/
+
+// Set up the publisher input channel, and resume the message sequence numbers.
+// Call after app_deep_sleep_init(), and before any touch values are posted.
+extern void app_publisher_init(void);
+
+// Create the publisher task and start publishing with 'client'.
+// Touch values posted before this wait in the channel (up to CONFIG_APP_PUBLISHER_QUEUE_SIZE).
+// Returns ESP_ERR_NO_MEM if the task or its copy of 'device_id' could not be allocated.
+extern esp_err_t app_publisher_start(esp_mqtt_client_handle_t client, const char *device_id);
+
+// Called by the sampler, the value is written straight into a channel slot. Never blocks.
+// 'sample_period_sec' is the current sampling period, it is published with the value.
+// Returns ESP_ERR_TIMEOUT if all of the channel slots are in use.
+extern esp_err_t app_publisher_post_touch_value(time_t utc_timestamp, int64_t sample_time_us, uint8_t touch_pad_num,
+                                                uint32_t touch_value, uint32_t sample_period_sec);
+
+// Have the publisher task publish the device and latency stats now, as well as every
+//  CONFIG_APP_STATS_PUBLISH_INTERVAL_SEC (e.g. before going to deep sleep, a wake-up is much shorter).
+// Never blocks: the stats are skipped if all of the channel slots are in use. Callable from any task.
+extern void app_publisher_publish_stats(void);
+
+// True once every touch value posted so far has been sent, i.e. the publisher has started and its
+//  channel, its pending values and the MQTT outbox are all empty (e.g. before going to deep sleep).
+// With CONFIG_APP_DEEP_SLEEP the touch values are published with QoS 1, so they are also acknowledged.
+// Callable from any task.
+extern bool app_publisher_is_idle(void);
+
+// Disconnect from the MQTT broker and stop the MQTT client, e.g. before going to deep sleep.
+// Not from the MQTT task (i.e. an MQTT event handler).
+extern void app_publisher_disconnect(void);
+
+// Called on the MQTT task (MQTT_EVENT_CONNECTED, MQTT_EVENT_PUBLISHED).
+// app_publisher_notify_connected() also notifies the outbox ready.
+extern void app_publisher_notify_connected(void);
+extern void app_publisher_notify_outbox_ready(void);
+extern void app_publisher_record_published(int msg_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_PUBLISHER_H_
@@ -0,0 +1,148 @@
+/*
+app_scheduler.cpp
+*/
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_APP_AUTO_LIGHT_SLEEP
+#include "esp_pm.h"
+#endif
+
+#include "app_metrics.h"
+#include "app_scheduler.h"
+#include "deadline_scheduler.hpp"
+
+
+static const char *LOG_TAG = "app_scheduler";
+
+using AppScheduler_t = DeadlineScheduler<APP_SCHEDULER_MAX_JOBS>;
+
+// 'scheduler_lock' protects everything below.
+// A mutex, not a spinlock, because the esp_timer is (re)armed while it is held.
+static SemaphoreHandle_t scheduler_lock = NULL;
+static AppScheduler_t scheduler;
+static esp_timer_handle_t wake_timer = NULL;
+static AppScheduler_t::TimeType armed_wake_time = AppScheduler_t::NEVER;
+static uint32_t reported_skipped_count = 0;
+// Only accessed by the callbacks, i.e. on the esp_timer task.
+static AppScheduler_t::TimeType running_due_time = 0;
+
+
+
+// Arm 'wake_timer' for the next deadline. Must hold 'scheduler_lock'.
+static void arm_wake_timer()
+{
+    const AppScheduler_t::TimeType wake_time = scheduler.get_wake_time();
+    if (wake_time == armed_wake_time) {
+        return;
+    }
+
+    esp_timer_stop(wake_timer);
+    armed_wake_time = wake_time;
+    if (wake_time != AppScheduler_t::NEVER) {
+        const int64_t delay = wake_time - esp_timer_get_time();
+        ESP_ERROR_CHECK(esp_timer_start_once(wake_timer, delay > 0 ? delay : 0));
+    }
+}
+
+
+static void wake_timer_callback(void *arg)
+{
+    int due_jobs[APP_SCHEDULER_MAX_JOBS];
+    AppScheduler_t::TimeType due_times[APP_SCHEDULER_MAX_JOBS];
+
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    armed_wake_time = AppScheduler_t::NEVER;
+    const size_t count = scheduler.collect_due(esp_timer_get_time(), due_jobs, APP_SCHEDULER_MAX_JOBS, due_times);
+    const uint32_t skipped_count = scheduler.get_skipped_count();
+    xSemaphoreGive(scheduler_lock);
+
+    app_metrics_increment(APP_METRIC_SCHEDULER_WAKES);
+    if (skipped_count != reported_skipped_count) {
+        app_metrics_add(APP_METRIC_SCHEDULER_SKIPPED, skipped_count - reported_skipped_count);
+        reported_skipped_count = skipped_count;
+    }
+
+    // The callbacks may start or stop jobs, so they are called without the lock.
+    for (size_t index = 0; index < count; ++index) {
+        running_due_time = due_times[index];
+        scheduler.invoke(due_jobs[index]);
+    }
+
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    arm_wake_timer();
+    xSemaphoreGive(scheduler_lock);
+}
+
+
+
+void app_scheduler_init()
+{
+    scheduler_lock = xSemaphoreCreateMutex();
+    assert(scheduler_lock);
+
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &wake_timer_callback;
+    timer_args.name = "app_scheduler";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &wake_timer));
+
+#if CONFIG_APP_AUTO_LIGHT_SLEEP
+    // Sleep whenever all tasks are idle. The esp_timer wakes the chip for the next deadline,
+    //  and Wi-Fi (in modem sleep) for the DTIM beacons.
+    esp_pm_config_t pm_config = {};
+    pm_config.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    pm_config.min_freq_mhz = CONFIG_XTAL_FREQ;
+    pm_config.light_sleep_enable = true;
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+    ESP_LOGI(LOG_TAG, "Automatic light sleep enabled.");
+#endif
+}
+
+
+int app_scheduler_add_job(app_scheduler_callback_t callback, void *arg, uint64_t period_us, uint64_t slack_us)
+{
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    const int job = scheduler.add_job(callback, arg, period_us, slack_us);
+    xSemaphoreGive(scheduler_lock);
+
+    if (job < 0) {
+        ESP_LOGE(LOG_TAG, "Too many jobs, increase APP_SCHEDULER_MAX_JOBS.");
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+    return job;
+}
+
+
+void app_scheduler_start_job(int job, uint64_t first_delay_us)
+{
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    scheduler.start(job, esp_timer_get_time() + first_delay_us);
+    arm_wake_timer();
+    xSemaphoreGive(scheduler_lock);
+}
+
+
+void app_scheduler_stop_job(int job)
+{
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    scheduler.stop(job);
+    arm_wake_timer();
+    xSemaphoreGive(scheduler_lock);
+}
+
+
+void app_scheduler_set_period(int job, uint64_t period_us)
+{
+    xSemaphoreTake(scheduler_lock, portMAX_DELAY);
+    scheduler.set_period(job, period_us);
+    xSemaphoreGive(scheduler_lock);
+}
+
+
+int64_t app_scheduler_get_due_time()
+{
+    return running_due_time;
+}
@@ -0,0 +1,56 @@
+/*
+app_scheduler.h
+*/
+
+#ifndef _APP_SCHEDULER_H_
+#define _APP_SCHEDULER_H_
+
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+All of the app's periodic work (the long and short touch sample periods)
+ is driven by one deadline scheduler (see deadline_scheduler.hpp) on one one-shot esp_timer,
+ which is always armed for the next deadline only.
+
+Each job has a 'slack': it may run up to that long after it is due, so that it can share
+ a wake-up with another job instead of waking the CPU on its own. With automatic light sleep
+ (CONFIG_APP_AUTO_LIGHT_SLEEP) the chip sleeps between the wake-ups.
+
+NOTE:
+ - The callbacks run on the esp_timer task, so they must be short (e.g. notify a task or post an event).
+ - The jobs are added during initialization. They can be started and stopped from any task, or from a callback.
+*/
+
+typedef void (*app_scheduler_callback_t)(void *arg);
+
+#define APP_SCHEDULER_MAX_JOBS 4
+
+// Call once, before any of the others.
+extern void app_scheduler_init(void);
+
+// Returns the job id. The job is not started.
+extern int app_scheduler_add_job(app_scheduler_callback_t callback, void *arg, uint64_t period_us, uint64_t slack_us);
+
+// Run 'job' in 'first_delay_us' and then every period. Restarts it if it is already running.
+extern void app_scheduler_start_job(int job, uint64_t first_delay_us);
+extern void app_scheduler_stop_job(int job);
+
+// Takes effect from the next run of 'job'.
+extern void app_scheduler_set_period(int job, uint64_t period_us);
+
+// The time (esp_timer_get_time()) the running callback was due at, e.g. to measure how late it ran.
+// Only valid within a callback.
+extern int64_t app_scheduler_get_due_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_SCHEDULER_H_
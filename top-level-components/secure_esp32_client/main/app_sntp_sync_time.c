@@ -20,6 +20,7 @@
 #include "lwip/ip_addr.h"
 #include "esp_sntp.h"
 
+#include "app_boot.h"
 #include "app_sntp_sync_time.h"
 
 
@@ -155,6 +156,8 @@ static void obtain_time(const char *sntp_server)
 
 void app_sntp_sync_time(const char *sntp_server)
 {
+    app_boot_stage_begin(APP_BOOT_STAGE_SNTP);
+
     time_t now;
     time(&now);
     struct tm timeinfo;
@@ -222,4 +225,8 @@ void app_sntp_sync_time(const char *sntp_server)
             vTaskDelay(2000 / portTICK_PERIOD_MS);
         }
     }
+
+    // Done, whether or not the time could be synchronized: the stages waiting for it
+    //  are better off with an unsynchronized clock than with no readings at all.
+    app_boot_stage_done(APP_BOOT_STAGE_SNTP);
 }
@@ -0,0 +1,47 @@
+/*
+app_tls_credentials.h
+*/
+
+#ifndef _APP_TLS_CREDENTIALS_H_
+#define _APP_TLS_CREDENTIALS_H_
+
+
+#include "esp_err.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The MQTT broker CA certificate, and the client certificate and key, parsed once at start-up
+ and kept (as mbedTLS contexts) for the lifetime of the app.
+
+Previously the three were kept as PEM text, and esp-tls base64 decoded and parsed them again on
+ every (re)connect. Now the NVS blobs ("mqtt" namespace: ca_cert, client_cert, client_key) are
+ read, parsed and freed right away, and every handshake uses the same parsed contexts.
+
+The blobs may be DER (see tools/create_client_certificates.sh and nonvolatile_storage.csv),
+ which is about 25% smaller in flash and skips the base64 decoding, or PEM as before.
+The load logs the blob sizes, the heap used by the parsed contexts and the parse time,
+ which used to be spent on every connect.
+
+NOTE:
+ - The contexts are given to esp-tls by app_tls_credentials_attach(), as the 'crt_bundle_attach'
+   callback of the TLS configuration (it is the one hook that gets the mbedtls_ssl_config).
+   So CONFIG_MBEDTLS_CERTIFICATE_BUNDLE must be enabled (it is by default), and the config must
+   NOT also have the certificate or key buffers set.
+*/
+
+// Call once, before the MQTT client is started. Returns ESP_FAIL if any of the three is missing or invalid.
+extern esp_err_t app_tls_credentials_load(void);
+
+// The 'crt_bundle_attach' callback, 'conf' is a mbedtls_ssl_config.
+extern esp_err_t app_tls_credentials_attach(void *conf);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_TLS_CREDENTIALS_H_
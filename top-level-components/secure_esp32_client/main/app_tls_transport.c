@@ -0,0 +1,237 @@
+/*
+app_tls_transport.c
+*/
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "esp_transport.h"
+#include "sdkconfig.h"
+
+#include "app_metrics.h"
+#include "app_tls_credentials.h"
+#include "app_tls_transport.h"
+
+
+// esp_tls_cfg_t::client_session and esp_tls_get_client_session() only exist with CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS,
+//  which CONFIG_APP_MQTT_TLS_SESSION_RESUMPTION depends on.
+#if CONFIG_APP_MQTT_TLS_SESSION_RESUMPTION
+
+static const char *LOG_TAG = "app_tls_transport";
+
+// Same values as the ERR_TCP_TRANSPORT_* of esp_transport_ssl, which the MQTT client expects.
+#define TRANSPORT_TIMEOUT            0
+#define TRANSPORT_CLOSED_BY_FIN     -1
+#define TRANSPORT_FAILED            -2
+
+
+typedef struct {
+    esp_tls_t *tls;
+    esp_tls_client_session_t *session;  // of the last successful handshake, NULL if none.
+} app_tls_transport_t;
+
+
+
+static int get_sockfd(const app_tls_transport_t *transport)
+{
+    int sockfd = -1;
+    if (transport->tls) {
+        esp_tls_get_conn_sockfd(transport->tls, &sockfd);
+    }
+    return sockfd;
+}
+
+
+// Returns 1 if the socket is ready, 0 on timeout, and -1 on an error.
+static int poll_socket(const app_tls_transport_t *transport, bool is_read, int timeout_ms)
+{
+    const int sockfd = get_sockfd(transport);
+    if (sockfd < 0) {
+        return -1;
+    }
+
+    fd_set ready_set;
+    fd_set error_set;
+    FD_ZERO(&ready_set);
+    FD_ZERO(&error_set);
+    FD_SET(sockfd, &ready_set);
+    FD_SET(sockfd, &error_set);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    const int ret = select(sockfd + 1, is_read ? &ready_set : NULL, is_read ? NULL : &ready_set, &error_set,
+                           timeout_ms < 0 ? NULL : &timeout);
+    if (ret > 0 && FD_ISSET(sockfd, &error_set)) {
+        return -1;
+    }
+    return ret;
+}
+
+
+static int handshake(app_tls_transport_t *transport, const char *host, int port, int timeout_ms,
+                     esp_tls_client_session_t *session)
+{
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = app_tls_credentials_attach,
+        .timeout_ms = timeout_ms,
+        .client_session = session,
+    };
+
+    transport->tls = esp_tls_init();
+    if (!transport->tls) {
+        return -1;
+    }
+
+    const int64_t start_time = esp_timer_get_time();
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &cfg, transport->tls) <= 0) {
+        esp_tls_conn_destroy(transport->tls);
+        transport->tls = NULL;
+        return -1;
+    }
+
+    // A broker that declines the ticket does a full handshake instead, so offering one doesn't mean it was resumed.
+    const uint32_t handshake_ms = (esp_timer_get_time() - start_time) / 1000;
+    app_metrics_record(APP_METRIC_HISTOGRAM_TLS_HANDSHAKE_MS, handshake_ms);
+    ESP_LOGI(LOG_TAG, "Handshake with %s (%s) took %" PRIu32 " ms.", host,
+             session ? "session ticket offered" : "full", handshake_ms);
+    return 0;
+}
+
+
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    app_tls_transport_t *transport = esp_transport_get_context_data(t);
+
+    app_metrics_increment(transport->session ? APP_METRIC_TLS_RESUME_ATTEMPTS : APP_METRIC_TLS_FULL_HANDSHAKES);
+    if (handshake(transport, host, port, timeout_ms, transport->session) != 0) {
+        ESP_LOGE(LOG_TAG, "Failed to connect to %s:%d", host, port);
+        if (transport->session) {
+            // A declined ticket does not fail the handshake, so this is the network or the broker.
+            // The ticket is dropped in case it is what the broker chokes on: the MQTT client's reconnect
+            //  then does a full handshake (rather than a second one right now, with another full timeout).
+            esp_tls_free_client_session(transport->session);
+            transport->session = NULL;
+        }
+        return -1;
+    }
+
+    // Keep the (possibly renewed) ticket of this session for the next connect.
+    esp_tls_client_session_t *session = esp_tls_get_client_session(transport->tls);
+    if (transport->session) {
+        esp_tls_free_client_session(transport->session);
+    }
+    transport->session = session;
+    if (!session) {
+        ESP_LOGW(LOG_TAG, "The broker did not issue a session ticket.");
+    }
+    return 0;
+}
+
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    app_tls_transport_t *transport = esp_transport_get_context_data(t);
+
+    if (esp_tls_get_bytes_avail(transport->tls) <= 0) {
+        const int poll = poll_socket(transport, true, timeout_ms);
+        if (poll <= 0) {
+            return poll == 0 ? TRANSPORT_TIMEOUT : TRANSPORT_FAILED;
+        }
+    }
+
+    const int ret = esp_tls_conn_read(transport->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_TIMEOUT) {
+        return TRANSPORT_TIMEOUT;
+    }
+    if (ret == 0) {
+        // The socket was readable, but there was nothing to read: the broker closed the connection.
+        return TRANSPORT_CLOSED_BY_FIN;
+    }
+    return ret < 0 ? TRANSPORT_FAILED : ret;
+}
+
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    app_tls_transport_t *transport = esp_transport_get_context_data(t);
+
+    const int poll = poll_socket(transport, false, timeout_ms);
+    if (poll <= 0) {
+        return poll == 0 ? TRANSPORT_TIMEOUT : TRANSPORT_FAILED;
+    }
+
+    const int ret = esp_tls_conn_write(transport->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_WRITE || ret == ESP_TLS_ERR_SSL_WANT_READ) {
+        return TRANSPORT_TIMEOUT;
+    }
+    return ret < 0 ? TRANSPORT_FAILED : ret;
+}
+
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    app_tls_transport_t *transport = esp_transport_get_context_data(t);
+    if (transport->tls && esp_tls_get_bytes_avail(transport->tls) > 0) {
+        return 1;
+    }
+    return poll_socket(transport, true, timeout_ms);
+}
+
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return poll_socket(esp_transport_get_context_data(t), false, timeout_ms);
+}
+
+
+static int tls_close(esp_transport_handle_t t)
+{
+    app_tls_transport_t *transport = esp_transport_get_context_data(t);
+    int ret = 0;
+    if (transport->tls) {
+        ret = esp_tls_conn_destroy(transport->tls);
+        transport->tls = NULL;
+    }
+    return ret;
+}
+
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    app_tls_transport_t *transport = esp_transport_get_context_data(t);
+    tls_close(t);
+    if (transport->session) {
+        esp_tls_free_client_session(transport->session);
+    }
+    free(transport);
+    return 0;
+}
+
+
+
+esp_transport_handle_t app_tls_transport_init()
+{
+    app_tls_transport_t *transport = calloc(1, sizeof(app_tls_transport_t));
+    esp_transport_handle_t t = esp_transport_init();
+    if (!transport || !t) {
+        ESP_LOGE(LOG_TAG, "app_tls_transport_init(): out of memory.");
+        free(transport);
+        if (t) {
+            esp_transport_destroy(t);
+        }
+        return NULL;
+    }
+
+    esp_transport_set_context_data(t, transport);
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close, tls_poll_read, tls_poll_write, tls_destroy);
+    esp_transport_set_default_port(t, 8883);
+    return t;
+}
+
+#endif // CONFIG_APP_MQTT_TLS_SESSION_RESUMPTION
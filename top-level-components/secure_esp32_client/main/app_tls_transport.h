@@ -0,0 +1,46 @@
+/*
+app_tls_transport.h
+*/
+
+#ifndef _APP_TLS_TRANSPORT_H_
+#define _APP_TLS_TRANSPORT_H_
+
+
+#include "esp_transport.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+A mutual TLS esp_transport for the MQTT client (see 'network.transport' in esp_mqtt_client_config_t)
+ that resumes the TLS session on reconnects.
+
+The esp_transport_ssl that the MQTT client creates on its own does a full handshake on every
+ (re)connect: the certificate chains are exchanged and verified, and the key exchange is done
+ with the client key. This one keeps the session ticket of the last successful handshake
+ (CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) and offers it on the next connect, which skips all of that.
+If the broker declines the ticket (e.g. it was restarted or the ticket expired) the same handshake
+ goes on as a full one, which issues a new ticket.
+If the connect fails with a ticket offered, the ticket is dropped and the MQTT client's next reconnect
+ does a full handshake.
+
+The handshake times (resumed or not) are recorded in the "tls_ms" histogram of the device stats,
+ the handshakes offering a ticket in the "tls_resume_try" counter and the others in "tls_full".
+
+NOTE:
+ - The certificates and key are the ones parsed by app_tls_credentials_load().
+ - Only built with CONFIG_APP_MQTT_TLS_SESSION_RESUMPTION.
+ - The port defaults to 8883 (MQTT over TLS) if the broker URL has none.
+ - The session ticket is kept in RAM only, so it doesn't survive deep sleep: esp-tls does not
+   expose a way to serialize it (see esp_tls_get_client_session()).
+*/
+extern esp_transport_handle_t app_tls_transport_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // _APP_TLS_TRANSPORT_H_
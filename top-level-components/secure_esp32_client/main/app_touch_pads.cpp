@@ -2,15 +2,30 @@
 app_touch_pads.cpp
 */
 
+#include <atomic>
+
 #include "freertos/FreeRTOS.h"
 #include "driver/touch_pad.h"
 #include "soc/clk_tree_defs.h"
+#include "esp_attr.h"
 #include "esp_timer.h"
 #include "esp_log.h"
 
-#include "app_timer.h"
+#include "adaptive_period.hpp"
+#include "app_boot.h"
+#include "app_config.hpp"
+#include "app_deep_sleep.h"
+#include "app_event_loop.h"
+#include "app_metrics.h"
+#include "app_publisher.h"
+#include "app_scheduler.h"
 #include "app_touch_pads.h"
-#include "fast_array_average.hpp"
+#include "retained_object.hpp"
+#include "settle_detector.hpp"
+#include "tick_timing.hpp"
+#include "token_bucket.hpp"
+#include "touch_pad_config.hpp"
+#include "touch_pipeline.hpp"
 
 
 // Defined in CMakeLists.txt: APP_DEBUG, DEBUG_TOUCH_PAD_NUMBER
@@ -21,33 +36,56 @@ app_touch_pads.cpp
 
 
 //------------------------------------------------------------------------------
+// The chip family picks the pipeline (see touch_pipeline.hpp), and the driver calls below.
 #if CONFIG_IDF_TARGET_ESP32S2 || CONFIG_IDF_TARGET_ESP32S3
    // ESP32 S2 and S3 touch pads.
 #  define USE_TOUCH_TIMER_CALLBACK
-#  define TOUCH_VALUE_32_BIT
+   using TouchChipTraits = Esp32S2S3TouchTraits;
 
 #elif CONFIG_IDF_TARGET_ESP32
    // ESP32 touch pads.
 #  define USE_TOUCH_FILTER_CALLBACK
-#  define TOUCH_VALUE_16_BIT
+   using TouchChipTraits = Esp32TouchTraits;
 
 #else
 #  error The device you are targeting is currently unsupported.
 #endif
+
+static_assert(TouchChipTraits::pad_count == TOUCH_PAD_MAX, "TouchChipTraits does not match the chip.");
+#ifdef USE_TOUCH_TIMER_CALLBACK
+static_assert(TouchChipTraits::read_style == TouchReadStyle::TIMER_CALLBACK);
+#else
+static_assert(TouchChipTraits::read_style == TouchReadStyle::FILTER_CALLBACK);
+#endif
+
+#if CONFIG_APP_DEEP_SLEEP && !defined(USE_TOUCH_TIMER_CALLBACK)
+#  error CONFIG_APP_DEEP_SLEEP needs the touch pads to be sampled in windows (ESP32 S2 and S3).
+#endif
 //------------------------------------------------------------------------------
 
 
+#if CONFIG_IDF_TARGET_ESP32S2 || CONFIG_IDF_TARGET_ESP32S3
+   // For ESP32 S2 and S3, touch_pad_config() has only 1 argument.
+   // This macro allows us to ignore the second argument.
+#  define TOUCH_PAD_CONFIG(touch_num,threshold)  touch_pad_config(touch_num)
+   // Stop measuring a touch pad.
+#  define TOUCH_PAD_UNCONFIG(touch_num)  touch_pad_clear_channel_mask(BIT(touch_num))
+
+#elif CONFIG_IDF_TARGET_ESP32
+   // For other targets, touch_pad_config() has 2 arguments.
+#  define TOUCH_PAD_CONFIG(touch_num,threshold)  touch_pad_config(touch_num,threshold)
+   // Stop measuring a touch pad, i.e. undo the group masks set by touch_pad_config().
+#  define TOUCH_PAD_UNCONFIG(touch_num)  touch_pad_clear_group_mask(BIT(touch_num), BIT(touch_num), BIT(touch_num))
+
+#endif
+
+
 #define TOUCH_PAD_NO_CHANGE   (-1)
 #define TOUCH_THRESH_NO_USE   (0)
-#define MEASUREMENT_DURATION_MSEC  (4)
-#define MEASUREMENT_INTERVAL_MSEC  (100 - MEASUREMENT_DURATION_MSEC)
+// The measurement duration is the "meas_ms" touch pad config, within a 100 ms cycle.
+#define MEASUREMENT_CYCLE_MSEC     (100)
 #define FILTER_TOUCH_PERIOD_MSEC   (1000)
 
-//TODO: implement this in "menuconfig".
-// The difference between a prior value and a new value that triggers
-//  the new value to be posted a an event.
-#define UPDATE_THRESHOLD_VALUE 16
-
 static const UBaseType_t readTouchPadsTask_IndexToNotify = 1;
 
 ESP_EVENT_DEFINE_BASE(APP_TOUCH_EVENTS);
@@ -55,189 +93,588 @@ ESP_EVENT_DEFINE_BASE(APP_TOUCH_EVENTS);
 static const char* LOG_TAG = "app_touch_pads";
 
 
-/****
-TODO: document...
-
-TouchValue_t:
-
-TouchValuesAverage_t:
+/*
+The touch pads being sampled, bit n for touch pad n (see lane_mask.hpp), are either:
+ - CONFIG_APP_TOUCH_FIXED_PADS, fixed at build time, so the pipeline loops are unrolled to exactly those, or
+ - compiled from 'touch_config.active_pads' by apply_touch_config() (CONFIG_APP_TOUCH_FIXED_PADS = 0).
+Only these touch pads are configured, so the others take no measurement time.
+The averaging window is changed at runtime by the 'average_bits' touch pad config.
+Each sample goes through the CONFIG_APP_TOUCH_OUTLIER_* stage, if any, before it is averaged,
+ and the averages through the CONFIG_APP_TOUCH_FILTER_* filter, if any (see filter_pipeline.hpp).
+*/
+#if CONFIG_APP_TOUCH_OUTLIER_MEDIAN_3
+template<class Frame> using TouchOutlierStage = MedianStage<Frame, 3>;
+#elif CONFIG_APP_TOUCH_OUTLIER_MEDIAN_5
+template<class Frame> using TouchOutlierStage = MedianStage<Frame, 5>;
+#elif CONFIG_APP_TOUCH_OUTLIER_TRIMMED_MEAN_5
+template<class Frame> using TouchOutlierStage = TrimmedMeanStage<Frame, 5, 1>;
+#else
+template<class Frame> using TouchOutlierStage = PassStage<Frame>;
+#endif
 
-****/
-#if defined(TOUCH_VALUE_16_BIT)
-  using TouchValue_t = uint16_t;
-  using TouchValuesAverage_t = FastArrayAverage<TouchValue_t, uint32_t, TOUCH_PAD_MAX>;
-#elif defined(TOUCH_VALUE_32_BIT)
-  using TouchValue_t = uint32_t;
-  using TouchValuesAverage_t = FastArrayAverage<TouchValue_t, uint64_t, TOUCH_PAD_MAX>;
+#if CONFIG_APP_TOUCH_FILTER_EMA
+template<class Frame> using TouchFilter = EmaStage<Frame, 2>;
+using TouchPipeline_t = TouchPipeline<TouchChipTraits, CONFIG_APP_TOUCH_FIXED_PADS, TouchOutlierStage, TouchFilter>;
+#elif CONFIG_APP_TOUCH_FILTER_KALMAN
+template<class Frame> using TouchFilter = KalmanStage<Frame>;
+using TouchPipeline_t = TouchPipeline<TouchChipTraits, CONFIG_APP_TOUCH_FIXED_PADS, TouchOutlierStage, TouchFilter>;
+#else
+using TouchPipeline_t = TouchPipeline<TouchChipTraits, CONFIG_APP_TOUCH_FIXED_PADS, TouchOutlierStage>;
 #endif
+using TouchValue_t = TouchPipeline_t::ValueType;
 
+/*
+The sampler state that is kept across deep sleep (CONFIG_APP_DEEP_SLEEP) in RTC memory:
+ the pipeline with the last published values, the adaptive sample period, and the changes
+ that wait for a network wake-up. See resume_sampler_state() and sleep_until_next_window().
+Without deep sleep it is in normal RAM, and constructed anew at every boot.
+Only accessed by the sampler.
+*/
+struct TouchSamplerState {
+    explicit TouchSamplerState(const TouchPadConfig& config)
+        : pipeline(config.average_bits),
+          sample_period(config.long_sample_period_sec, config.max_long_sample_period_sec),
+          config(config)
+    { }
 
-static TouchValuesAverage_t touchValuesAverage(7); // 2^7 = 128 (average over 128 samples)
-static TouchValue_t prior_touch_value[TOUCH_PAD_MAX];
-static bool force_update = true;
+    TouchPipeline_t pipeline;
+    AdaptivePeriod sample_period;       // in seconds, see 'adaptive_sample_period'.
+    TouchPadConfig config;              // the config in effect when going to sleep.
+    uint32_t deferred_windows = 0;      // the windows since the first change that is not published yet (coalesced).
+    bool force_update = true;           // 'force_update' when going to sleep.
+    bool is_publish_pending = false;    // the last network wake-up ran out of time before its values were acknowledged.
+};
+#if CONFIG_APP_DEEP_SLEEP
+RTC_DATA_ATTR static RetainedObject<TouchSamplerState> sampler_state;
+#else
+static RetainedObject<TouchSamplerState> sampler_state;
+#endif
+static TouchPipeline_t& touch_pipeline = sampler_state.get().pipeline;
 
-static esp_event_loop_handle_t event_loop_handle = NULL;
+// Set by the sampler, a config change, or an APP_TOUCH_FORCE_UPDATE event (on the app event loop task).
+static std::atomic<bool> force_update(true);
 
+// Both sample periods are app scheduler jobs (see app_scheduler.h).
 #ifdef USE_TOUCH_TIMER_CALLBACK
-// - 'short_sample_timer' is the short period timer used to take many samples which are then averaged.
-// - this timer is stopped each time enough samples have been taken to get a good average.
-static esp_timer_handle_t short_sample_timer;
+// - 'short_sample_job' is the short period job used to take many samples which are then averaged.
+// - this job is stopped each time enough samples have been taken to get a good average.
+// - it has no slack, the samples are taken on time.
+static int short_sample_job = -1;
 static uint64_t short_sample_period; //(in microseconds) this must be based on the capacitive touch sensor parameters.
 #endif
 
 
-// - 'long_sample_timer' is the long period timer whose sole purpose is to restart the 'short_sample_timer'
+// - 'long_sample_job' is the long period job whose sole purpose is to restart the 'short_sample_job'
 //    when the next batch of samples are to be started and averaged.
-static esp_timer_handle_t long_sample_timer;
-static uint64_t long_sample_period
-#ifdef APP_DEBUG
-    = 5 * 1000000; // every 5 seconds when debugging.
+// - 'long_sample_period' adapts to the touch values (see 'adaptive_sample_period').
+// - it may start a batch up to 'LONG_SAMPLE_SLACK' late, to share a wake-up with other periodic work.
+static int long_sample_job = -1;
+static uint64_t long_sample_period; //(in microseconds)
+static const uint64_t LONG_SAMPLE_SLACK = 1000000;
+
+
+/*
+The timing of the sample ticks as the sampler sees them (see tick_timing.hpp): how late it wakes,
+ how long it works, the ticks it never saw, and the time each averaging window covers.
+They are recorded in the APP_METRIC_HISTOGRAM_TOUCH_* histograms and APP_METRIC_TOUCH_SKIPPED_TICKS.
+Only accessed by the sampler.
+*/
+#ifdef USE_TOUCH_TIMER_CALLBACK
+static TickTiming sample_timing(1);  // the period follows 'short_sample_period'.
 #else
-    = 60 * 1000000; // every minute under normal use.
+// The touch filter callback has no due time, the intervals are measured against its period.
+static TickTiming sample_timing(FILTER_TOUCH_PERIOD_MSEC * 1000);
 #endif
+// Set when a sampling window is (re)started, which may be on another task.
+// The sampler then restarts the tick timing, and discards the samples of a window in progress.
+static std::atomic<bool> sampling_window_restarted(true);
+// The due time of a sample tick that has none.
+static const int64_t NO_DUE_TIME = -1;
+
+
+/*
+The long sample period (in seconds) between the 'long_sample_period' and 'max_long_sample_period'
+ touch pad configs (see adaptive_period.hpp): back to the shortest as soon as a window has a touch pad
+ that moved by more than the deadband, and doubled after each window without one.
+Only the timer callback (ESP32 S2 and S3) stops sampling between the batches, so only it adapts.
+Only accessed by the sampler.
+*/
+static AdaptivePeriod& adaptive_sample_period = sampler_state.get().sample_period;
+
 
 
-struct app_touch_pad_status {
-    app_touch_pad_status(touch_pad_t touch_pad_num, bool is_activated = true)
-        : touch_pad_num(touch_pad_num), is_activated(is_activated)
-    { }
 
-    // see: github/espressif/esp-idf/components/hal/include/hal/touch_sensor_types.h
-    touch_pad_t touch_pad_num;
-    bool is_activated;
-};
 
-static app_touch_pad_status TOUCH_PAD[ TOUCH_PAD_MAX ] {
-    app_touch_pad_status(TOUCH_PAD_NUM0, false),
-    app_touch_pad_status(TOUCH_PAD_NUM1),
-    app_touch_pad_status(TOUCH_PAD_NUM2),
-    app_touch_pad_status(TOUCH_PAD_NUM3),
-    app_touch_pad_status(TOUCH_PAD_NUM4),
-    app_touch_pad_status(TOUCH_PAD_NUM5),
-    app_touch_pad_status(TOUCH_PAD_NUM6),
-    app_touch_pad_status(TOUCH_PAD_NUM7),
-    app_touch_pad_status(TOUCH_PAD_NUM8),
-    app_touch_pad_status(TOUCH_PAD_NUM9),
-#if SOC_TOUCH_SENSOR_NUM > 10
-    app_touch_pad_status(TOUCH_PAD_NUM10),
-    app_touch_pad_status(TOUCH_PAD_NUM11),
-    app_touch_pad_status(TOUCH_PAD_NUM12),
-    app_touch_pad_status(TOUCH_PAD_NUM13),
-    app_touch_pad_status(TOUCH_PAD_NUM14),
+//------------------------------------------------------------------------------
+// Runtime touch pad configuration.
+//------------------------------------------------------------------------------
+// 'touch_config' is the configuration in effect. It is only accessed by the sampler
+//  (i.e. the 'app_read_touch_pads' task, or the touch filter callback on the ESP32).
+// Updates arrive on other tasks (see app_touch_pads_set_config()) and wait in 'pending_touch_config'
+//  until the sampler swaps them in at the next averaging window boundary.
+static TouchPadConfig default_touch_config();
+static TouchPadConfig touch_config = default_touch_config();
+static TouchPadConfig pending_touch_config;
+static bool pending_touch_config_ready = false;
+static portMUX_TYPE touch_config_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// The measurement time of each touch pad (ESP32 only), see read_touch_pads_init_device().
+// From the "meas_ms" key, it is only read at start-up.
+static uint8_t measurement_duration_msec;
+
+
+#ifdef APP_DEBUG
+// Only touch pads 1 to 4 when debugging.
+static constexpr uint16_t DEFAULT_ACTIVE_PADS = 0x001e;
+static constexpr uint32_t DEFAULT_LONG_SAMPLE_PERIOD_SEC = 5; // every 5 seconds when debugging.
+static constexpr uint32_t DEFAULT_MAX_LONG_SAMPLE_PERIOD_SEC = 40; // backs off to 40 seconds.
+#else
+// All touch pads, except touch pad 0 (see FIRST_TOUCH_PAD_INDEX).
+static constexpr uint16_t DEFAULT_ACTIVE_PADS = ((1u << TOUCH_PAD_MAX) - 1) & ~((1u << FIRST_TOUCH_PAD_INDEX) - 1);
+static constexpr uint32_t DEFAULT_LONG_SAMPLE_PERIOD_SEC = 60; // every minute under normal use.
+static constexpr uint32_t DEFAULT_MAX_LONG_SAMPLE_PERIOD_SEC = 900; // backs off to 15 minutes.
 #endif
+
+/*
+The touch pad settings stored in NVS, with their defaults and ranges.
+All but "meas_ms" are also received over MQTT (see touch_pad_config.hpp), which saves them here.
+*/
+struct TouchPadSchema {
+    static constexpr const char *nvs_namespace = "touchpad";
+    static constexpr ConfigKey<uint16_t> active_pads{"active_pads", DEFAULT_ACTIVE_PADS, 0, 0xffff};
+    static constexpr ConfigKey<uint8_t> average_bits{"average_bits", 7, 0, TouchPadConfig::MAX_AVERAGE_BITS};
+    static constexpr ConfigKey<uint32_t> long_period_sec{"long_period_sec", DEFAULT_LONG_SAMPLE_PERIOD_SEC,
+            TouchPadConfig::MIN_LONG_SAMPLE_PERIOD_SEC, TouchPadConfig::MAX_LONG_SAMPLE_PERIOD_SEC};
+    static constexpr ConfigKey<uint32_t> max_period_sec{"max_period_sec", DEFAULT_MAX_LONG_SAMPLE_PERIOD_SEC,
+            TouchPadConfig::MIN_LONG_SAMPLE_PERIOD_SEC, TouchPadConfig::MAX_LONG_SAMPLE_PERIOD_SEC};
+    static constexpr ConfigKey<uint32_t> deadband{"deadband", 16, 0, TouchPadConfig::MAX_DEADBAND};
+    static constexpr ConfigKey<uint8_t> publish_mode{"publish_mode",
+            static_cast<uint8_t>(TouchPublishMode::changed), 0, static_cast<uint8_t>(TouchPublishMode::always)};
+    // The measurement_clock_cycles are 16 bits, so at most 65535 / 8.5 MHz = 7 ms.
+    static constexpr ConfigKey<uint8_t> meas_ms{"meas_ms", 4, 1, 7};
+};
+static_assert(config_schema_is_valid(TouchPadSchema::active_pads, TouchPadSchema::average_bits,
+                                     TouchPadSchema::long_period_sec, TouchPadSchema::max_period_sec,
+                                     TouchPadSchema::deadband,
+                                     TouchPadSchema::publish_mode, TouchPadSchema::meas_ms));
+
+class TouchPadNvsConfig: public AppConfig {
+public:
+    TouchPadNvsConfig(LoadMode load_mode = LoadMode::BULK) : AppConfig(TouchPadSchema::nvs_namespace, load_mode) { }
+    CONFIG_VALUE(TouchPadSchema, active_pads)
+    CONFIG_VALUE(TouchPadSchema, average_bits)
+    CONFIG_VALUE(TouchPadSchema, long_period_sec)
+    CONFIG_VALUE(TouchPadSchema, max_period_sec)
+    CONFIG_VALUE(TouchPadSchema, deadband)
+    CONFIG_VALUE(TouchPadSchema, publish_mode)
+    CONFIG_VALUE(TouchPadSchema, meas_ms)
 };
 
 
+static TouchPadConfig default_touch_config()
+{
+    TouchPadConfig config;
+    config.active_pads = TouchPadSchema::active_pads.default_value;
+    config.average_bits = TouchPadSchema::average_bits.default_value;
+    config.long_sample_period_sec = TouchPadSchema::long_period_sec.default_value;
+    config.max_long_sample_period_sec = TouchPadSchema::max_period_sec.default_value;
+    config.deadband = TouchPadSchema::deadband.default_value;
+    config.publish_mode = static_cast<TouchPublishMode>(TouchPadSchema::publish_mode.default_value);
+    return config;
+}
+
 
-static void post_touch_values(TouchValuesAverage_t::ValueArrayType& touch_values)
+// Keys that are missing or out of range take their default (see config_schema.hpp).
+static TouchPadConfig load_touch_config()
 {
-    // It's important to grab the current time at the top of this function.
-    time_t now = 0;
-    time(&now);
+    TouchPadNvsConfig nvs_config;
+    measurement_duration_msec = nvs_config.get_meas_ms();
+
+    TouchPadConfig stored;
+    stored.active_pads = nvs_config.get_active_pads();
+    stored.average_bits = nvs_config.get_average_bits();
+    stored.long_sample_period_sec = nvs_config.get_long_period_sec();
+    stored.max_long_sample_period_sec = nvs_config.get_max_period_sec();
+    if (stored.max_long_sample_period_sec < stored.long_sample_period_sec) {
+        // e.g. stored before there was a maximum, the period is then fixed.
+        stored.max_long_sample_period_sec = stored.long_sample_period_sec;
+    }
+    stored.deadband = nvs_config.get_deadband();
+    stored.publish_mode = static_cast<TouchPublishMode>(nvs_config.get_publish_mode());
+
+    // e.g. touch pads that this chip does not have.
+    const char *error = stored.validate(TOUCH_PAD_MAX);
+    if (error) {
+        ESP_LOGW(LOG_TAG, "Ignoring the stored touch pad config: %s!", error);
+        return default_touch_config();
+    }
+    return stored;
+}
 
-    ESP_LOGV(LOG_TAG, "post_touch_values");
 
-    // Just incase force_update is changed while we are processing below.
-    const bool local_force_update = force_update;
-    force_update = false;
+static esp_err_t save_touch_config(const TouchPadConfig& config)
+{
+    // Nothing is read, so don't load the namespace.
+    TouchPadNvsConfig nvs_config(AppConfig::LoadMode::ON_DEMAND);
+    esp_err_t err = nvs_config.set_active_pads(config.active_pads);
+    if (err == ESP_OK) {
+        err = nvs_config.set_average_bits(config.average_bits);
+    }
+    if (err == ESP_OK) {
+        err = nvs_config.set_long_period_sec(config.long_sample_period_sec);
+    }
+    if (err == ESP_OK) {
+        err = nvs_config.set_max_period_sec(config.max_long_sample_period_sec);
+    }
+    if (err == ESP_OK) {
+        err = nvs_config.set_deadband(config.deadband);
+    }
+    if (err == ESP_OK) {
+        err = nvs_config.set_publish_mode(static_cast<uint8_t>(config.publish_mode));
+    }
+    if (err == ESP_OK) {
+        err = nvs_config.commit();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(LOG_TAG, "Error (%s) saving the touch pad config!", esp_err_to_name(err));
+    }
+    return err;
+}
 
-    TouchValue_t prior_value, new_value, diff;
 
-    for (uint8_t ndx = FIRST_TOUCH_PAD_INDEX; ndx < TOUCH_PAD_MAX; ++ndx) {
-        if (!TOUCH_PAD[ndx].is_activated) {
-            // Ignore touch pads that are not currently activated.
-            continue;
+TouchPadConfig app_touch_pads_get_config()
+{
+    TouchPadConfig config;
+    taskENTER_CRITICAL(&touch_config_lock);
+    config = pending_touch_config_ready ? pending_touch_config : touch_config;
+    taskEXIT_CRITICAL(&touch_config_lock);
+    return config;
+}
+
+
+esp_err_t app_touch_pads_set_config(const TouchPadConfig& config)
+{
+    const char *error = config.validate(TOUCH_PAD_MAX);
+    if (error) {
+        ESP_LOGW(LOG_TAG, "Invalid touch pad config: %s!", error);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&touch_config_lock);
+    pending_touch_config = config;
+    pending_touch_config_ready = true;
+    taskEXIT_CRITICAL(&touch_config_lock);
+
+    ESP_LOGI(LOG_TAG, "Touch pad config received: active_pads=0x%04x, average_bits=%u, long_sample_period=%" PRIu32
+             ", max_long_sample_period=%" PRIu32 ", deadband=%" PRIu32 ", publish_mode=%u",
+             config.active_pads, config.average_bits, config.long_sample_period_sec,
+             config.max_long_sample_period_sec, config.deadband, static_cast<unsigned>(config.publish_mode));
+
+    return save_touch_config(config);
+}
+
+
+// Make the hardware and timers match 'touch_config'.
+// 'previous' is the configuration that was in effect, or nullptr during initialization.
+static void apply_touch_config(const TouchPadConfig *previous)
+{
+    const LaneMask previous_pads = touch_pipeline.get_pads();
+    const LaneMask requested_pads = touch_config.active_pads & ~all_lanes(FIRST_TOUCH_PAD_INDEX);
+    const LaneMask pads = touch_pipeline.set_pads(requested_pads);
+    if (TouchPipeline_t::has_fixed_pads && pads != requested_pads) {
+        ESP_LOGW(LOG_TAG, "active_pads=0x%04x is ignored, the touch pads are fixed to 0x%04" PRIx32 " (CONFIG_APP_TOUCH_FIXED_PADS).",
+                 touch_config.active_pads, pads);
+    }
+    if (previous) {
+        // During initialization the touch pads are configured after touch_pad_init().
+        for_each_lane(pads & ~previous_pads, [](unsigned ndx) {
+            TOUCH_PAD_CONFIG(static_cast<touch_pad_t>(ndx), TOUCH_THRESH_NO_USE);
+        });
+        for_each_lane(previous_pads & ~pads, [](unsigned ndx) {
+            TOUCH_PAD_UNCONFIG(static_cast<touch_pad_t>(ndx));
+        });
+    }
+
+    if (!previous || previous->average_bits != touch_config.average_bits) {
+        touch_pipeline.set_average_bits(touch_config.average_bits);
+#ifdef USE_TOUCH_TIMER_CALLBACK
+        // Average the sample values over 1 second.
+        // 1000000 microseconds = 1 second
+        short_sample_period = 1000000 / touch_pipeline.get_sample_size();
+        sample_timing.set_period(short_sample_period);
+#endif
+    }
+
+    if (!previous || previous->long_sample_period_sec != touch_config.long_sample_period_sec
+        || previous->max_long_sample_period_sec != touch_config.max_long_sample_period_sec)
+    {
+        adaptive_sample_period.set_bounds(touch_config.long_sample_period_sec, touch_config.max_long_sample_period_sec);
+        if (previous) {
+            // Starts over at the shortest period.
+            adaptive_sample_period.reset();
         }
+        long_sample_period = adaptive_sample_period.get() * 1000000;
+        if (previous && long_sample_job >= 0) {
+            app_scheduler_set_period(long_sample_job, long_sample_period);
+            app_scheduler_start_job(long_sample_job, long_sample_period);
+        }
+    }
+}
 
-        prior_value = prior_touch_value[ndx];
-        new_value = touch_values[ndx];
-        diff = prior_value > new_value ? prior_value - new_value : new_value - prior_value;
 
-#ifdef DEBUG_TOUCH_PAD_NUMBER
-        if (ndx == DEBUG_TOUCH_PAD_NUMBER) {
-#if defined(TOUCH_VALUE_32_BIT)
-            ESP_LOGD(LOG_TAG, "touch - [%u] %lu (diff=%lu)", ndx, new_value, diff);
+// Called by the sampler at the end of each averaging window.
+static void apply_pending_touch_config()
+{
+    TouchPadConfig new_config;
+    bool is_ready;
+
+    taskENTER_CRITICAL(&touch_config_lock);
+    is_ready = pending_touch_config_ready;
+    if (is_ready) {
+        new_config = pending_touch_config;
+        pending_touch_config_ready = false;
+    }
+    taskEXIT_CRITICAL(&touch_config_lock);
+
+    if (!is_ready || new_config == touch_config) {
+        return;
+    }
+
+    const TouchPadConfig previous = touch_config;
+    touch_config = new_config;
+    apply_touch_config(&previous);
+
+    // Publish every active touch pad under the new config.
+    force_update = true;
+    ESP_LOGI(LOG_TAG, "Touch pad config applied.");
+}
+
+
+
+// The time between the starts of two averaging windows, in seconds. It is published with the values.
+static uint32_t get_sample_period_sec()
+{
+#ifdef USE_TOUCH_TIMER_CALLBACK
+    return static_cast<uint32_t>(long_sample_period / 1000000);
 #else
-            ESP_LOGD(LOG_TAG, "touch - [%u] %u (diff=%u)", ndx, new_value, diff);
+    // Sampling never stops, each window starts where the previous one ended.
+    return touch_pipeline.get_sample_size() * FILTER_TOUCH_PERIOD_MSEC / 1000;
+#endif
+}
+
+
+/*
+Adapt the long sample period to the window that just ended (see 'adaptive_sample_period').
+'changed' is whether it had a touch pad that moved by more than the deadband.
+'window_span' is the time (in microseconds) since the window started, so the next one starts
+ a whole new period after it.
+*/
+static void adapt_sample_period(bool changed, int64_t window_span)
+{
+#ifdef USE_TOUCH_TIMER_CALLBACK
+    if (!adaptive_sample_period.update(changed) || long_sample_job < 0) {
+        return;
+    }
+    long_sample_period = adaptive_sample_period.get() * 1000000;
+    const uint64_t span = window_span > 0 ? static_cast<uint64_t>(window_span) : 0;
+    app_scheduler_set_period(long_sample_job, long_sample_period);
+    app_scheduler_start_job(long_sample_job, long_sample_period > span ? long_sample_period - span : long_sample_period);
+    ESP_LOGD(LOG_TAG, "Long sample period %" PRIu32 " sec.", get_sample_period_sec());
 #endif
+}
+
+
+#if CONFIG_APP_DEEP_SLEEP
+/*
+After a deep sleep wake-up the network is only brought up to publish (see app_deep_sleep.h).
+The changes are coalesced: they wait for up to CONFIG_APP_DEEP_SLEEP_COALESCE_WINDOWS windows, counted
+ from the first one, and then only the latest value of each touch pad is published (publish_changed()).
+Every window is compared with the last published values, so a change that has reverted since
+ no longer waits, and doesn't bring up the network.
+Values that the last network wake-up could not get acknowledged (see sleep_until_next_window())
+ don't wait at all.
+Returns true if the values of this window are not published now, false if they are
+ (the network is then requested).
+'force' is whether every touch pad is to be published.
+*/
+static bool coalesce_touch_values(bool force, int64_t window_span)
+{
+    TouchSamplerState& state = sampler_state.get();
+    const unsigned changed = touch_pipeline.count_changed(touch_config.deadband);
+    if (!changed && !force) {
+        if (state.deferred_windows) {
+            ESP_LOGD(LOG_TAG, "Touch values back within the deadband after %" PRIu32 " windows.", state.deferred_windows);
+            state.deferred_windows = 0;
         }
-#endif // DEBUG_TOUCH_PAD_NUMBER
+    } else {
+        ++state.deferred_windows;
+    }
+
+    if (!app_deep_sleep_is_network_requested() && !state.is_publish_pending
+        && state.deferred_windows < CONFIG_APP_DEEP_SLEEP_COALESCE_WINDOWS)
+    {
+        if (force) {
+            // Kept for the network wake-up.
+            force_update = true;
+        }
+        adapt_sample_period(changed != 0, window_span);
+        ESP_LOGD(LOG_TAG, "Touch values coalesced, %u changed, %" PRIu32 " windows waiting.", changed, state.deferred_windows);
+        return true;
+    }
+    state.deferred_windows = 0;
+    app_deep_sleep_request_network();
+    return false;
+}
+#endif
 
-        if (local_force_update || diff > UPDATE_THRESHOLD_VALUE) {
-            prior_touch_value[ndx] = new_value;
 
-#if defined(TOUCH_VALUE_32_BIT)
-            ESP_LOGV(LOG_TAG, "touch - [%u] %lu (diff=%lu)", ndx, new_value, diff);
-#else
-            ESP_LOGV(LOG_TAG, "touch - [%u] %u (diff=%u)", ndx, new_value, diff);
+// 'window_span' is the time (in microseconds) the window that just ended covered.
+static void post_touch_values(int64_t window_span)
+{
+    // It's important to grab the current time at the top of this function.
+    time_t now = 0;
+    time(&now);
+    const int64_t sample_time_us = esp_timer_get_time();
+
+    ESP_LOGV(LOG_TAG, "post_touch_values");
+
+    // Just incase force_update is changed while we are processing below.
+    const bool local_force_update = force_update.exchange(false) || touch_config.publish_mode == TouchPublishMode::always;
+
+#if CONFIG_APP_DEEP_SLEEP
+    if (coalesce_touch_values(local_force_update, window_span)) {
+        return;
+    }
 #endif
 
-            app_touch_value_change_event_payload payload = {};
-            payload.utc_timestamp = now;
-            payload.touch_pad_num = ndx;
-            payload.touch_value = new_value;
-
-            esp_err_t err = esp_event_post_to(
-                    event_loop_handle,
-                    APP_TOUCH_EVENTS, APP_TOUCH_VALUE_CHANGE_EVENT,
-                    &payload, sizeof(payload),
-                    MEASUREMENT_DURATION_MSEC / portTICK_PERIOD_MS
-            );
-            switch(err) {
-            case ESP_OK:
-                // All is well
-                break;
-            case ESP_ERR_TIMEOUT:
-                // Ignore and try again next time.
-                ESP_LOGD(LOG_TAG, "APP_TOUCH_VALUE_CHANGE_EVENT timed-out! Ignoring and trying again.");
-                prior_touch_value[ndx] = 0;
-                // ?? force_update = true; ??
-                break;
-            default:
-                ESP_ERROR_CHECK(err);
-                break;
-            }
+    // The period these values were sampled under.
+    const uint32_t sample_period_sec = get_sample_period_sec();
+
+    const auto counts = touch_pipeline.publish_changed(touch_config.deadband, local_force_update,
+            [&](unsigned ndx, TouchValue_t new_value, TouchValue_t diff) {
+        ESP_LOGV(LOG_TAG, "touch - [%u] %lu (diff=%lu)", ndx, (unsigned long)new_value, (unsigned long)diff);
+
+        esp_err_t err = app_publisher_post_touch_value(now, sample_time_us, ndx, new_value, sample_period_sec);
+        switch(err) {
+        case ESP_OK:
+            // All is well
+            return true;
+        case ESP_ERR_TIMEOUT:
+            // Ignore and try again next time.
+            ESP_LOGD(LOG_TAG, "Publisher channel full! Ignoring and trying again.");
+            app_metrics_increment(APP_METRIC_TOUCH_POST_TIMEOUT);
+            // ?? force_update = true; ??
+            return false;
+        default:
+            ESP_ERROR_CHECK(err);
+            return false;
         }
+    });
+    if (counts.suppressed) {
+        app_metrics_add(APP_METRIC_TOUCH_SUPPRESSED, counts.suppressed);
     }
+    adapt_sample_period(counts.changed != 0, window_span);
+
+#ifdef DEBUG_TOUCH_PAD_NUMBER
+    ESP_LOGD(LOG_TAG, "touch - [%u] %lu", DEBUG_TOUCH_PAD_NUMBER,
+             (unsigned long)touch_pipeline.get_averages()[DEBUG_TOUCH_PAD_NUMBER]);
+#endif // DEBUG_TOUCH_PAD_NUMBER
 }
 
 
 
 enum class handle_touch_result { average_not_ready, average_ready };
 
-static handle_touch_result handle_touch_values(TouchValuesAverage_t::ValueArrayType& touch_values)
+// 'due_time' is when the sample tick was due (esp_timer_get_time()), or NO_DUE_TIME.
+// 'read(ndx)' returns the value of touch pad 'ndx', it is only called for the active touch pads.
+template<class Read>
+static handle_touch_result handle_touch_sample(int64_t due_time, Read&& read)
 {
-    handle_touch_result result = handle_touch_result::average_not_ready;
+    const int64_t wake_time = esp_timer_get_time();
+    if (sampling_window_restarted.exchange(false)) {
+        sample_timing.restart();
+        touch_pipeline.restart_window();
+    }
+    const TickTiming::Tick tick = (due_time == NO_DUE_TIME) ? sample_timing.tick(wake_time)
+                                                            : sample_timing.tick(due_time, wake_time);
+    app_metrics_record(APP_METRIC_HISTOGRAM_TOUCH_WAKE_US, tick.wake_latency);
+    if (tick.skipped) {
+        app_metrics_add(APP_METRIC_TOUCH_SKIPPED_TICKS, tick.skipped);
+    }
+
+    if (!touch_pipeline.add_sample(read)) {
+        app_metrics_record(APP_METRIC_HISTOGRAM_TOUCH_HANDLER_US, static_cast<uint32_t>(esp_timer_get_time() - wake_time));
+        return handle_touch_result::average_not_ready;
+    }
+    const int64_t window_span = sample_timing.get_span();
+    app_metrics_record(APP_METRIC_HISTOGRAM_TOUCH_WINDOW_MS, static_cast<uint32_t>(window_span / 1000));
+    sample_timing.start_window();
 
 #ifdef DEBUG_TOUCH_PAD_NUMBER
-    ESP_LOGV(LOG_TAG, "handle_touch_values");
-# if defined(TOUCH_VALUE_32_BIT)
-    ESP_LOGV(LOG_TAG, "raw touch - [%u] %lu", DEBUG_TOUCH_PAD_NUMBER, touch_values[DEBUG_TOUCH_PAD_NUMBER]);
-# else
-    ESP_LOGV(LOG_TAG, "raw touch - [%u] %u", DEBUG_TOUCH_PAD_NUMBER, touch_values[DEBUG_TOUCH_PAD_NUMBER]);
-# endif
+    ESP_LOGV(LOG_TAG, "avg touch - [%u] %lu", DEBUG_TOUCH_PAD_NUMBER,
+             (unsigned long)touch_pipeline.get_averages()[DEBUG_TOUCH_PAD_NUMBER]);
 #endif // DEBUG_TOUCH_PAD_NUMBER
 
-    touchValuesAverage.add_values(touch_values);
+    post_touch_values(window_span);
 
-    if (touchValuesAverage.is_average_ready()) {
-        result = handle_touch_result::average_ready;
-        TouchValuesAverage_t::ValueArrayType average_values;
-        touchValuesAverage.get_average_values(average_values);
+    // This is the averaging window boundary, where a new config can take effect.
+    apply_pending_touch_config();
+    app_metrics_record(APP_METRIC_HISTOGRAM_TOUCH_HANDLER_US, static_cast<uint32_t>(esp_timer_get_time() - wake_time));
+    return handle_touch_result::average_ready;
+}
 
-#ifdef DEBUG_TOUCH_PAD_NUMBER
-# if defined(TOUCH_VALUE_32_BIT)
-        ESP_LOGV(LOG_TAG, "avg touch - [%u] %lu", DEBUG_TOUCH_PAD_NUMBER, average_values[DEBUG_TOUCH_PAD_NUMBER]);
-# else
-        ESP_LOGV(LOG_TAG, "avg touch - [%u] %u", DEBUG_TOUCH_PAD_NUMBER, average_values[DEBUG_TOUCH_PAD_NUMBER]);
-# endif
-#endif // DEBUG_TOUCH_PAD_NUMBER
 
-        post_touch_values(average_values);
+
+#if CONFIG_APP_DEEP_SLEEP
+static const TickType_t PUBLISH_POLL_TICKS = pdMS_TO_TICKS(100);
+static const uint64_t MIN_SLEEP_US = 100000;
+
+
+// Returns true if the publisher is idle (see app_publisher_is_idle()) before 'awake_limit_us' after boot.
+static bool wait_for_publisher_idle(int64_t awake_limit_us)
+{
+    while (!app_publisher_is_idle() && esp_timer_get_time() < awake_limit_us) {
+        vTaskDelay(PUBLISH_POLL_TICKS);
+    }
+    return app_publisher_is_idle();
+}
+
+
+/*
+Called at the end of each window: once its values are published and acknowledged by the broker
+ (if any, see coalesce_touch_values()), or CONFIG_APP_DEEP_SLEEP_MAX_AWAKE_SEC after boot, disconnect
+ from the broker and go to deep sleep until the next window is due.
+A network wake-up is far shorter than CONFIG_APP_STATS_PUBLISH_INTERVAL_SEC, so it publishes the stats
+ of its own boot just before it disconnects.
+Values that are not acknowledged in time stay pending: every touch pad is published at the next wake-up.
+'sampler_state' carries on from there at the wake-up. Does not return.
+*/
+static void sleep_until_next_window()
+{
+    TouchSamplerState& state = sampler_state.get();
+    if (app_deep_sleep_is_network_requested()) {
+        const int64_t awake_limit_us = static_cast<int64_t>(CONFIG_APP_DEEP_SLEEP_MAX_AWAKE_SEC) * 1000000;
+        state.is_publish_pending = !wait_for_publisher_idle(awake_limit_us);
+        if (!state.is_publish_pending) {
+            // After the touch values, so the latencies include their acknowledgements.
+            app_publisher_publish_stats();
+            wait_for_publisher_idle(awake_limit_us);
+        } else {
+            ESP_LOGW(LOG_TAG, "The touch values were not acknowledged in time, they all are at the next wake-up.");
+            force_update = true;
+        }
+        app_publisher_disconnect();
     }
 
-    return result;
+    state.config = touch_config;
+    state.force_update = force_update;
+
+    // The next wake-up gets to its window in about the time this one did, so the window starts
+    //  a whole period after this one if the time awake so far is taken off (esp_timer starts at boot).
+    const uint64_t awake_us = static_cast<uint64_t>(esp_timer_get_time());
+    app_deep_sleep_start(long_sample_period > awake_us + MIN_SLEEP_US ? long_sample_period - awake_us : MIN_SLEEP_US);
 }
+#endif
 
 
 
@@ -249,39 +686,36 @@ static void off_timer_task_handler()
         // Wait for the short timer and do the following processing on this Task
         // rather than on the Timer Task which really does NOT want to get bogged down.
         //ulTaskNotifyTakeIndexed(readTouchPadsTask_IndexToNotify, pdTRUE, portMAX_DELAY);
-        BaseType_t wait_result = xTaskNotifyWaitIndexed(readTouchPadsTask_IndexToNotify, 0, ULONG_MAX, NULL, portMAX_DELAY);
+        // The notification value is the low 32 bits of the time the tick was due.
+        uint32_t due_time_low = 0;
+        BaseType_t wait_result = xTaskNotifyWaitIndexed(readTouchPadsTask_IndexToNotify, 0, ULONG_MAX, &due_time_low, portMAX_DELAY);
         if (!wait_result) {
             // The notification timed-out. Ingore and wait again.
             continue;
         }
         ESP_LOGV(LOG_TAG, "OffTimerTask SHORT timer event...");
+        const int64_t now = esp_timer_get_time();
+        const int64_t due_time = now - static_cast<uint32_t>(static_cast<uint32_t>(now) - due_time_low);
 
-        // Note: don't instantiate 'touch_values' on the stack because it takes up a bit too much space.
-        static TouchValuesAverage_t::ValueArrayType touch_values;
-
-        for (uint8_t ndx = FIRST_TOUCH_PAD_INDEX; ndx < TOUCH_PAD_MAX; ++ndx) {
-            if (!TOUCH_PAD[ndx].is_activated) {
-                // Ignore touch pads that are not currently activated.
-                touch_values[ndx] = 0;
-                continue;
-            }
-
-#if defined(TOUCH_VALUE_16_BIT)
-            uint16_t tmp_u16;
-            touch_pad_read_filtered(ndx, &tmp_u16);
-            touch_values[ndx] = tmp_u16;
-#elif defined(TOUCH_VALUE_32_BIT)
-            uint32_t tmp_u32;
-            touch_pad_filter_read_smooth(TOUCH_PAD[ndx].touch_pad_num, &tmp_u32);
-            touch_values[ndx] = tmp_u32;
+        // The inactive touch pads are neither read nor averaged.
+        [[maybe_unused]] handle_touch_result handle_touch_result = handle_touch_sample(due_time, [](unsigned ndx) {
+            TouchValue_t value = 0;
+#ifdef USE_TOUCH_TIMER_CALLBACK
+            touch_pad_filter_read_smooth(static_cast<touch_pad_t>(ndx), &value);
+#else
+            touch_pad_read_filtered(static_cast<touch_pad_t>(ndx), &value);
 #endif
-        }
-
-        handle_touch_result handle_touch_result = handle_touch_values(touch_values);
+            return value;
+        });
+#ifdef USE_TOUCH_TIMER_CALLBACK
         if (handle_touch_result::average_ready == handle_touch_result) {
-            esp_timer_stop(short_sample_timer);
+            app_scheduler_stop_job(short_sample_job);
             ESP_LOGV(LOG_TAG, "OffTimerTask restart touch sample averaging.");
+#if CONFIG_APP_DEEP_SLEEP
+            sleep_until_next_window();
+#endif
         }
+#endif
     }
 }
 
@@ -294,43 +728,138 @@ static void short_sample_timer_callback(void *arg)
     // Do the heavy lifing on the task specified in 'arg'.
     TaskHandle_t taskToNotify = static_cast<TaskHandle_t>(arg);
     //xTaskNotifyGiveIndexed(taskToNotify, readTouchPadsTask_IndexToNotify);
-    xTaskNotifyIndexed(taskToNotify, readTouchPadsTask_IndexToNotify, 1, eSetValueWithoutOverwrite);
+    // If the sampler has not taken the previous tick yet, this one is dropped (and counted as skipped).
+    xTaskNotifyIndexed(taskToNotify, readTouchPadsTask_IndexToNotify,
+                       static_cast<uint32_t>(app_scheduler_get_due_time()), eSetValueWithoutOverwrite);
 }
 #endif // USE_TOUCH_TIMER_CALLBACK
 
 
 
-static void long_sample_timer_callback(void *arg)
+// Start a new batch of samples to be averaged.
+// A window in progress (e.g. at a force update) is discarded, its samples predate the request.
+static void start_sampling_window()
 {
 #ifdef USE_TOUCH_TIMER_CALLBACK
-    // Restart the short_sample_timer regardless of whether it is running or not.
-    esp_timer_stop(short_sample_timer);
-    ESP_ERROR_CHECK(esp_timer_start_periodic(short_sample_timer, short_sample_period));
+    if (short_sample_job < 0) {
+        // Not yet added, the touch pads are still being initialized.
+        return;
+    }
+    // Restart the short_sample_job regardless of whether it is running or not.
+    // The averaging window (and so 'short_sample_period') may have changed since the last batch.
+    app_scheduler_set_period(short_sample_job, short_sample_period);
+    sampling_window_restarted = true;
+    app_scheduler_start_job(short_sample_job, short_sample_period);
+#else
+    // NOTE: with the touch filter callback (ESP32) sampling never stops,
+    //       so the next filter callback starts the new window.
+    sampling_window_restarted = true;
 #endif
 }
 
 
 
+static void long_sample_timer_callback(void *arg)
+{
+    start_sampling_window();
+}
+
+
+
+//------------------------------------------------------------------------------
+// On-demand force update.
+//------------------------------------------------------------------------------
+// Only accessed by app_touch_force_update_handler(), i.e. on the app event loop task.
+static TokenBucket force_update_rate_limit(
+        CONFIG_APP_TOUCH_FORCE_UPDATE_BURST,
+        static_cast<TokenBucket::TimeType>(CONFIG_APP_TOUCH_FORCE_UPDATE_PERIOD_SEC) * 1000000
+);
+
+static void app_touch_force_update_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    const int64_t now = esp_timer_get_time();
+    if (!force_update_rate_limit.try_take(now)) {
+        app_metrics_increment(APP_METRIC_TOUCH_FORCE_UPDATE_LIMITED);
+        ESP_LOGW(LOG_TAG, "APP_TOUCH_FORCE_UPDATE rate limited, the next one is allowed in %lld msec.",
+                 (long long)(force_update_rate_limit.get_wait_time(now) / 1000));
+        return;
+    }
+
+    ESP_LOGI(LOG_TAG, "APP_TOUCH_FORCE_UPDATE");
+    // Publish every active touch pad at the end of a sampling window started right now.
+    force_update = true;
+    start_sampling_window();
+}
+
+
+
 #ifdef USE_TOUCH_FILTER_CALLBACK
 static void touch_filter_callback(uint16_t *raw_values, uint16_t *filtered_values)
 {
-    TouchValuesAverage_t::ValueArrayType touch_values;
-    for (uint8_t ndx = 0; ndx < TOUCH_PAD_MAX; ++ndx) {
-        if (TOUCH_PAD[ndx].is_activated) {
-            touch_values[ndx] = filtered_values[ndx];
-        } else {
-            // Ignore touch pads that are not currently activated.
-            touch_values[ndx] = 0;
-        }
-    }
-    handle_touch_values(touch_values);
+    // Only the values of the active touch pads are used.
+    handle_touch_sample(NO_DUE_TIME, [filtered_values](unsigned ndx) {
+        return filtered_values[ndx];
+    });
 }
 #endif
 
 
 
+//------------------------------------------------------------------------------
+// Called once the touch filters have warmed up, just before sampling starts.
+// The touch values are time stamped, so sampling waits for the time to be synchronized.
+// (The warm-up itself overlaps Wi-Fi association and SNTP, see app_boot.h.)
+static void wait_for_sampling_dependencies()
+{
+    app_boot_stage_done(APP_BOOT_STAGE_TOUCH_WARM_UP);
+    // After a deep sleep wake-up the clock has kept running, and the network may never be brought up.
+    if (!app_boot_is_done(APP_BOOT_STAGE_SNTP) && !app_deep_sleep_is_wake_up()) {
+        ESP_LOGI(LOG_TAG, "Touch pads ready, waiting for the time to be synchronized.");
+        app_boot_wait(APP_BOOT_STAGE_SNTP, portMAX_DELAY);
+    }
+    app_boot_stage_begin(APP_BOOT_STAGE_FIRST_READING);
+}
+
+
+
 //------------------------------------------------------------------------------
 #if CONFIG_IDF_TARGET_ESP32S2 || CONFIG_IDF_TARGET_ESP32S3
+static const uint32_t WARM_UP_READ_MSEC = 50;
+
+/*
+Poll the smoothed value of each active touch pad until all of them have settled (see settle_detector.hpp
+ and CONFIG_APP_TOUCH_WARM_UP_*), but no longer than CONFIG_APP_TOUCH_WARM_UP_MAX_MSEC.
+The time it took is kept in the boot metrics.
+*/
+static void wait_for_touch_pads_to_settle()
+{
+    SettleDetector<TouchValue_t, TOUCH_PAD_MAX> settle(CONFIG_APP_TOUCH_WARM_UP_TOLERANCE,
+                                                       CONFIG_APP_TOUCH_WARM_UP_SETTLED_READS);
+    const int64_t start = esp_timer_get_time();
+    const int64_t limit = start + static_cast<int64_t>(CONFIG_APP_TOUCH_WARM_UP_MAX_MSEC) * 1000;
+    bool is_settled = false;
+    while (!is_settled && esp_timer_get_time() < limit) {
+        vTaskDelay(pdMS_TO_TICKS(WARM_UP_READ_MSEC));
+        is_settled = true;
+        touch_pipeline.for_each_pad([&settle, &is_settled](unsigned ndx) {
+            TouchValue_t value = 0;
+            touch_pad_filter_read_smooth(static_cast<touch_pad_t>(ndx), &value);
+            settle.add(ndx, value);
+            is_settled = settle.is_settled(ndx) && is_settled;
+        });
+    }
+
+    const uint32_t warm_up_ms = static_cast<uint32_t>((esp_timer_get_time() - start) / 1000);
+    app_boot_touch_warm_up(warm_up_ms, is_settled);
+    if (is_settled) {
+        ESP_LOGI(LOG_TAG, "Touch pads settled in %" PRIu32 " ms.", warm_up_ms);
+    } else {
+        ESP_LOGW(LOG_TAG, "Touch pads not settled after %" PRIu32 " ms, sampling anyway.", warm_up_ms);
+    }
+}
+
+
+
 // Initialize ESP32 S2 and S3 touch pads.
 static void read_touch_pads_init_device()
 {
@@ -356,11 +885,10 @@ static void read_touch_pads_init_device()
     touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
     touch_pad_fsm_start();
 
-    //TODO: write code to determine the better wait duration.
-    // Wait 5 seconds for the touch pad filters to start doing their thing
+    // Wait for the touch pad filters to start doing their thing
     //  before we actually start listening for touch pad values.
-    const TickType_t xdelay = 5000 / portTICK_PERIOD_MS;
-    vTaskDelay(xdelay);
+    wait_for_touch_pads_to_settle();
+    wait_for_sampling_dependencies();
 
     //---------------------------------------------------------------------
     // Now that the touch filters have had time to start doing their thing
@@ -369,30 +897,18 @@ static void read_touch_pads_init_device()
     //---------------------------------------------------------------------
 
 #ifdef USE_TOUCH_TIMER_CALLBACK
-    // Start the timer so that we average the sample values over 1 second.
-    // 1000000 microseconds = 1 second
-    short_sample_period = 1000000 / touchValuesAverage.sample_size;
-
-    { // Short Sample Timer.
-        esp_timer_create_args_t periodic_timer_args = {};
-        periodic_timer_args.callback = &short_sample_timer_callback;
-        periodic_timer_args.arg = (void *)xTaskGetCurrentTaskHandle();
-        periodic_timer_args.name = "short_sample_timer";
-        periodic_timer_args.skip_unhandled_events = true;
-        ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &short_sample_timer));
-        // NOTE: the 'short_sample_timer' is started by the 'long_sample_timer' at the prescribed intervals.
-    }
+    // NOTE: 'short_sample_period' was set by apply_touch_config() so that we average
+    //       the sample values over 1 second.
+
+    // Short Sample Timer.
+    // NOTE: the 'short_sample_job' is started by the 'long_sample_job' at the prescribed intervals.
+    short_sample_job = app_scheduler_add_job(
+            &short_sample_timer_callback, (void *)xTaskGetCurrentTaskHandle(), short_sample_period, 0);
 #endif
 
-    { // Long Sample Timer.
-        esp_timer_create_args_t periodic_timer_args = {};
-        periodic_timer_args.callback = &long_sample_timer_callback;
-        //periodic_timer_args.arg = (void *)event_loop_handle;
-        periodic_timer_args.name = "long_sample_timer";
-        periodic_timer_args.skip_unhandled_events = true;
-        ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &long_sample_timer));
-        ESP_ERROR_CHECK(esp_timer_start_periodic(long_sample_timer, long_sample_period));
-    }
+    // Long Sample Timer.
+    long_sample_job = app_scheduler_add_job(&long_sample_timer_callback, NULL, long_sample_period, LONG_SAMPLE_SLACK);
+    app_scheduler_start_job(long_sample_job, long_sample_period);
 
     ESP_LOGI(LOG_TAG, "Touch Timers Started");
 }
@@ -422,8 +938,8 @@ static void read_touch_pads_init_device()
     //   MEASUREMENT_CYCLES     32767
     //   MEASUREMENT_INTERVAL    4096
 
-    uint16_t measurement_clock_cycles = MEASUREMENT_DURATION_MSEC * (SOC_CLK_RC_FAST_FREQ_APPROX / 1000),
-             measurement_sleep_cycles = MEASUREMENT_INTERVAL_MSEC * (SOC_CLK_RC_SLOW_FREQ_APPROX / 1000);
+    uint16_t measurement_clock_cycles = measurement_duration_msec * (SOC_CLK_RC_FAST_FREQ_APPROX / 1000),
+             measurement_sleep_cycles = (MEASUREMENT_CYCLE_MSEC - measurement_duration_msec) * (SOC_CLK_RC_SLOW_FREQ_APPROX / 1000);
 
     ESP_ERROR_CHECK(touch_pad_set_measurement_clock_cycles(measurement_clock_cycles));
     ESP_ERROR_CHECK(touch_pad_set_measurement_interval(measurement_sleep_cycles));
@@ -431,38 +947,42 @@ static void read_touch_pads_init_device()
     //esp_err_t touch_pad_filter_start(uint32_t filter_period_ms)
     // filter calibration period, in ms
     ESP_ERROR_CHECK(touch_pad_filter_start(FILTER_TOUCH_PERIOD_MSEC));
+    wait_for_sampling_dependencies();
     ESP_ERROR_CHECK(touch_pad_set_filter_read_cb(&touch_filter_callback));
 }
 #endif
 
 
 
-#if CONFIG_IDF_TARGET_ESP32S2 || CONFIG_IDF_TARGET_ESP32S3
-   // For ESP32 S2 and S3, touch_pad_config() has only 1 argument.
-   // This macro allows us to ignore the second argument.
-#  define TOUCH_PAD_CONFIG(touch_num,threshold)  touch_pad_config(touch_num)
-
-#elif CONFIG_IDF_TARGET_ESP32
-   // For other targets, touch_pad_config() has 2 arguments.
-#  define TOUCH_PAD_CONFIG(touch_num,threshold)  touch_pad_config(touch_num,threshold)
+/*
+Carry on where the last deep sleep left off, or start over (see 'sampler_state').
+A config saved during the last network wake-up (i.e. not in effect yet) also starts over.
+*/
+static void resume_sampler_state()
+{
+    const bool can_resume = app_deep_sleep_is_wake_up() && sampler_state.is_constructed()
+                            && sampler_state.get().config == touch_config;
+    if (sampler_state.resume_or_construct(can_resume, touch_config)) {
+        const TouchSamplerState& state = sampler_state.get();
+        force_update = state.force_update;
+        ESP_LOGI(LOG_TAG, "Touch pad state resumed: sample period %" PRIu32 " sec, %" PRIu32 " windows deferred%s.",
+                 static_cast<uint32_t>(state.sample_period.get()), state.deferred_windows,
+                 state.is_publish_pending ? ", publish pending" : "");
+    }
+}
 
-#endif
 
 
 static void read_touch_pads_init_task(void *pvParameters)
 {
-#ifdef APP_DEBUG
-    // Determine which touch pads to Activate or deactivate.
-    // NOTE: 'is_activated' defaults to true when first initialized.
-    // TODO: this information should be stored in the Nonvolatile Storage (NVS).
-    for (uint8_t ndx = FIRST_TOUCH_PAD_INDEX; ndx < TOUCH_PAD_MAX; ++ndx) {
-        if (ndx >= 1 && ndx <= 4) {
-            TOUCH_PAD[ndx].is_activated = true;
-        } else {
-            TOUCH_PAD[ndx].is_activated = false;
-        }
-    }
-#endif
+    app_metrics_register_task(NULL);
+    app_boot_stage_begin(APP_BOOT_STAGE_TOUCH_WARM_UP);
+
+    // Determine which touch pads to Activate or deactivate, the averaging window, etc.
+    // The config stored in the Nonvolatile Storage (NVS) overrides the defaults.
+    touch_config = load_touch_config();
+    resume_sampler_state();
+    apply_touch_config(nullptr);
 
     // Initialize touch pad peripheral.
     // The default fsm mode is software trigger mode.
@@ -476,18 +996,17 @@ static void read_touch_pads_init_task(void *pvParameters)
     //esp_err_t touch_pad_set_voltage(touch_high_volt_t refh, touch_low_volt_t refl, touch_volt_atten_t atten)
     // touch_pad_set_voltage(TOUCH_HVOLT_2V7, TOUCH_LVOLT_0V5, TOUCH_HVOLT_ATTEN_1V);
 
-    for (uint8_t ndx = 0; ndx < TOUCH_PAD_MAX; ++ndx) {
-        if (TOUCH_PAD[ndx].is_activated) {
-            TOUCH_PAD_CONFIG(TOUCH_PAD[ndx].touch_pad_num, TOUCH_THRESH_NO_USE);
-        }
-    }
+    // Only the active touch pads, the others are not measured at all.
+    touch_pipeline.for_each_pad([](unsigned ndx) {
+        TOUCH_PAD_CONFIG(static_cast<touch_pad_t>(ndx), TOUCH_THRESH_NO_USE);
+    });
 
     // This must be done after the above init's and config's.
     read_touch_pads_init_device();
 
 #if defined(USE_TOUCH_TIMER_CALLBACK) && !defined(APP_DEBUG)
     // Now that everything is ready, start the short timer.
-    ESP_ERROR_CHECK(esp_timer_start_periodic(short_sample_timer, short_sample_period));
+    app_scheduler_start_job(short_sample_job, short_sample_period);
 #endif
 
     // Handle timer events "Off" of the system Timer Task.
@@ -502,7 +1021,13 @@ static void read_touch_pads_init_task(void *pvParameters)
 
 void app_read_touch_pads_init(esp_event_loop_handle_t event_loop)
 {
-    event_loop_handle = event_loop;
+    ESP_ERROR_CHECK(app_event_loop_handler_register(
+            event_loop,
+            APP_TOUCH_EVENTS,
+            APP_TOUCH_FORCE_UPDATE,
+            app_touch_force_update_handler,
+            NULL
+    ));
 
     // Create a new task for initializing the touch pads so that we can
     // put in a delay to wait for the touch pad filters to start doing there thing.
@@ -26,4 +26,16 @@ extern void app_read_touch_pads_init(esp_event_loop_handle_t event_loop);
 #endif
 
 
+#ifdef __cplusplus
+#include "touch_pad_config.hpp"
+
+// Return a copy of the latest touch pad config, including an update that is not yet in effect.
+extern TouchPadConfig app_touch_pads_get_config();
+
+// Validate 'config', save it in NVS, and hand it to the sampler which swaps it in
+//  at the next averaging window boundary. Can be called from any task.
+extern esp_err_t app_touch_pads_set_config(const TouchPadConfig& config);
+#endif // __cplusplus
+
+
 #endif // _APP_TOUCH_PADS_H_
@@ -6,11 +6,15 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <inttypes.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "esp_attr.h"
 #include "esp_system.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -19,6 +23,8 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
+#include "app_boot.h"
+#include "app_metrics.h"
 #include "app_wifi_station.h"
 
 
@@ -59,35 +65,203 @@
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
 
-/* The event group allows multiple bits for each event, but we only care about two events:
+/* The event group allows multiple bits for each event, but we only care about one event:
  * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
+ * The station never gives up, see the reconnect supervisor below. */
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
 
 static const char *LOG_TAG = "app_wifi_station";
 
-static int s_retry_num = 0;
+static esp_netif_t *s_sta_netif = NULL;
+
+
+//------------------------------------------------------------------------------
+/*
+The last good AP and IP lease, kept in RTC memory so they survive deep sleep (and resets, but not a power cycle).
+
+With them the station associates directly on the cached channel and BSSID, instead of scanning
+ every channel for the SSID. After MAXIMUM_RETRY failed attempts it falls back to a full scan.
+If DHCP is slow (CONFIG_APP_WIFI_STATIC_IP_FALLBACK_MS) the cached lease is used as a static configuration.
+
+NOTE:
+ - With CONFIG_LWIP_DHCP_RESTORE_LAST_IP (see sdkconfig.defaults) the DHCP client also asks
+   for the last address directly, which saves the DISCOVER/OFFER round trip.
+*/
+//------------------------------------------------------------------------------
+#define WIFI_CACHE_MAGIC 0x57494649 // "WIFI"
+
+typedef struct {
+    uint32_t magic;             // WIFI_CACHE_MAGIC when valid.
+    uint8_t ssid[32];           // the cache is only used for the same SSID.
+    uint8_t bssid[6];
+    uint8_t channel;
+    bool has_ip_info;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns_info;
+} wifi_cache_t;
+
+RTC_DATA_ATTR static wifi_cache_t s_cache;
+
+// The configuration for a full scan. The cached AP is applied to a copy of it.
+static wifi_config_t s_wifi_config;
+
+// These are only accessed from wifi_event_handler() (the default event loop task),
+//  and from app_wifi_station_init() before the Wi-Fi is started.
+static bool s_use_cache = false;
+static int s_fast_connect_failures = 0;
+static uint32_t s_retry_num = 0;
+static int64_t s_link_lost_us = 0;  // 0 while connected, and during the initial connect.
+
+// Set by the static IP fallback timer, just before the IP_EVENT_STA_GOT_IP it causes.
+static volatile bool s_is_static_ip = false;
+
+static esp_timer_handle_t s_reconnect_timer = NULL;
+static esp_timer_handle_t s_static_ip_timer = NULL;
+
+
+static bool is_cache_valid_for(const wifi_config_t *wifi_config)
+{
+    return s_cache.magic == WIFI_CACHE_MAGIC &&
+           memcmp(s_cache.ssid, wifi_config->sta.ssid, sizeof(s_cache.ssid)) == 0;
+}
+
+
+static void set_wifi_config(bool use_cache)
+{
+    wifi_config_t wifi_config = s_wifi_config;
+    if (use_cache) {
+        wifi_config.sta.channel = s_cache.channel;
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(wifi_config.sta.bssid));
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+}
+
+
+static void static_ip_timer_callback(void *arg)
+{
+    ESP_LOGW(LOG_TAG, "DHCP is slow, using the last lease " IPSTR " instead.", IP2STR(&s_cache.ip_info.ip));
+    s_is_static_ip = true;
+    esp_netif_dhcpc_stop(s_sta_netif);
+    // This posts IP_EVENT_STA_GOT_IP.
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(s_sta_netif, &s_cache.ip_info));
+    esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns_info);
+}
+
+
+//------------------------------------------------------------------------------
+/*
+The reconnect supervisor.
+Every disconnect schedules the next attempt on a one-shot timer, with a jittered exponential backoff:
+ the delay doubles with every failed attempt, from CONFIG_APP_WIFI_BACKOFF_MIN_MS up to CONFIG_APP_WIFI_BACKOFF_MAX_MS,
+ and the actual delay is random between half of it and all of it ("equal jitter").
+*/
+//------------------------------------------------------------------------------
+static uint32_t get_backoff_delay_ms(uint32_t retry_num)
+{
+    uint64_t delay_ms = (uint64_t)CONFIG_APP_WIFI_BACKOFF_MIN_MS << (retry_num < 32 ? retry_num : 32);
+    if (delay_ms > CONFIG_APP_WIFI_BACKOFF_MAX_MS) {
+        delay_ms = CONFIG_APP_WIFI_BACKOFF_MAX_MS;
+    }
+    const uint32_t half_delay_ms = (uint32_t)(delay_ms / 2);
+    return half_delay_ms + esp_random() % ((uint32_t)delay_ms - half_delay_ms + 1);
+}
+
+
+static void reconnect_timer_callback(void *arg)
+{
+    app_metrics_increment(APP_METRIC_WIFI_RECONNECTS);
+    esp_wifi_connect();
+}
+
+
+static void schedule_reconnect()
+{
+    const uint32_t delay_ms = get_backoff_delay_ms(s_retry_num++);
+    ESP_LOGI(LOG_TAG, "retry to connect to the AP in %" PRIu32 " ms", delay_ms);
+    esp_timer_stop(s_reconnect_timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(s_reconnect_timer, (uint64_t)delay_ms * 1000));
+}
+
+
+static void on_disconnected()
+{
+    esp_timer_stop(s_static_ip_timer);
+    const bool was_connected = xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT) & WIFI_CONNECTED_BIT;
+
+    if (s_is_static_ip) {
+        // Give DHCP another chance on the next association.
+        s_is_static_ip = false;
+        esp_netif_dhcpc_start(s_sta_netif);
+    }
+
+    if (was_connected) {
+        s_link_lost_us = esp_timer_get_time();
+        s_fast_connect_failures = 0;
+        // The configuration is only changed while disconnected, changing it while connected disconnects.
+        if (!s_use_cache) {
+            s_use_cache = true;
+            set_wifi_config(true);
+        }
+    } else if (s_use_cache && ++s_fast_connect_failures >= MAXIMUM_RETRY) {
+        ESP_LOGI(LOG_TAG, "The cached AP did not answer, falling back to a full scan.");
+        s_use_cache = false;
+        s_cache.magic = 0;
+        set_wifi_config(false);
+        app_metrics_increment(APP_METRIC_WIFI_FULL_SCANS);
+    }
+    schedule_reconnect();
+}
+
+
+static void on_connected(const wifi_event_sta_connected_t *event)
+{
+    memcpy(s_cache.bssid, event->bssid, sizeof(s_cache.bssid));
+    s_cache.channel = event->channel;
+
+    if (CONFIG_APP_WIFI_STATIC_IP_FALLBACK_MS > 0 && s_use_cache && s_cache.has_ip_info) {
+        esp_timer_stop(s_static_ip_timer);
+        ESP_ERROR_CHECK(esp_timer_start_once(s_static_ip_timer, CONFIG_APP_WIFI_STATIC_IP_FALLBACK_MS * 1000LL));
+    }
+}
+
+
+static void on_got_ip(const ip_event_got_ip_t *event)
+{
+    esp_timer_stop(s_static_ip_timer);
+    ESP_LOGI(LOG_TAG, "got ip:" IPSTR " on channel %u", IP2STR(&event->ip_info.ip), s_cache.channel);
+
+    // Remember this AP and lease for the next (re)connect.
+    memcpy(s_cache.ssid, s_wifi_config.sta.ssid, sizeof(s_cache.ssid));
+    s_cache.ip_info = event->ip_info;
+    esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns_info);
+    s_cache.has_ip_info = true;
+    s_cache.magic = WIFI_CACHE_MAGIC;
+    s_retry_num = 0;
+
+    if (s_link_lost_us != 0) {
+        const int64_t reconnect_ms = (esp_timer_get_time() - s_link_lost_us) / 1000;
+        s_link_lost_us = 0;
+        ESP_LOGI(LOG_TAG, "Reconnected in %lld ms.", (long long)reconnect_ms);
+        app_metrics_record(APP_METRIC_HISTOGRAM_WIFI_RECONNECT_MS, (uint32_t)reconnect_ms);
+    }
+
+    app_boot_stage_done(APP_BOOT_STAGE_WIFI);
+    xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+}
 
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        on_connected((const wifi_event_sta_connected_t *)event_data);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(LOG_TAG, "retry to connect to the AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(LOG_TAG,"connect to the AP fail");
+        ESP_LOGI(LOG_TAG, "connect to the AP fail, reason %d", ((wifi_event_sta_disconnected_t *)event_data)->reason);
+        on_disconnected();
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(LOG_TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        on_got_ip((const ip_event_got_ip_t *)event_data);
     }
 }
 
@@ -109,7 +283,16 @@ void app_wifi_station_init(const char *wifi_ssid, const char *wifi_password)
     //ESP_ERROR_CHECK(esp_netif_init());
     //ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
+
+    esp_timer_create_args_t timer_args = {
+        .callback = &reconnect_timer_callback,
+        .name = "wifi_reconnect",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_reconnect_timer));
+    timer_args.callback = &static_ip_timer_callback;
+    timer_args.name = "wifi_static_ip";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_static_ip_timer));
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -152,28 +335,24 @@ void app_wifi_station_init(const char *wifi_ssid, const char *wifi_password)
         wifi_config.sta.password[ sizeof(wifi_config.sta.password)-1 ] = '\0';
     }
 
-    ESP_LOGI(LOG_TAG, "app_wifi_station_init() connecting to '%s'", wifi_config.sta.ssid);
+    s_wifi_config = wifi_config;
+    s_use_cache = is_cache_valid_for(&wifi_config);
+
+    ESP_LOGI(LOG_TAG, "app_wifi_station_init() connecting to '%s'%s", wifi_config.sta.ssid,
+             s_use_cache ? " (cached AP)" : "");
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+    set_wifi_config(s_use_cache);
+    app_boot_stage_begin(APP_BOOT_STAGE_WIFI);
     ESP_ERROR_CHECK(esp_wifi_start() );
 
     ESP_LOGI(LOG_TAG, "app_wifi_station_init() finished.");
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by wifi_event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+    /* Waiting until the connection is established (WIFI_CONNECTED_BIT), which is set by wifi_event_handler()
+     * (see above). Until then the reconnect supervisor keeps trying. */
+    xEventGroupWaitBits(s_wifi_event_group,
+            WIFI_CONNECTED_BIT,
             pdFALSE,
             pdFALSE,
             portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(LOG_TAG, "connected to ap SSID:%s", wifi_config.sta.ssid);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(LOG_TAG, "Failed to connect to SSID:%s", wifi_config.sta.ssid);
-    } else {
-        ESP_LOGE(LOG_TAG, "UNEXPECTED EVENT");
-    }
+    ESP_LOGI(LOG_TAG, "connected to ap SSID:%s", wifi_config.sta.ssid);
 }
@@ -0,0 +1,234 @@
+// config_arena.hpp
+
+#ifndef _CONFIG_ARENA_HPP_
+#define _CONFIG_ARENA_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+
+
+/*
+All the values of one configuration namespace in one contiguous heap allocation.
+
+It is built in two passes over the namespace (e.g. with the NVS entry iterator):
+ 1. add() every key with its type and size. Nothing is allocated yet.
+ 2. load(read) allocates the arena once, for all the values, and calls
+    'read(key, type, buffer, size)' to fill in each one.
+After that the values are served as views into the arena, until it is destroyed or reset().
+
+ - Lookups are a binary search over at most 'max_entries' keys.
+ - Trailing new lines and carriage returns are trimmed off strings once, while loading.
+ - Every string and blob is followed by a null terminator (not included in its size,
+   except for strings, whose size includes it as in NVS), so text blobs (e.g. PEM) can be used as strings.
+ - Integers are stored as their native bytes, so get_integer() reads them back with memcpy
+   (no alignment requirements).
+
+NOTE:
+ - NOT thread safe.
+ - Keys longer than max_key_length (the NVS limit) are rejected.
+*/
+template<std::size_t max_entries_>
+class ConfigArena {
+public:
+    static const std::size_t max_entries = max_entries_;
+    static const std::size_t max_key_length = 15;
+
+    enum class ValueType : uint8_t {
+        UNSIGNED,   // size 1, 2, 4 or 8.
+        SIGNED,     // size 1, 2, 4 or 8.
+        STRING,     // size includes the null terminator, as NVS reports it.
+        BLOB,
+    };
+
+    struct Value {
+        ValueType type = ValueType::BLOB;
+        const std::byte *data = nullptr;
+        std::size_t size = 0;
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+
+    ConfigArena() = default;
+    ConfigArena(const ConfigArena&) = delete;
+    ConfigArena& operator=(const ConfigArena&) = delete;
+
+
+    void reset() {
+        arena.reset();
+        arena_size = 0;
+        entry_count = 0;
+        is_loaded = false;
+    }
+
+    std::size_t size() const { return entry_count; }
+    std::size_t bytes_used() const { return arena_size; }
+    bool loaded() const { return is_loaded; }
+
+
+    // Pass 1. Returns false if the key is too long, there is no room for it, or it was already added.
+    bool add(std::string_view key, ValueType type, std::size_t size) {
+        if (is_loaded || key.empty() || key.size() > max_key_length || entry_count >= max_entries) {
+            return false;
+        }
+        for (std::size_t index = 0; index < entry_count; ++index) {
+            if (key_of(entries[index]) == key) {
+                return false;
+            }
+        }
+
+        Entry &entry = entries[entry_count++];
+        std::memcpy(entry.key, key.data(), key.size());
+        entry.key[key.size()] = '\0';
+        entry.key_length = static_cast<uint8_t>(key.size());
+        entry.type = type;
+        entry.size = size;
+        return true;
+    }
+
+
+    /*
+    Pass 2. 'read' is called as bool read(const char *key, ValueType type, std::byte *buffer, std::size_t size)
+     for every added key, in key order. Entries that it fails to read are dropped.
+    Returns false if the arena could not be allocated.
+    */
+    template<typename Reader>
+    bool load(Reader &&read) {
+        if (is_loaded) {
+            return true;
+        }
+
+        // An insertion sort: there are only a few keys, and std::sort() over the fixed size 'entries'
+        //  trips -Warray-bounds (its > 16 elements paths are instantiated for an array of 'max_entries').
+        for (std::size_t index = 1; index < entry_count; ++index) {
+            const Entry entry = entries[index];
+            std::size_t insert_at = index;
+            for (; insert_at > 0 && key_of(entry) < key_of(entries[insert_at - 1]); --insert_at) {
+                entries[insert_at] = entries[insert_at - 1];
+            }
+            entries[insert_at] = entry;
+        }
+
+        std::size_t total_size = 0;
+        for (std::size_t index = 0; index < entry_count; ++index) {
+            Entry &entry = entries[index];
+            entry.offset = total_size;
+            // One more for a guaranteed null terminator.
+            total_size += entry.size + 1;
+        }
+
+        arena.reset(new (std::nothrow) std::byte[total_size ? total_size : 1]);
+        if (!arena) {
+            entry_count = 0;
+            return false;
+        }
+        arena_size = total_size;
+
+        std::size_t kept_count = 0;
+        for (std::size_t index = 0; index < entry_count; ++index) {
+            Entry entry = entries[index];
+            std::byte *buffer = &arena[entry.offset];
+            if (!read(static_cast<const char *>(entry.key), entry.type, buffer, entry.size)) {
+                continue;
+            }
+            buffer[entry.size] = std::byte(0);
+            if (entry.type == ValueType::STRING) {
+                char *str = reinterpret_cast<char *>(buffer);
+                std::size_t length = std::strlen(str);
+                while (length && (str[length - 1] == '\n' || str[length - 1] == '\r')) {
+                    str[--length] = '\0';
+                }
+                entry.size = length + 1;
+            }
+            entries[kept_count++] = entry;
+        }
+        entry_count = kept_count;
+        is_loaded = true;
+        return true;
+    }
+
+
+    Value find(std::string_view key) const {
+        Value value;
+        const Entry *entry = find_entry(key);
+        if (entry) {
+            value.type = entry->type;
+            value.data = &arena[entry->offset];
+            value.size = entry->size;
+        }
+        return value;
+    }
+
+    // Null terminated, nullptr if 'key' is missing or not a string.
+    const char *get_str(std::string_view key) const {
+        const Value value = find(key);
+        return (value && value.type == ValueType::STRING) ? reinterpret_cast<const char *>(value.data) : nullptr;
+    }
+
+    // Any type, as bytes. An empty Value if 'key' is missing.
+    Value get_blob(std::string_view key) const {
+        return find(key);
+    }
+
+    // Returns false (and leaves 'result' unchanged) if 'key' is missing or not an integer.
+    template<typename T>
+    bool get_integer(std::string_view key, T &result) const {
+        const Value value = find(key);
+        if (!value || (value.type != ValueType::UNSIGNED && value.type != ValueType::SIGNED) || value.size > 8) {
+            return false;
+        }
+        uint64_t bits = 0;
+        std::memcpy(&bits, value.data, value.size);  // little endian, like the ESP32.
+        if (value.type == ValueType::SIGNED && value.size < 8 && (bits >> (value.size * 8 - 1)) & 1) {
+            bits |= ~uint64_t(0) << (value.size * 8);  // sign extend.
+        }
+        result = static_cast<T>(bits);
+        return true;
+    }
+
+
+private:
+    struct Entry {
+        char key[max_key_length + 1];
+        uint8_t key_length;
+        ValueType type;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::array<Entry, max_entries_> entries;
+    std::size_t entry_count = 0;
+    std::unique_ptr<std::byte[]> arena;
+    std::size_t arena_size = 0;
+    bool is_loaded = false;
+
+
+    static std::string_view key_of(const Entry &entry) {
+        return std::string_view(entry.key, entry.key_length);
+    }
+
+    const Entry *find_entry(std::string_view key) const {
+        if (!is_loaded) {
+            return nullptr;
+        }
+        std::size_t low = 0, high = entry_count;
+        while (low < high) {
+            const std::size_t mid = (low + high) / 2;
+            if (key_of(entries[mid]) < key) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return (low < entry_count && key_of(entries[low]) == key) ? &entries[low] : nullptr;
+    }
+};
+
+
+
+#endif // _CONFIG_ARENA_HPP_
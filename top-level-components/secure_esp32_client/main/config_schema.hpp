@@ -0,0 +1,150 @@
+// config_schema.hpp
+
+#ifndef _CONFIG_SCHEMA_HPP_
+#define _CONFIG_SCHEMA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+/*
+Typed keys of a configuration namespace, with their defaults and valid ranges.
+
+A schema is a struct of constexpr keys, e.g.
+
+  struct TouchPadSchema {
+      static constexpr const char *nvs_namespace = "touchpad";
+      static constexpr ConfigKey<uint8_t> average_bits{"average_bits", 7, 0, 10};
+      static constexpr ConfigStrKey label{"label", "none"};
+  };
+  static_assert(config_schema_is_valid(TouchPadSchema::average_bits, TouchPadSchema::label));
+
+ - read_config() returns the stored value of a key, or its default if the value is missing,
+   is not an integer, or is out of range. So the rest of the app never sees an invalid value.
+ - The key names are checked at compile time against the NVS limit (15 characters),
+   and so are the defaults against the ranges.
+
+NOTE:
+ - Only the unsigned integer types of NVS (u8, u16, u32) are supported, plus strings and blobs.
+ - Stored integers of another width are accepted as long as they are in range.
+*/
+
+enum class ConfigKeyType : uint8_t { U8, U16, U32, STR, BLOB };
+
+// The NVS limit, without the null terminator.
+constexpr std::size_t CONFIG_MAX_KEY_LENGTH = 15;
+
+
+template<typename T> struct ConfigKeyTypeOf;
+template<> struct ConfigKeyTypeOf<uint8_t>  { static constexpr ConfigKeyType value = ConfigKeyType::U8; };
+template<> struct ConfigKeyTypeOf<uint16_t> { static constexpr ConfigKeyType value = ConfigKeyType::U16; };
+template<> struct ConfigKeyTypeOf<uint32_t> { static constexpr ConfigKeyType value = ConfigKeyType::U32; };
+
+
+constexpr bool is_valid_config_key_name(std::string_view name)
+{
+    return !name.empty() && name.size() <= CONFIG_MAX_KEY_LENGTH;
+}
+
+
+template<typename T>
+struct ConfigKey {
+    using value_type = T;
+    static constexpr ConfigKeyType type = ConfigKeyTypeOf<T>::value;
+
+    std::string_view name;
+    T default_value;
+    T min_value;
+    T max_value;
+
+    constexpr bool in_range(uint64_t value) const {
+        return value >= min_value && value <= max_value;
+    }
+
+    constexpr bool is_valid() const {
+        return is_valid_config_key_name(name) && min_value <= max_value && in_range(default_value);
+    }
+};
+
+
+struct ConfigStrKey {
+    using value_type = const char *;
+    static constexpr ConfigKeyType type = ConfigKeyType::STR;
+
+    std::string_view name;
+    const char *default_value = nullptr;  // nullptr: there is no default.
+
+    constexpr bool is_valid() const { return is_valid_config_key_name(name); }
+};
+
+
+struct ConfigBlobKey {
+    static constexpr ConfigKeyType type = ConfigKeyType::BLOB;
+
+    std::string_view name;  // blobs have no default, a missing blob is empty.
+
+    constexpr bool is_valid() const { return is_valid_config_key_name(name); }
+};
+
+
+
+// Every key is valid, and no two keys have the same name.
+template<typename... Keys>
+constexpr bool config_schema_is_valid(const Keys&... keys)
+{
+    const std::string_view names[] = { keys.name... };
+    const bool is_valid[] = { keys.is_valid()... };
+    const std::size_t count = sizeof...(keys);
+    for (std::size_t index = 0; index < count; ++index) {
+        if (!is_valid[index]) {
+            return false;
+        }
+        for (std::size_t other = index + 1; other < count; ++other) {
+            if (names[index] == names[other]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+
+enum class ConfigReadStatus : uint8_t {
+    OK,
+    MISSING,        // or not an integer.
+    OUT_OF_RANGE,
+};
+
+/*
+'source' provides bool get_integer(std::string_view key, uint64_t& result) (e.g. a ConfigArena).
+'result' is set to the stored value if the status is OK, otherwise to the default.
+*/
+template<typename T, class Source>
+ConfigReadStatus read_config(const Source& source, const ConfigKey<T>& key, T& result)
+{
+    uint64_t value = 0;
+    result = key.default_value;
+    if (!source.get_integer(key.name, value)) {
+        return ConfigReadStatus::MISSING;
+    }
+    if (!key.in_range(value)) {
+        return ConfigReadStatus::OUT_OF_RANGE;
+    }
+    result = static_cast<T>(value);
+    return ConfigReadStatus::OK;
+}
+
+
+// 'source' provides const char *get_str(std::string_view key), nullptr if missing.
+template<class Source>
+const char *read_config(const Source& source, const ConfigStrKey& key)
+{
+    const char *value = source.get_str(key.name);
+    return value ? value : key.default_value;
+}
+
+
+
+#endif // _CONFIG_SCHEMA_HPP_
@@ -0,0 +1,189 @@
+// deadline_scheduler.hpp
+
+#ifndef _DEADLINE_SCHEDULER_HPP_
+#define _DEADLINE_SCHEDULER_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+A deadline ordered scheduler of periodic jobs, driven by a caller supplied clock
+(e.g. esp_timer_get_time(), or a virtual clock in a host test).
+
+The caller sleeps until get_wake_time(), and then calls run_due(now) (or collect_due()
+and invoke()) to run every job that is due. The active jobs are kept in a min-heap
+ordered by their due time.
+
+Nearby deadlines are coalesced with a per job 'slack': a job may run up to 'slack'
+after its due time. get_wake_time() is the earliest (due + slack) of all the jobs,
+and every job that is due by then runs on that same wake-up. So a job with a large
+slack (e.g. a 1 second housekeeping tick) rides along with the wake-ups of the
+jobs that need to be on time, instead of waking the CPU on its own.
+
+A job that falls more than a whole period behind skips the missed runs (they are
+counted by get_skipped_count()), like esp_timer's 'skip_unhandled_events'.
+
+NOTE:
+ - NOT thread safe. The caller must serialize access if it is shared between Tasks.
+ - 'now' must never go backwards.
+ - The jobs are added once, during initialization. They can then be started and stopped at any time.
+*/
+template<std::size_t max_jobs_>
+class DeadlineScheduler {
+public:
+    using TimeType = int64_t;
+    using Callback = void (*)(void *arg);
+
+    static const std::size_t max_jobs = max_jobs_;
+    static constexpr TimeType NEVER = INT64_MAX;
+    static_assert(max_jobs_ >= 1 && max_jobs_ <= 255, "max_jobs must be in the range [1, 255]");
+
+
+    DeadlineScheduler() = default;
+    DeadlineScheduler(const DeadlineScheduler&) = delete;
+    DeadlineScheduler& operator=(const DeadlineScheduler&) = delete;
+
+
+    // Returns the job id, or -1 if there is no room left. The job is not started.
+    int add_job(Callback callback, void *arg, TimeType period, TimeType slack = 0) {
+        if (job_count >= max_jobs) {
+            return -1;
+        }
+        Job &job = jobs[job_count];
+        job.callback = callback;
+        job.arg = arg;
+        job.period = period > 0 ? period : 1;
+        job.slack = slack > 0 ? slack : 0;
+        job.is_active = false;
+        return static_cast<int>(job_count++);
+    }
+
+
+    // Run 'job' at 'first_due' and then every period. Restarts it if it is already active.
+    void start(int job, TimeType first_due) {
+        remove_from_heap(job);
+        jobs[job].due = first_due;
+        jobs[job].is_active = true;
+        heap[heap_size++] = static_cast<uint8_t>(job);
+        std::push_heap(heap.begin(), heap.begin() + heap_size, due_later);
+    }
+
+    void stop(int job) {
+        remove_from_heap(job);
+        jobs[job].is_active = false;
+    }
+
+    // Takes effect from the next run of 'job'.
+    void set_period(int job, TimeType period) {
+        jobs[job].period = period > 0 ? period : 1;
+    }
+
+    bool is_active(int job) const { return jobs[job].is_active; }
+    TimeType get_due(int job) const { return jobs[job].due; }
+    uint32_t get_skipped_count() const { return skipped_count; }
+
+
+    // The time by which the earliest job must run, NEVER if no job is active.
+    TimeType get_wake_time() const {
+        TimeType wake_time = NEVER;
+        for (std::size_t index = 0; index < heap_size; ++index) {
+            const Job &job = jobs[heap[index]];
+            wake_time = std::min(wake_time, job.due + job.slack);
+        }
+        return wake_time;
+    }
+
+
+    /*
+    Store the id of every job due at 'now' in 'due_jobs' (in due time order) and schedule their next runs.
+    If 'due_times' is not nullptr, the time each one was due is stored in it too.
+    Returns the number of jobs stored, at most 'max_count'.
+    Calling the callbacks is left to the caller (see invoke()), e.g. outside of a lock.
+    */
+    std::size_t collect_due(TimeType now, int *due_jobs, std::size_t max_count, TimeType *due_times = nullptr) {
+        std::size_t count = 0;
+        while (heap_size && count < max_count) {
+            const int job_id = heap[0];
+            Job &job = jobs[job_id];
+            if (job.due > now) {
+                break;
+            }
+            std::pop_heap(heap.begin(), heap.begin() + heap_size, due_later);
+
+            if (due_times) {
+                due_times[count] = job.due;
+            }
+            job.due += job.period;
+            if (job.due <= now) {
+                const TimeType missed = (now - job.due) / job.period + 1;
+                skipped_count += static_cast<uint32_t>(missed);
+                job.due += missed * job.period;
+            }
+            std::push_heap(heap.begin(), heap.begin() + heap_size, due_later);
+
+            due_jobs[count++] = job_id;
+        }
+        return count;
+    }
+
+    void invoke(int job) const {
+        jobs[job].callback(jobs[job].arg);
+    }
+
+    // collect_due() and invoke() in one. Returns the number of jobs run.
+    std::size_t run_due(TimeType now) {
+        int due_jobs[max_jobs_];
+        const std::size_t count = collect_due(now, due_jobs, max_jobs_);
+        for (std::size_t index = 0; index < count; ++index) {
+            invoke(due_jobs[index]);
+        }
+        return count;
+    }
+
+
+private:
+    struct Job {
+        Callback callback = nullptr;
+        void *arg = nullptr;
+        TimeType period = 1;
+        TimeType slack = 0;
+        TimeType due = 0;
+        bool is_active = false;
+    };
+
+    std::array<Job, max_jobs_> jobs;
+    std::size_t job_count = 0;
+
+    // A min-heap of the active job ids, ordered by due time.
+    std::array<uint8_t, max_jobs_> heap;
+    std::size_t heap_size = 0;
+    uint32_t skipped_count = 0;
+
+    // The std heap functions build a max-heap, so their "less" is "due later".
+    struct DueLater {
+        const std::array<Job, max_jobs_> *jobs;
+        bool operator()(uint8_t left, uint8_t right) const {
+            return (*jobs)[left].due > (*jobs)[right].due;
+        }
+    };
+    const DueLater due_later {&jobs};
+
+    void remove_from_heap(int job) {
+        if (!jobs[job].is_active) {
+            return;
+        }
+        auto heap_end = heap.begin() + heap_size;
+        auto position = std::find(heap.begin(), heap_end, static_cast<uint8_t>(job));
+        if (position != heap_end) {
+            *position = heap[--heap_size];
+            std::make_heap(heap.begin(), heap.begin() + heap_size, due_later);
+        }
+    }
+};
+
+
+
+#endif // _DEADLINE_SCHEDULER_HPP_
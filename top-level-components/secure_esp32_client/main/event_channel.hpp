@@ -0,0 +1,247 @@
+// event_channel.hpp
+
+#ifndef _EVENT_CHANNEL_HPP_
+#define _EVENT_CHANNEL_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef EMULATE_SYSTEM_CALLS
+#  include "emulated_system_calls.hpp"
+#else
+#  include "freertos/FreeRTOS.h"
+#  include "freertos/task.h"
+#endif
+
+
+/*
+A typed, pool backed event channel that passes events by slot index.
+
+esp_event_post_to() copies the payload into the event loop's queue, and then again
+into a heap allocated buffer for the handlers. Here the producer fills a slot of a
+fixed pool in place and only the slot index travels to the consumer task, which runs
+the handlers directly on the slot. Nothing is allocated or copied per event.
+
+Producers (any number of tasks):
+    int slot = channel.acquire();           // -1 when all slots are in use.
+    channel[slot].touch_value = ...;        // fill it in place.
+    channel.post(slot, MY_EVENT_ID);        // the slot now belongs to the consumer.
+
+Consumer (the one task given to set_consumer()):
+    channel.dispatch(portMAX_DELAY);        // runs the handlers of the posted events, in posting order,
+                                            //  and then returns the slots to the pool.
+
+Handlers are registered per event id (or ANY_ID), similar to esp_event_handler_instance_register_with().
+
+NOTE:
+ - Thread safe for any number of producers and a single consumer.
+ - Lock free: the free slots are an atomic bitmask and the posted slots a bounded ring of indices.
+ - Register the handlers before the first event is dispatched.
+ - slot_count must be in the range [1, 32].
+*/
+template<class T, std::size_t slot_count_, std::size_t max_handlers_ = 4>
+class EventChannel {
+public:
+    using ValueType = T;
+    using Handler = void (*)(void *handler_arg, int32_t event_id, T& data);
+
+    static const std::size_t slot_count = slot_count_;
+    static const std::size_t max_handlers = max_handlers_;
+    static const int32_t ANY_ID = -1;
+    static_assert(slot_count_ >= 1 && slot_count_ <= 32, "slot_count must be in the range [1, 32]");
+
+
+    EventChannel() {
+        for (std::size_t index = 0; index < ring_size; ++index) {
+            ring[index].sequence.store(index, std::memory_order_relaxed);
+        }
+    }
+
+    EventChannel(const EventChannel&) = delete;
+    EventChannel& operator=(const EventChannel&) = delete;
+
+
+    // The task that calls dispatch(). Until it is set, post() doesn't notify anyone
+    //  and events simply wait in their slots (or the consumer polls with dispatch_pending()).
+    void set_consumer(TaskHandle_t task, UBaseType_t index_to_notify) {
+        consumer_index_to_notify = index_to_notify;
+        consumer_task.store(task, std::memory_order_release);
+    }
+
+
+    /*
+    Register 'handler' for 'event_id' (or ANY_ID).
+    Returns the handler instance (for unregister_handler), or -1 if there is no room left.
+    */
+    int register_handler(int32_t event_id, Handler handler, void *handler_arg) {
+        for (std::size_t index = 0; index < max_handlers; ++index) {
+            if (!handlers[index].handler) {
+                handlers[index].event_id = event_id;
+                handlers[index].handler_arg = handler_arg;
+                handlers[index].handler = handler;
+                return static_cast<int>(index);
+            }
+        }
+        return -1;
+    }
+
+    void unregister_handler(int instance) {
+        if (instance >= 0 && static_cast<std::size_t>(instance) < max_handlers) {
+            handlers[instance].handler = nullptr;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Producer side.
+    //--------------------------------------------------------------------------
+
+    // Take a slot from the pool. Returns -1 if all slots are in use.
+    int acquire() {
+        uint32_t free_mask = free_slots.load(std::memory_order_relaxed);
+        while (free_mask) {
+            const unsigned slot = __builtin_ctz(free_mask);
+            if (free_slots.compare_exchange_weak(free_mask, free_mask & ~(1u << slot), std::memory_order_acquire)) {
+                return static_cast<int>(slot);
+            }
+        }
+        return -1;
+    }
+
+    T& operator[](int slot) { return slots[slot]; }
+
+    // Hand an acquired slot back without posting it.
+    void release(int slot) {
+        free_slots.fetch_or(1u << slot, std::memory_order_release);
+    }
+
+    // Hand an acquired (and filled) slot to the consumer.
+    void post(int slot, int32_t event_id) {
+        // There are never more posted slots than 'slot_count' <= 'ring_size', so this always fits.
+        std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+        RingCell *cell;
+        while (true) {
+            cell = &ring[position & ring_mask];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+        cell->slot = static_cast<uint8_t>(slot);
+        cell->event_id = event_id;
+        cell->sequence.store(position + 1, std::memory_order_release);
+
+        TaskHandle_t task = consumer_task.load(std::memory_order_acquire);
+        if (task) {
+            xTaskNotifyGiveIndexed(task, consumer_index_to_notify);
+        }
+    }
+
+    // Copy 'value' into a new slot and post it. Returns false if all slots are in use.
+    bool post_copy(int32_t event_id, const T& value) {
+        const int slot = acquire();
+        if (slot < 0) {
+            return false;
+        }
+        slots[slot] = value;
+        post(slot, event_id);
+        return true;
+    }
+
+
+    //--------------------------------------------------------------------------
+    // Consumer side.
+    //--------------------------------------------------------------------------
+
+    // Run the handlers of every event posted so far, without blocking.
+    // Returns the number of events dispatched.
+    std::size_t dispatch_pending() {
+        std::size_t count = 0;
+        while (true) {
+            RingCell &cell = ring[dequeue_position & ring_mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence != dequeue_position + 1) {
+                // Empty, or the next producer in line hasn't finished posting (it will notify when it has).
+                return count;
+            }
+            const int slot = cell.slot;
+            const int32_t event_id = cell.event_id;
+            cell.sequence.store(dequeue_position + ring_size, std::memory_order_release);
+            ++dequeue_position;
+
+            for (const auto &entry : handlers) {
+                if (entry.handler && (entry.event_id == ANY_ID || entry.event_id == event_id)) {
+                    entry.handler(entry.handler_arg, event_id, slots[slot]);
+                }
+            }
+            release(slot);
+            ++count;
+        }
+    }
+
+    // Wait up to 'ticks_to_wait' for events to be posted, then dispatch them.
+    // Must be called from the consumer task. Returns the number of events dispatched.
+    std::size_t dispatch(TickType_t ticks_to_wait) {
+        std::size_t count = dispatch_pending();
+        if (count == 0) {
+            ulTaskNotifyTakeIndexed(consumer_index_to_notify, pdTRUE, ticks_to_wait);
+            count = dispatch_pending();
+        }
+        return count;
+    }
+
+
+    std::size_t get_free_count() const {
+        return __builtin_popcount(free_slots.load(std::memory_order_relaxed));
+    }
+
+
+private:
+    static constexpr std::size_t round_up_to_power_of_2(std::size_t value) {
+        std::size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    static const std::size_t ring_size = round_up_to_power_of_2(slot_count_);
+    static const std::size_t ring_mask = ring_size - 1;
+
+    // A bounded ring of posted slot indices (D. Vyukov's bounded MPMC queue).
+    // 'sequence' tells whether a cell is free for the producer at that position
+    //  or holds a posted slot for the consumer.
+    struct RingCell {
+        std::atomic<std::size_t> sequence;
+        int32_t event_id;
+        uint8_t slot;
+    };
+
+    struct HandlerEntry {
+        int32_t event_id = ANY_ID;
+        Handler handler = nullptr;
+        void *handler_arg = nullptr;
+    };
+
+    std::array<T, slot_count_> slots;
+    std::atomic<uint32_t> free_slots {static_cast<uint32_t>(slot_count_ == 32 ? 0xffffffffu : (1u << slot_count_) - 1)};
+
+    std::array<RingCell, ring_size> ring;
+    std::atomic<std::size_t> enqueue_position {0};
+    std::size_t dequeue_position = 0; // only accessed by the consumer.
+
+    std::array<HandlerEntry, max_handlers_> handlers;
+    std::atomic<TaskHandle_t> consumer_task {nullptr};
+    UBaseType_t consumer_index_to_notify = 0;
+};
+
+
+
+#endif // _EVENT_CHANNEL_HPP_
@@ -6,6 +6,8 @@
 #include <array>
 #include <ostream>
 
+#include "lane_mask.hpp"
+
 
 
 template<class T, class S, std::size_t array_size_>
@@ -31,15 +33,22 @@ public:
     **/
 
     static const std::size_t array_size = array_size_;
-    const unsigned number_of_bits;
-    const unsigned sample_size;
+    // Read-only outside of this class. Use set_number_of_bits() to change them.
+    unsigned number_of_bits;
+    unsigned sample_size;
+
+
+    FastArrayAverage(unsigned number_of_bits) {
+        set_number_of_bits(number_of_bits);
+    }
 
 
-    FastArrayAverage(unsigned number_of_bits) :
-        number_of_bits(number_of_bits),
-        sample_size(1 << number_of_bits) // The number of samples to collect before calculating the average.
-    {
+    // Change the averaging window to 2^number_of_bits samples.
+    // Any partially accumulated average is discarded.
+    void set_number_of_bits(unsigned new_number_of_bits) {
         //TODO: number_of_bits > 0 and number_of_bits < 2^(sizeof(S))
+        number_of_bits = new_number_of_bits;
+        sample_size = 1 << new_number_of_bits; // The number of samples to collect before calculating the average.
         reset();
     }
 
@@ -60,6 +69,30 @@ public:
     }
 
 
+    /*
+    Only the lanes in 'lanes' are accumulated, the others are left as they are.
+    The average of a lane is only meaningful if it was in 'lanes' for the whole window,
+     so change the lanes at a window boundary (i.e. right after get_average_values()).
+    */
+    void add_values(const ValueArrayType& values, LaneMask lanes) {
+        static_assert(array_size <= 32, "LaneMask has 32 lanes.");
+        for_each_lane(lanes, [&](unsigned index) {
+            accumulator[index] += values[index];
+        });
+        ++array_sample_count;
+    }
+
+    // The same, with the lanes fixed at compile time, unrolled to exactly those lanes.
+    template<LaneMask lanes>
+    void add_values(const ValueArrayType& values) {
+        static_assert(array_size <= 32, "LaneMask has 32 lanes.");
+        for_each_lane<lanes>([&](unsigned index) {
+            accumulator[index] += values[index];
+        });
+        ++array_sample_count;
+    }
+
+
     bool is_average_ready() {
         return array_sample_count == sample_size;
     }
@@ -94,6 +127,29 @@ public:
     }
 
 
+    // Only the lanes in 'lanes' are set in 'result', the others are left as they are.
+    void get_average_values(ValueArrayType& result, LaneMask lanes) {
+        const bool is_ready = is_average_ready();
+        for_each_lane(lanes, [&](unsigned index) {
+            result[index] = is_ready ? average_of(index) : 0;
+        });
+        if (is_ready) {
+            reset();
+        }
+    }
+
+    template<LaneMask lanes>
+    void get_average_values(ValueArrayType& result) {
+        const bool is_ready = is_average_ready();
+        for_each_lane<lanes>([&](unsigned index) {
+            result[index] = is_ready ? average_of(index) : 0;
+        });
+        if (is_ready) {
+            reset();
+        }
+    }
+
+
 #if defined(DEBUG) || defined(APP_DEBUG)
     void debug_stream(std::ostream &stream) {
         stream << "array_sample_count:" << array_sample_count
@@ -132,6 +188,14 @@ public:
 private:
     unsigned array_sample_count = 0;
     std::array<AccumulatorType, array_size> accumulator;
+
+
+    T average_of(std::size_t index) const {
+        if (accumulator[index] < 0) {
+            return -(-accumulator[index] >> number_of_bits);
+        }
+        return accumulator[index] >> number_of_bits;
+    }
 };
 
 
@@ -0,0 +1,395 @@
+// filter_pipeline.hpp
+
+#ifndef _FILTER_PIPELINE_HPP_
+#define _FILTER_PIPELINE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "fast_array_average.hpp"
+#include "lane_mask.hpp"
+#include "sorting_network.hpp"
+
+
+/*
+A chain of multi-channel filter stages, composed at compile time:
+
+  using Frame = FilterFrame<uint32_t, 15>;
+  FilterPipeline<Frame,
+                 BlockAverageStage<Frame, uint64_t>,
+                 KalmanStage<Frame>,
+                 DeadbandStage<Frame>,
+                 SinkStage<Frame, Publish>> pipeline;
+
+  frame.values[pad] = ...;          // one sample of every channel in 'frame.lanes'.
+  pipeline.process(frame);
+
+ - Every stage works in place on the one frame, there are no copies between the stages.
+ - A stage returns false to end the chain for this frame, e.g. BlockAverageStage until the end of
+   its averaging window. The stages after it then see one frame per window.
+ - The stages are called directly (no virtual functions), so the whole chain can be inlined.
+ - With 'fixed_lanes' the channels are fixed at compile time, and the loops over them are unrolled
+   (see lane_mask.hpp). Otherwise they are the runtime 'lanes' of the frame.
+
+A stage is any class with:
+  bool process(Frame& frame);
+  void reset();                     // forget the history, e.g. when the lanes change.
+
+NOTE:
+ - NOT thread safe.
+ - Change the lanes of a frame only after a reset() of the pipeline.
+*/
+template<class T, std::size_t channels_, LaneMask fixed_lanes_ = 0>
+struct FilterFrame {
+    using ValueType = T;
+    using ValueArrayType = std::array<T, channels_>;
+    static constexpr std::size_t channels = channels_;
+    static constexpr LaneMask fixed_lanes = fixed_lanes_;
+    static_assert(channels <= 32, "LaneMask has 32 lanes.");
+    static_assert((fixed_lanes & ~all_lanes(channels)) == 0, "fixed_lanes has channels that do not exist.");
+
+    ValueArrayType values {};
+    LaneMask lanes = fixed_lanes;   // the channels with a value, ignored if 'fixed_lanes' != 0.
+    LaneMask suppressed = 0;        // set by DeadbandStage, the channels not to pass on to a sink.
+
+    LaneMask get_lanes() const { return fixed_lanes ? fixed_lanes : lanes; }
+
+    template<class Function>
+    void for_each(Function&& function) const {
+        if constexpr (fixed_lanes != 0) {
+            for_each_lane<fixed_lanes>(function);
+        } else {
+            for_each_lane(lanes, function);
+        }
+    }
+};
+
+
+
+template<class Frame, class... Stages>
+class FilterPipeline {
+public:
+    FilterPipeline() = default;
+    explicit FilterPipeline(Stages... stages) : stages(std::move(stages)...) { }
+
+    // Returns true if the frame made it through every stage.
+    bool process(Frame& frame) {
+        frame.suppressed = 0;
+        return process(frame, std::index_sequence_for<Stages...>());
+    }
+
+    void reset() {
+        std::apply([](auto&... stage) { (stage.reset(), ...); }, stages);
+    }
+
+    template<std::size_t index>
+    auto& stage() { return std::get<index>(stages); }
+    template<std::size_t index>
+    const auto& stage() const { return std::get<index>(stages); }
+
+private:
+    std::tuple<Stages...> stages;
+
+    template<std::size_t... indexes>
+    bool process(Frame& frame, std::index_sequence<indexes...>) {
+        // && stops at the first stage that returns false.
+        return (std::get<indexes>(stages).process(frame) && ...);
+    }
+};
+
+
+
+//------------------------------------------------------------------------------
+// Stages
+//------------------------------------------------------------------------------
+// Passes every frame on as is, a placeholder for an optional stage.
+template<class Frame>
+class PassStage {
+public:
+    bool process(Frame&) { return true; }
+    void reset() { }
+};
+
+
+
+/*
+Averages blocks of 2^number_of_bits frames (see fast_array_average.hpp).
+Passes on one frame, of the averages, at the end of each block.
+*/
+template<class Frame, class AccumulatorType>
+class BlockAverageStage {
+public:
+    using Average = FastArrayAverage<typename Frame::ValueType, AccumulatorType, Frame::channels>;
+
+    explicit BlockAverageStage(unsigned number_of_bits = 7) : average(number_of_bits) { }
+
+    void set_number_of_bits(unsigned number_of_bits) { average.set_number_of_bits(number_of_bits); }
+    unsigned get_sample_size() const { return average.sample_size; }
+
+    bool process(Frame& frame) {
+        if constexpr (Frame::fixed_lanes != 0) {
+            average.template add_values<Frame::fixed_lanes>(frame.values);
+        } else {
+            average.add_values(frame.values, frame.lanes);
+        }
+        if (!average.is_average_ready()) {
+            return false;
+        }
+        if constexpr (Frame::fixed_lanes != 0) {
+            average.template get_average_values<Frame::fixed_lanes>(frame.values);
+        } else {
+            average.get_average_values(frame.values, frame.lanes);
+        }
+        return true;
+    }
+
+    void reset() { average.reset(); }
+
+private:
+    Average average;
+};
+
+
+
+/*
+Exponential moving average, with a weight of 1 / 2^shift for the new value.
+Integer only: the state is kept scaled by 2^shift, so there is no rounding drift.
+The first value of a channel is passed on as is.
+*/
+template<class Frame, unsigned shift>
+class EmaStage {
+public:
+    using ValueType = typename Frame::ValueType;
+    using StateType = std::conditional_t<std::is_signed_v<ValueType>, int64_t, uint64_t>;
+    static_assert(std::is_integral_v<ValueType>, "EmaStage is for integer values.");
+
+    bool process(Frame& frame) {
+        frame.for_each([&](unsigned lane) {
+            const StateType value = frame.values[lane];
+            if (!(initialized & (LaneMask(1) << lane))) {
+                initialized |= LaneMask(1) << lane;
+                state[lane] = value << shift;
+            } else {
+                // state = state * (1 - 1/2^shift) + value, scaled by 2^shift.
+                state[lane] += value - (state[lane] >> shift);
+            }
+            frame.values[lane] = static_cast<ValueType>(state[lane] >> shift);
+        });
+        return true;
+    }
+
+    void reset() { initialized = 0; }
+
+private:
+    std::array<StateType, Frame::channels> state {};
+    LaneMask initialized = 0;
+};
+
+
+
+/*
+The last 'window' values of each channel, for the median and trimmed mean stages below.
+Until the window is full (after a reset) these stages pass the values on as is, so an outlier
+ among the first values is not counted more than once.
+*/
+template<class Frame, std::size_t window>
+class SlidingWindow {
+public:
+    using ValueType = typename Frame::ValueType;
+    using WindowArrayType = std::array<ValueType, window>;
+
+    // Returns true if the window is full.
+    bool add(const Frame& frame) {
+        frame.for_each([&](unsigned lane) {
+            history[lane][position] = frame.values[lane];
+        });
+        position = (position + 1 == window) ? 0 : position + 1;
+        if (count < window) {
+            ++count;
+        }
+        return count == window;
+    }
+
+    // In no particular order.
+    const WindowArrayType& get(unsigned lane) const { return history[lane]; }
+
+    void reset() {
+        position = 0;
+        count = 0;
+    }
+
+private:
+    std::array<WindowArrayType, Frame::channels> history {};
+    std::size_t position = 0;
+    std::size_t count = 0;
+};
+
+
+
+/*
+The median of the last 'window' values of each channel (odd, see sorting_network.hpp).
+Drops single impulses (window 3), or up to window / 2 in a row, e.g. before they reach an average.
+*/
+template<class Frame, std::size_t window>
+class MedianStage {
+public:
+    static_assert(window % 2 == 1, "The window must be odd.");
+
+    bool process(Frame& frame) {
+        if (values.add(frame)) {
+            frame.for_each([&](unsigned lane) {
+                frame.values[lane] = median_of(values.get(lane));
+            });
+        }
+        return true;
+    }
+
+    void reset() { values.reset(); }
+
+private:
+    SlidingWindow<Frame, window> values;
+};
+
+
+
+/*
+The mean of the last 'window' values of each channel, without the 'trim' lowest and
+ the 'trim' highest ones (see sorting_network.hpp).
+Smoother than the median, and a window of 5 trimmed by 1 still drops a single impulse.
+*/
+template<class Frame, std::size_t window, std::size_t trim>
+class TrimmedMeanStage {
+public:
+    bool process(Frame& frame) {
+        if (values.add(frame)) {
+            frame.for_each([&](unsigned lane) {
+                frame.values[lane] = trimmed_mean_of<trim>(values.get(lane));
+            });
+        }
+        return true;
+    }
+
+    void reset() { values.reset(); }
+
+private:
+    SlidingWindow<Frame, window> values;
+};
+
+
+
+/*
+A one dimensional Kalman filter per channel, for a value that is constant apart from a random walk:
+ 'measurement_error' is the variance of the measurement noise and 'process_noise' the variance
+ of the random walk per frame. Only their ratio matters for the estimate.
+
+It is the update of KalmanFilter_1D (KalmanFilter_1D.hpp), plus the process noise, without
+ which the gain decays to zero and the estimate stops following the soil.
+The first value of a channel is passed on as is.
+*/
+template<class Frame>
+class KalmanStage {
+public:
+    using ValueType = typename Frame::ValueType;
+
+    explicit KalmanStage(float measurement_error = 1.0f, float process_noise = 0.0625f)
+        : measurement_error(measurement_error), process_noise(process_noise)
+    { }
+
+    bool process(Frame& frame) {
+        frame.for_each([&](unsigned lane) {
+            const float measurement = static_cast<float>(frame.values[lane]);
+            if (!(initialized & (LaneMask(1) << lane))) {
+                initialized |= LaneMask(1) << lane;
+                estimate[lane] = measurement;
+                estimate_error[lane] = measurement_error;
+                return;
+            }
+            const float predicted_error = estimate_error[lane] + process_noise;
+            const float kalman_gain = predicted_error / (predicted_error + measurement_error);
+            estimate[lane] += kalman_gain * (measurement - estimate[lane]);
+            estimate_error[lane] = (1.0f - kalman_gain) * predicted_error;
+            frame.values[lane] = static_cast<ValueType>(estimate[lane] + 0.5f);
+        });
+        return true;
+    }
+
+    void reset() { initialized = 0; }
+
+private:
+    float measurement_error;
+    float process_noise;
+    std::array<float, Frame::channels> estimate {};
+    std::array<float, Frame::channels> estimate_error {};
+    LaneMask initialized = 0;
+};
+
+
+
+/*
+Marks the channels whose value moved by 'deadband' or less, since the last value passed on,
+ as suppressed (see FilterFrame), so a sink skips them.
+The first value of a channel is never suppressed.
+*/
+template<class Frame>
+class DeadbandStage {
+public:
+    using ValueType = typename Frame::ValueType;
+
+    explicit DeadbandStage(uint32_t deadband = 16) : deadband(deadband) { }
+
+    void set_deadband(uint32_t new_deadband) { deadband = new_deadband; }
+
+    bool process(Frame& frame) {
+        frame.for_each([&](unsigned lane) {
+            const ValueType value = frame.values[lane];
+            const ValueType prior_value = passed[lane];
+            const ValueType diff = prior_value > value ? prior_value - value : value - prior_value;
+            const LaneMask bit = LaneMask(1) << lane;
+            if ((initialized & bit) && diff <= deadband) {
+                frame.suppressed |= bit;
+            } else {
+                initialized |= bit;
+                passed[lane] = value;
+            }
+        });
+        return true;
+    }
+
+    void reset() { initialized = 0; }
+
+private:
+    uint32_t deadband;
+    std::array<ValueType, Frame::channels> passed {};
+    LaneMask initialized = 0;
+};
+
+
+
+// Calls 'function(channel, value)' for each channel of the frame that is not suppressed.
+template<class Frame, class Function>
+class SinkStage {
+public:
+    explicit SinkStage(Function function = Function()) : function(std::move(function)) { }
+
+    bool process(Frame& frame) {
+        frame.for_each([&](unsigned lane) {
+            if (!(frame.suppressed & (LaneMask(1) << lane))) {
+                function(lane, frame.values[lane]);
+            }
+        });
+        return true;
+    }
+
+    void reset() { }
+
+private:
+    Function function;
+};
+
+
+
+#endif // _FILTER_PIPELINE_HPP_
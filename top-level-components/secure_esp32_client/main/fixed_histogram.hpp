@@ -0,0 +1,133 @@
+// fixed_histogram.hpp
+
+#ifndef _FIXED_HISTOGRAM_HPP_
+#define _FIXED_HISTOGRAM_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+
+/*
+A fixed size histogram with power-of-two bucket boundaries.
+No memory is allocated and add() is a handful of instructions,
+so it can be used in hot paths (e.g. on every published message).
+
+ bucket   values
+    0       0
+    1       1
+    2       2 ..   3
+    3       4 ..   7
+    4       8 ..  15
+   ...
+   n-1   2^(n-2) .. infinity   (the last bucket also holds all larger values)
+
+The unit of the values (microseconds, milliseconds, ...) is up to the caller.
+
+NOTE:
+ - NOT thread safe. The caller must serialize access if it is shared between Tasks.
+*/
+template<std::size_t bucket_count_>
+class FixedHistogram {
+public:
+    using ValueType = uint32_t;
+    using CountType = uint32_t;
+
+    static const std::size_t bucket_count = bucket_count_;
+    static_assert(bucket_count_ >= 2 && bucket_count_ <= 33, "bucket_count must be in the range [2, 33]");
+
+    // The longest snprint_json() output, without the nul: every bucket in use, and every number 10 digits.
+    static const std::size_t max_json_length = 56 + 11 * bucket_count;
+
+
+    FixedHistogram() {
+        reset();
+    }
+
+
+    void reset() {
+        for (auto &count : buckets) {
+            count = 0;
+        }
+        count = 0;
+        min_value = 0;
+        max_value = 0;
+    }
+
+
+    static std::size_t bucket_index(ValueType value) {
+        if (value == 0) {
+            return 0;
+        }
+        // 1 + floor(log2(value))
+        std::size_t index = 32 - __builtin_clz(value);
+        return index < bucket_count ? index : bucket_count - 1;
+    }
+
+
+    void add(ValueType value) {
+        ++buckets[bucket_index(value)];
+        if (count == 0 || value < min_value) {
+            min_value = value;
+        }
+        if (count == 0 || value > max_value) {
+            max_value = value;
+        }
+        ++count;
+    }
+
+
+    CountType get_count() const { return count; }
+    ValueType get_min() const { return min_value; }
+    ValueType get_max() const { return max_value; }
+    CountType get_bucket(std::size_t index) const { return buckets[index]; }
+
+
+    /*
+    Format as a compact JSON object, e.g. {"n":5,"min":1,"max":9,"b":[0,1,0,3,1]}
+    Trailing empty buckets are not printed.
+    Return value is the same as snprintf(...).
+    */
+    int snprint_json(char *buffer, std::size_t size) const {
+        std::size_t last_bucket = 0;
+        for (std::size_t index = 0; index < bucket_count; ++index) {
+            if (buckets[index] != 0) {
+                last_bucket = index + 1;
+            }
+        }
+
+        int total = 0;
+        auto append = [&](int num_of_characters) {
+            if (num_of_characters < 0) {
+                total = -1;
+            } else if (total >= 0) {
+                total += num_of_characters;
+            }
+        };
+        auto remaining = [&]() -> std::size_t {
+            return (total >= 0 && static_cast<std::size_t>(total) < size) ? size - total : 0;
+        };
+        auto position = [&]() -> char * {
+            return remaining() ? buffer + total : nullptr;
+        };
+
+        append(std::snprintf(position(), remaining(), "{\"n\":%lu,\"min\":%lu,\"max\":%lu,\"b\":[",
+                             (unsigned long)count, (unsigned long)min_value, (unsigned long)max_value));
+        for (std::size_t index = 0; index < last_bucket; ++index) {
+            append(std::snprintf(position(), remaining(), index ? ",%lu" : "%lu", (unsigned long)buckets[index]));
+        }
+        append(std::snprintf(position(), remaining(), "]}"));
+        return total;
+    }
+
+
+private:
+    std::array<CountType, bucket_count> buckets;
+    CountType count;
+    ValueType min_value, max_value;
+};
+
+
+
+#endif // _FIXED_HISTOGRAM_HPP_
@@ -0,0 +1,212 @@
+// flat_string_map.hpp
+
+#ifndef _FLAT_STRING_MAP_HPP_
+#define _FLAT_STRING_MAP_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+
+/*
+A fixed capacity, sorted, string to string map that never allocates.
+
+All keys and values are copied (null terminated) into one inline arena,
+and the items are a sorted small-vector of offsets into that arena.
+Because only offsets are stored, copying or moving a map is a plain copy of
+the used part of its storage, and no pointers need to be fixed up.
+
+ - Lookups are a binary search over at most 'max_items' items.
+ - If a key is inserted more than once then the last value is kept.
+ - Keys or values that don't fit in the remaining capacity are rejected.
+ - The views handed out stay valid until the map is modified, moved or destroyed.
+
+NOTE:
+ - NOT thread safe.
+ - max_items and arena_size must each fit in 16 bits.
+*/
+template<std::size_t max_items_, std::size_t arena_size_>
+class FlatStringMap {
+public:
+    using size_type = std::size_t;
+    using value_type = std::pair<std::string_view, std::string_view>;
+
+    static const size_type max_items = max_items_;
+    static const size_type arena_size = arena_size_;
+    static_assert(max_items_ > 0 && max_items_ <= UINT16_MAX, "max_items must fit in 16 bits");
+    static_assert(arena_size_ > 0 && arena_size_ <= UINT16_MAX, "arena_size must fit in 16 bits");
+
+
+    class const_iterator {
+    public:
+        const_iterator(const FlatStringMap *map, size_type index) : map(map), index(index) { }
+
+        value_type operator*() const { return map->item_at(index); }
+        const_iterator& operator++() { ++index; return *this; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+
+    private:
+        const FlatStringMap *map;
+        size_type index;
+    };
+
+
+    FlatStringMap() { }
+
+    FlatStringMap(const FlatStringMap& other) {
+        copy_from(other);
+    }
+
+    FlatStringMap(FlatStringMap&& other) noexcept {
+        copy_from(other);
+        other.clear();
+    }
+
+    FlatStringMap& operator=(const FlatStringMap& other) {
+        if (this != &other) {
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    FlatStringMap& operator=(FlatStringMap&& other) noexcept {
+        if (this != &other) {
+            copy_from(other);
+            other.clear();
+        }
+        return *this;
+    }
+
+
+    void clear() {
+        item_count = 0;
+        arena_used = 0;
+    }
+
+    size_type size() const { return item_count; }
+    bool empty() const { return item_count == 0; }
+    size_type arena_bytes_used() const { return arena_used; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, item_count); }
+
+
+    /*
+    Insert 'key' and 'value', or replace the value if 'key' already exists.
+    Returns false if there is not enough capacity left (the map is unchanged).
+    */
+    bool insert_or_assign(std::string_view key, std::string_view value) {
+        size_type index = lower_bound(key);
+        const bool key_exists = index < item_count && key_at(index) == key;
+
+        const size_type required = (key_exists ? 0 : key.size() + 1) + value.size() + 1;
+        if (arena_used + required > arena_size || (!key_exists && item_count >= max_items)) {
+            return false;
+        }
+
+        if (!key_exists) {
+            // Make room for the new item, keeping the items sorted.
+            for (size_type ndx = item_count; ndx > index; --ndx) {
+                items[ndx] = items[ndx - 1];
+            }
+            ++item_count;
+            items[index].key_offset = append(key);
+            items[index].key_length = static_cast<uint16_t>(key.size());
+        }
+
+        // A replaced value's old bytes are simply left unused in the arena.
+        items[index].value_offset = append(value);
+        items[index].value_length = static_cast<uint16_t>(value.size());
+        return true;
+    }
+
+
+    const_iterator find(std::string_view key) const {
+        size_type index = lower_bound(key);
+        if (index < item_count && key_at(index) == key) {
+            return const_iterator(this, index);
+        }
+        return end();
+    }
+
+
+    bool exists(std::string_view key) const {
+        return find(key) != end();
+    }
+
+
+    // Returns an empty view if 'key' does not exist.
+    std::string_view get(std::string_view key) const {
+        size_type index = lower_bound(key);
+        if (index < item_count && key_at(index) == key) {
+            return value_at(index);
+        }
+        return std::string_view();
+    }
+
+
+private:
+    struct Item {
+        uint16_t key_offset, key_length;
+        uint16_t value_offset, value_length;
+    };
+
+    std::array<Item, max_items> items;
+    std::array<char, arena_size> arena;
+    size_type item_count = 0;
+    size_type arena_used = 0;
+
+
+    void copy_from(const FlatStringMap& other) {
+        item_count = other.item_count;
+        arena_used = other.arena_used;
+        std::copy_n(other.items.begin(), item_count, items.begin());
+        std::copy_n(other.arena.begin(), arena_used, arena.begin());
+    }
+
+
+    // Copy 'str' and a null terminator into the arena and return its offset.
+    uint16_t append(std::string_view str) {
+        const size_type offset = arena_used;
+        std::memcpy(&arena[offset], str.data(), str.size());
+        arena[offset + str.size()] = '\0';
+        arena_used += str.size() + 1;
+        return static_cast<uint16_t>(offset);
+    }
+
+
+    std::string_view key_at(size_type index) const {
+        return std::string_view(&arena[items[index].key_offset], items[index].key_length);
+    }
+
+    std::string_view value_at(size_type index) const {
+        return std::string_view(&arena[items[index].value_offset], items[index].value_length);
+    }
+
+    value_type item_at(size_type index) const {
+        return value_type(key_at(index), value_at(index));
+    }
+
+
+    size_type lower_bound(std::string_view key) const {
+        size_type low = 0, high = item_count;
+        while (low < high) {
+            size_type mid = (low + high) / 2;
+            if (key_at(mid) < key) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+};
+
+
+
+#endif // _FLAT_STRING_MAP_HPP_
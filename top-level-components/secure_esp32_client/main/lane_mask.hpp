@@ -0,0 +1,51 @@
+// lane_mask.hpp
+
+#ifndef _LANE_MASK_HPP_
+#define _LANE_MASK_HPP_
+
+#include <cstdint>
+#include <type_traits>
+
+
+/*
+A set of array lanes (e.g. touch pads), bit n for lane n.
+
+for_each_lane() visits only the set bits, lowest first, with count trailing zeros:
+ the cost is one iteration per set lane instead of one test and branch per lane.
+for_each_lane<mask>() does the same for a mask known at compile time, unrolled:
+ one call per set lane, with the lane as a constant.
+*/
+using LaneMask = uint32_t;
+
+
+template<class Function>
+inline void for_each_lane(LaneMask mask, Function&& function)
+{
+    while (mask) {
+        const unsigned lane = __builtin_ctz(mask);
+        mask &= mask - 1;  // clear the lowest set bit.
+        function(lane);
+    }
+}
+
+
+// 'function' is called with a std::integral_constant<unsigned, lane>, which converts to unsigned.
+template<LaneMask mask, class Function>
+inline void for_each_lane(Function&& function)
+{
+    if constexpr (mask != 0) {
+        function(std::integral_constant<unsigned, __builtin_ctz(mask)>());
+        for_each_lane<mask & (mask - 1)>(function);
+    }
+}
+
+
+// The lanes 0 to 'lane_count' - 1.
+constexpr LaneMask all_lanes(unsigned lane_count)
+{
+    return lane_count >= 32 ? ~LaneMask(0) : (LaneMask(1) << lane_count) - 1;
+}
+
+
+
+#endif // _LANE_MASK_HPP_
@@ -0,0 +1,127 @@
+// latest_value_slots.hpp
+
+#ifndef _LATEST_VALUE_SLOTS_HPP_
+#define _LATEST_VALUE_SLOTS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+A fixed size set of "pending latest value" slots, one per channel (e.g. per touch pad).
+
+While a downstream consumer (e.g. the MQTT outbox) is saturated, new values are
+stored here instead of being dropped. A newer value for the same channel simply
+overwrites (coalesces) the older pending value, so memory is bounded to one
+value per channel and stale values are never sent.
+
+When the consumer has capacity again, drain() hands the pending values back,
+most recently stored first.
+
+NOTE:
+ - NOT thread safe. All calls must be made from the same Task.
+ - <T> must be copy assignable and default constructible.
+*/
+template<class T, std::size_t n>
+class LatestValueSlots {
+public:
+    using ValueType = T;
+    static const std::size_t slot_count = n;
+
+    LatestValueSlots() {
+        clear();
+    }
+
+
+    void clear() {
+        for (auto &slot : slots) {
+            slot.is_pending = false;
+        }
+        pending_count = 0;
+    }
+
+
+    // Store 'value' as the latest pending value of slot 'index'.
+    // Returns true if an older pending value was overwritten (coalesced).
+    bool store(std::size_t index, const T& value) {
+        if (index >= n) {
+            return false;
+        }
+
+        Slot &slot = slots[index];
+        const bool coalesced = slot.is_pending;
+        slot.value = value;
+        slot.stored_order = ++store_counter;
+        if (!coalesced) {
+            slot.is_pending = true;
+            ++pending_count;
+        }
+        return coalesced;
+    }
+
+
+    bool is_pending(std::size_t index) const {
+        return index < n && slots[index].is_pending;
+    }
+
+
+    bool has_pending() const {
+        return pending_count != 0;
+    }
+
+
+    std::size_t get_pending_count() const {
+        return pending_count;
+    }
+
+
+    /*
+    Call 'send(index, value)' for each pending slot, most recently stored first.
+    'send' must return true if the value was accepted, or false if the consumer
+    is (still) saturated; in which case draining stops and the remaining values
+    stay pending.
+    Returns the number of values sent.
+    */
+    template<class SendFunction>
+    std::size_t drain(SendFunction send) {
+        std::size_t sent_count = 0;
+
+        while (pending_count > 0) {
+            std::size_t newest_index = n;
+            for (std::size_t index = 0; index < n; ++index) {
+                if (slots[index].is_pending &&
+                    (newest_index == n || slots[index].stored_order > slots[newest_index].stored_order))
+                {
+                    newest_index = index;
+                }
+            }
+
+            if (!send(newest_index, static_cast<const T&>(slots[newest_index].value))) {
+                break;
+            }
+
+            slots[newest_index].is_pending = false;
+            --pending_count;
+            ++sent_count;
+        }
+
+        return sent_count;
+    }
+
+
+private:
+    struct Slot {
+        T value;
+        uint32_t stored_order = 0;
+        bool is_pending = false;
+    };
+
+    std::array<Slot, n> slots;
+    std::size_t pending_count = 0;
+    uint32_t store_counter = 0;
+};
+
+
+
+#endif // _LATEST_VALUE_SLOTS_HPP_
@@ -0,0 +1,67 @@
+// retained_object.hpp
+
+#ifndef _RETAINED_OBJECT_HPP_
+#define _RETAINED_OBJECT_HPP_
+
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+/*
+An object that lives in memory retained across deep sleep (i.e. RTC_DATA_ATTR), constructed on
+ a cold start and carried on as is after a wake-up:
+
+  RTC_DATA_ATTR static RetainedObject<Pipeline> retained;      // zero at power-on.
+  const bool is_resumed = retained.resume_or_construct(is_wake_up, constructor arguments...);
+  Pipeline& pipeline = retained.get();
+
+ - A plain RTC_DATA_ATTR object with a constructor is constructed again by the C++ start-up code
+   of every boot, which wipes out what it kept. RetainedObject has no constructor of its own:
+   it is only raw storage until resume_or_construct() constructs the object in place.
+ - A resume needs an object constructed since power-on: the storage carries a tag (of the type's
+   size), so zeroed or foreign storage is a cold start.
+
+NOTE:
+ - 'T' must not hold pointers to (or handles of) anything outside the object, they do not survive
+   deep sleep. Nor should the caller keep pointers into it across a resume_or_construct().
+ - 'T' is never destroyed.
+ - NOT thread safe.
+*/
+template<class T>
+class RetainedObject {
+public:
+    static_assert(std::is_trivially_destructible_v<T>, "A retained object is never destroyed.");
+
+    // Returns true if the object was resumed, false if a new one was constructed from 'args'.
+    template<class... Args>
+    bool resume_or_construct(bool resume, Args&&... args) {
+        if (resume && is_constructed()) {
+            return true;
+        }
+        tag = 0;
+        new (storage) T(std::forward<Args>(args)...);
+        tag = TAG;
+        return false;
+    }
+
+    bool is_constructed() const { return tag == TAG; }
+
+    // Only valid once constructed.
+    T& get() { return *std::launder(reinterpret_cast<T *>(storage)); }
+    const T& get() const { return *std::launder(reinterpret_cast<const T *>(storage)); }
+
+    // The next resume_or_construct() constructs a new object.
+    void invalidate() { tag = 0; }
+
+private:
+    static constexpr uint32_t TAG = 0x52540000u ^ static_cast<uint32_t>(sizeof(T));    // "RT"
+
+    alignas(T) unsigned char storage[sizeof(T)];
+    uint32_t tag;
+};
+
+
+
+#endif // _RETAINED_OBJECT_HPP_
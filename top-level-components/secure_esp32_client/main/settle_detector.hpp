@@ -0,0 +1,72 @@
+// settle_detector.hpp
+
+#ifndef _SETTLE_DETECTOR_HPP_
+#define _SETTLE_DETECTOR_HPP_
+
+#include <cstdint>
+
+
+/*
+Whether each of 'N' readings (e.g. the filtered value of each touch pad) has settled after start-up,
+ so the caller can carry on as soon as they are ready instead of after a fixed delay:
+
+  SettleDetector<uint32_t, TOUCH_PAD_MAX> settle(tolerance, settled_reads);
+  while (... not all settled, and before the upper bound ...) {
+      ... wait one read period ...
+      settle.add(ndx, read(ndx));                  // for each reading in use.
+      ... settle.is_settled(ndx) ...
+  }
+
+ - A reading has settled once 'settled_reads' consecutive reads stay within 'tolerance' of the read
+   before them that started the run. A read beyond it starts a new run, so a slow drift never settles.
+ - A read of 0 (i.e. no measurement yet) does not start a run.
+
+NOTE:
+ - NOT thread safe. The caller must serialize access if it is shared between Tasks.
+*/
+template<class T, unsigned N>
+class SettleDetector {
+public:
+    SettleDetector(T tolerance, uint32_t settled_reads)
+        : tolerance(tolerance), settled_reads(settled_reads > 0 ? settled_reads : 1) { }
+
+
+    void add(unsigned index, T value) {
+        Run& run = runs[index];
+        if (value == 0) {
+            run.count = 0;
+            return;
+        }
+        const T diff = value > run.first ? value - run.first : run.first - value;
+        if (run.count == 0 || diff > tolerance) {
+            run.first = value;
+            run.count = 1;
+        } else if (run.count <= settled_reads) {
+            ++run.count;
+        }
+    }
+
+    // The run counts its first read, which is not one of the 'settled_reads'.
+    bool is_settled(unsigned index) const { return runs[index].count > settled_reads; }
+
+    void reset() {
+        for (Run& run : runs) {
+            run.count = 0;
+        }
+    }
+
+
+private:
+    struct Run {
+        T first = 0;
+        uint32_t count = 0;
+    };
+
+    T tolerance;
+    uint32_t settled_reads;
+    Run runs[N];
+};
+
+
+
+#endif // _SETTLE_DETECTOR_HPP_
@@ -0,0 +1,128 @@
+// sorting_network.hpp
+
+#ifndef _SORTING_NETWORK_HPP_
+#define _SORTING_NETWORK_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+
+/*
+Branch-free sorts of small fixed-size arrays, with sorting networks:
+ a fixed sequence of compare-exchanges, each one a compare and a masked swap. So the time is
+ the same for any values, and there are no mispredicted branches on noisy data.
+
+  std::array<uint32_t, 5> values = ...;
+  sort_network(values);                   // sorted, in place.
+  uint32_t median = median_of(values);    // sorts a copy.
+  uint32_t mean = trimmed_mean_of<1>(values); // the mean without the lowest and the highest value.
+
+There are networks for 1 to 7 values, the smallest known ones (for 2 to 7 values: 1, 3, 5, 9, 12
+ and 16 compare-exchanges).
+*/
+template<std::size_t size> struct SortingNetwork;
+
+template<> struct SortingNetwork<1> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 0> pairs {};
+};
+
+template<> struct SortingNetwork<2> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 1> pairs {{
+        {0, 1},
+    }};
+};
+
+template<> struct SortingNetwork<3> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 3> pairs {{
+        {0, 2}, {0, 1}, {1, 2},
+    }};
+};
+
+template<> struct SortingNetwork<4> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 5> pairs {{
+        {0, 1}, {2, 3}, {0, 2}, {1, 3}, {1, 2},
+    }};
+};
+
+template<> struct SortingNetwork<5> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 9> pairs {{
+        {0, 1}, {3, 4}, {2, 4}, {2, 3}, {0, 3}, {0, 2}, {1, 4}, {1, 3}, {1, 2},
+    }};
+};
+
+template<> struct SortingNetwork<6> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 12> pairs {{
+        {0, 5}, {1, 3}, {2, 4}, {1, 2}, {3, 4}, {0, 3}, {2, 5}, {0, 1}, {2, 3}, {4, 5}, {1, 2}, {3, 4},
+    }};
+};
+
+template<> struct SortingNetwork<7> {
+    static constexpr std::array<std::pair<uint8_t, uint8_t>, 16> pairs {{
+        {1, 2}, {3, 4}, {5, 6}, {0, 2}, {3, 5}, {4, 6}, {0, 1}, {4, 5},
+        {2, 6}, {0, 4}, {1, 5}, {0, 3}, {2, 5}, {1, 3}, {2, 4}, {2, 3},
+    }};
+};
+
+
+/*
+Swaps 'low' and 'high' if they are out of order.
+NOTE: not std::min() and std::max(): GCC turns that pair back into a branch around a swap.
+*/
+template<class T>
+inline void compare_exchange(T& low, T& high)
+{
+    static_assert(std::is_integral_v<T>, "The masked swap is for integer values.");
+    using Bits = std::make_unsigned_t<T>;
+    const T a = low;
+    const T b = high;
+    const Bits mask = Bits(0) - Bits(b < a);    // all ones to swap.
+    const Bits diff = (Bits(a) ^ Bits(b)) & mask;
+    low = T(Bits(a) ^ diff);
+    high = T(Bits(b) ^ diff);
+}
+
+
+template<class T, std::size_t size, std::size_t... indexes>
+inline void sort_network(std::array<T, size>& values, std::index_sequence<indexes...>)
+{
+    constexpr auto& pairs = SortingNetwork<size>::pairs;
+    (compare_exchange(values[pairs[indexes].first], values[pairs[indexes].second]), ...);
+}
+
+template<class T, std::size_t size>
+inline void sort_network(std::array<T, size>& values)
+{
+    sort_network(values, std::make_index_sequence<SortingNetwork<size>::pairs.size()>());
+}
+
+
+template<class T, std::size_t size>
+inline T median_of(std::array<T, size> values)
+{
+    static_assert(size % 2 == 1, "The median of an even number of values is not one of them.");
+    sort_network(values);
+    return values[size / 2];
+}
+
+
+// The mean of the values without the 'trim' lowest and the 'trim' highest ones, rounded toward zero.
+template<std::size_t trim, class T, std::size_t size>
+inline T trimmed_mean_of(std::array<T, size> values)
+{
+    static_assert(2 * trim < size, "Nothing is left after trimming.");
+    using SumType = std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>;
+    sort_network(values);
+    SumType sum = 0;
+    for (std::size_t index = trim; index < size - trim; ++index) {
+        sum += values[index];
+    }
+    // A constant divisor, so a multiply.
+    return static_cast<T>(sum / SumType(size - 2 * trim));
+}
+
+
+
+#endif // _SORTING_NETWORK_HPP_
@@ -0,0 +1,110 @@
+// tick_timing.hpp
+
+#ifndef _TICK_TIMING_HPP_
+#define _TICK_TIMING_HPP_
+
+#include <cstdint>
+
+
+/*
+The timing of a periodic tick as its handler sees it, driven by a caller supplied clock
+ (e.g. esp_timer_get_time()):
+
+  Tick tick = timing.tick(scheduled_time, now);   // on each wake-up of the handler.
+  ... tick.wake_latency, tick.skipped ...
+  timing.get_span()                                // at the end of a window of ticks.
+  timing.start_window();
+
+ - wake_latency is how late the handler woke, after the time the tick was scheduled for.
+ - skipped is the number of scheduled ticks that never reached the handler since the previous
+   one, whether the timer skipped them or they were dropped on the way (e.g. a notification
+   that was still pending).
+ - The span of a window is the time from its first to its last wake-up, plus one period,
+   i.e. the time the window covers with each tick standing for one period.
+
+When the scheduled time is not known (e.g. a driver callback), tick(now) takes the previous
+ wake-up plus the nearest whole number of periods, so wake_latency is the lateness of each
+ interval instead.
+
+NOTE:
+ - NOT thread safe. The caller must serialize access if it is shared between Tasks.
+ - Call restart() whenever the tick is restarted (e.g. stopped and started again), so the gap is not
+   counted as skipped ticks.
+*/
+class TickTiming {
+public:
+    using TimeType = int64_t;
+
+    struct Tick {
+        uint32_t wake_latency;
+        uint32_t skipped;
+    };
+
+    explicit TickTiming(TimeType period) { set_period(period); }
+
+    void set_period(TimeType new_period) { period = new_period > 0 ? new_period : 1; }
+    TimeType get_period() const { return period; }
+
+
+    Tick tick(TimeType scheduled_time, TimeType now) {
+        const TimeType periods = has_previous ? periods_between(previous_scheduled_time, scheduled_time) : 1;
+        return record(scheduled_time, now, periods);
+    }
+
+    Tick tick(TimeType now) {
+        if (!has_previous) {
+            return record(now, now, 1);
+        }
+        const TimeType periods = periods_between(previous_time, now);
+        return record(previous_time + periods * period, now, periods);
+    }
+
+
+    // The number of ticks in the current window.
+    uint32_t get_window_count() const { return window_count; }
+
+    // 0 if the window has no ticks.
+    TimeType get_span() const { return window_count ? window_end - window_start + period : 0; }
+
+    void start_window() { window_count = 0; }
+
+    // The next tick is the first one, and starts a window.
+    void restart() {
+        has_previous = false;
+        start_window();
+    }
+
+
+private:
+    // Rounded, so that jitter alone never counts as a skipped tick. At least 1.
+    TimeType periods_between(TimeType from, TimeType to) const {
+        const TimeType periods = (to - from + period / 2) / period;
+        return periods > 1 ? periods : 1;
+    }
+
+    Tick record(TimeType scheduled_time, TimeType now, TimeType periods) {
+        Tick result;
+        result.wake_latency = static_cast<uint32_t>(now > scheduled_time ? now - scheduled_time : 0);
+        result.skipped = static_cast<uint32_t>(periods - 1);
+        if (window_count++ == 0) {
+            window_start = now;
+        }
+        window_end = now;
+        previous_scheduled_time = scheduled_time;
+        previous_time = now;
+        has_previous = true;
+        return result;
+    }
+
+    TimeType period = 1;
+    TimeType previous_scheduled_time = 0;
+    TimeType previous_time = 0;
+    bool has_previous = false;
+    uint32_t window_count = 0;
+    TimeType window_start = 0;
+    TimeType window_end = 0;
+};
+
+
+
+#endif // _TICK_TIMING_HPP_
@@ -0,0 +1,91 @@
+// token_bucket.hpp
+
+#ifndef _TOKEN_BUCKET_HPP_
+#define _TOKEN_BUCKET_HPP_
+
+#include <cstdint>
+
+
+/*
+A token bucket rate limiter driven by a caller supplied clock (e.g. esp_timer_get_time()).
+
+The bucket holds at most 'capacity' tokens and gains one token every 'refill_period'.
+try_take() spends a token if there is one, so at most 'capacity' requests are
+allowed in a burst, and after that one request per 'refill_period'.
+
+The bucket starts full. Only integer arithmetic is used, and the remainder of a
+partial refill period is carried over so no time is lost between calls.
+
+NOTE:
+ - NOT thread safe. The caller must serialize access if it is shared between Tasks.
+ - 'now' must never go backwards.
+*/
+class TokenBucket {
+public:
+    using TimeType = int64_t;
+
+    TokenBucket(uint32_t capacity, TimeType refill_period)
+        : capacity(capacity), refill_period(refill_period > 0 ? refill_period : 1), tokens(capacity)
+    { }
+
+
+    bool try_take(TimeType now) {
+        refill(now);
+        if (tokens == 0) {
+            return false;
+        }
+        --tokens;
+        return true;
+    }
+
+
+    uint32_t get_tokens(TimeType now) {
+        refill(now);
+        return tokens;
+    }
+
+
+    // Time until the next token is available, 0 if one is available now.
+    TimeType get_wait_time(TimeType now) {
+        refill(now);
+        return tokens ? 0 : last_refill + refill_period - now;
+    }
+
+
+private:
+    uint32_t capacity;
+    TimeType refill_period;
+    uint32_t tokens;
+    TimeType last_refill = 0;
+    bool is_started = false;
+
+
+    void refill(TimeType now) {
+        if (!is_started) {
+            is_started = true;
+            last_refill = now;
+            return;
+        }
+        if (tokens >= capacity) {
+            // Full buckets don't bank time.
+            last_refill = now;
+            return;
+        }
+
+        const TimeType periods = (now - last_refill) / refill_period;
+        if (periods <= 0) {
+            return;
+        }
+        if (periods >= static_cast<TimeType>(capacity - tokens)) {
+            tokens = capacity;
+            last_refill = now;
+        } else {
+            tokens += static_cast<uint32_t>(periods);
+            last_refill += periods * refill_period;
+        }
+    }
+};
+
+
+
+#endif // _TOKEN_BUCKET_HPP_
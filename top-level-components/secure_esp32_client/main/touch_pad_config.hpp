@@ -0,0 +1,271 @@
+// touch_pad_config.hpp
+
+#ifndef _TOUCH_PAD_CONFIG_HPP_
+#define _TOUCH_PAD_CONFIG_HPP_
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+
+enum class TouchPublishMode : uint8_t {
+    changed = 0, // publish a pad's value only when it moved more than 'deadband'.
+    always = 1,  // publish every pad's value at the end of every averaging window.
+};
+
+
+/*
+A validated snapshot of the runtime tunable touch pad settings.
+
+It is received as MQTT5 user properties on the subscribed topics:
+  soilmoisture/<device-id>/touchpad/config        (all keys below)
+  soilmoisture/<device-id>/touchpad/<n>/config    (key "active" = 0 or 1, for touch pad <n> only)
+
+ key                      value
+ active_pads              bitmask of active touch pads, decimal or 0x... hex (bit 0 is never active)
+ average_bits             the averaging window is 2^average_bits samples
+ long_sample_period       seconds between the starts of two averaging windows, while the values change
+ max_long_sample_period   the longest period, backed off to while the values are stable (see adaptive_period.hpp),
+                            equal to long_sample_period for a fixed period
+ deadband                 minimum change of an averaged value before it is published
+ publish_mode             "changed" or "always"
+*/
+struct TouchPadConfig {
+    static const unsigned MAX_AVERAGE_BITS = 10;
+    // The averaging window is 1 second long, so the period must be longer than that.
+    static const uint32_t MIN_LONG_SAMPLE_PERIOD_SEC = 2;
+    static const uint32_t MAX_LONG_SAMPLE_PERIOD_SEC = 24 * 60 * 60;
+    static const uint32_t MAX_DEADBAND = 0xffff;
+
+    uint16_t active_pads = 0;
+    uint8_t average_bits = 7; // 2^7 = 128 samples
+    uint32_t long_sample_period_sec = 60;
+    uint32_t max_long_sample_period_sec = 900;
+    uint32_t deadband = 16;
+    TouchPublishMode publish_mode = TouchPublishMode::changed;
+
+
+    bool is_active(unsigned touch_pad_num) const {
+        return touch_pad_num < 16 && (active_pads & (1u << touch_pad_num));
+    }
+
+    void set_active(unsigned touch_pad_num, bool active) {
+        if (active) {
+            active_pads |= (1u << touch_pad_num);
+        } else {
+            active_pads &= ~(1u << touch_pad_num);
+        }
+    }
+
+
+    // 'touch_pad_max' is the number of touch pads of the chip (i.e. TOUCH_PAD_MAX).
+    // Returns nullptr if valid, otherwise a description of the problem.
+    const char *validate(unsigned touch_pad_max) const {
+        const uint32_t valid_pads = ((touch_pad_max >= 16) ? 0xffffu : ((1u << touch_pad_max) - 1)) & ~1u;
+        if (active_pads & ~valid_pads) {
+            return "active_pads contains touch pads that do not exist";
+        }
+        if (average_bits > MAX_AVERAGE_BITS) {
+            return "average_bits out of range";
+        }
+        if (long_sample_period_sec < MIN_LONG_SAMPLE_PERIOD_SEC || long_sample_period_sec > MAX_LONG_SAMPLE_PERIOD_SEC) {
+            return "long_sample_period out of range";
+        }
+        if (max_long_sample_period_sec < long_sample_period_sec || max_long_sample_period_sec > MAX_LONG_SAMPLE_PERIOD_SEC) {
+            return "max_long_sample_period out of range";
+        }
+        if (deadband > MAX_DEADBAND) {
+            return "deadband out of range";
+        }
+        if (publish_mode != TouchPublishMode::changed && publish_mode != TouchPublishMode::always) {
+            return "publish_mode is unknown";
+        }
+        return nullptr;
+    }
+
+
+    bool operator==(const TouchPadConfig& other) const {
+        return active_pads == other.active_pads
+            && average_bits == other.average_bits
+            && long_sample_period_sec == other.long_sample_period_sec
+            && max_long_sample_period_sec == other.max_long_sample_period_sec
+            && deadband == other.deadband
+            && publish_mode == other.publish_mode;
+    }
+
+    bool operator!=(const TouchPadConfig& other) const {
+        return !(*this == other);
+    }
+};
+
+
+
+// Parse an unsigned decimal, or 0x... hexadecimal, number. The whole string must be used.
+template<class T>
+bool parse_config_number(std::string_view str, T& result)
+{
+    int base = 10;
+    if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str.remove_prefix(2);
+        base = 16;
+    }
+    T value = 0;
+    auto [end, err] = std::from_chars(str.data(), str.data() + str.size(), value, base);
+    if (err != std::errc() || end != str.data() + str.size() || str.empty()) {
+        return false;
+    }
+    result = value;
+    return true;
+}
+
+
+
+/*
+Apply the user properties of a ".../touchpad/config" message to 'config'.
+Keys that are not present keep their current value.
+'properties' must provide std::string_view get(std::string_view key), returning an empty view if missing.
+Returns nullptr on success, otherwise a description of the problem and 'config' is unchanged.
+*/
+template<class Properties>
+const char *apply_touch_pad_config(TouchPadConfig& config, const Properties& properties, unsigned touch_pad_max)
+{
+    TouchPadConfig updated = config;
+    std::string_view value;
+
+    if (!(value = properties.get("active_pads")).empty() && !parse_config_number(value, updated.active_pads)) {
+        return "active_pads is not a number";
+    }
+    if (!(value = properties.get("average_bits")).empty() && !parse_config_number(value, updated.average_bits)) {
+        return "average_bits is not a number";
+    }
+    if (!(value = properties.get("long_sample_period")).empty() && !parse_config_number(value, updated.long_sample_period_sec)) {
+        return "long_sample_period is not a number";
+    }
+    if (!(value = properties.get("max_long_sample_period")).empty()) {
+        if (!parse_config_number(value, updated.max_long_sample_period_sec)) {
+            return "max_long_sample_period is not a number";
+        }
+    } else if (updated.max_long_sample_period_sec < updated.long_sample_period_sec) {
+        // A longer long_sample_period on its own raises the maximum with it.
+        updated.max_long_sample_period_sec = updated.long_sample_period_sec;
+    }
+    if (!(value = properties.get("deadband")).empty() && !parse_config_number(value, updated.deadband)) {
+        return "deadband is not a number";
+    }
+    if (!(value = properties.get("publish_mode")).empty()) {
+        if (value == "changed") {
+            updated.publish_mode = TouchPublishMode::changed;
+        } else if (value == "always") {
+            updated.publish_mode = TouchPublishMode::always;
+        } else {
+            return "publish_mode must be 'changed' or 'always'";
+        }
+    }
+
+    const char *error = updated.validate(touch_pad_max);
+    if (!error) {
+        config = updated;
+    }
+    return error;
+}
+
+
+/*
+Apply the user properties of a ".../touchpad/<n>/config" message to 'config'.
+Returns nullptr on success, otherwise a description of the problem and 'config' is unchanged.
+*/
+template<class Properties>
+const char *apply_touch_pad_channel_config(TouchPadConfig& config, unsigned touch_pad_num,
+                                           const Properties& properties, unsigned touch_pad_max)
+{
+    TouchPadConfig updated = config;
+    std::string_view value;
+    unsigned active;
+
+    if (!(value = properties.get("active")).empty()) {
+        if (!parse_config_number(value, active) || active > 1) {
+            return "active must be 0 or 1";
+        }
+        if (touch_pad_num == 0 || touch_pad_num >= touch_pad_max || touch_pad_num >= 16) {
+            return "touch pad does not exist";
+        }
+        updated.set_active(touch_pad_num, active);
+    }
+
+    const char *error = updated.validate(touch_pad_max);
+    if (!error) {
+        config = updated;
+    }
+    return error;
+}
+
+
+
+/*
+Return the part of 'topic' after "soilmoisture/<device-id>/", or an empty view if it doesn't match.
+The <device-id> is not checked, the subscriptions already took care of that.
+*/
+inline std::string_view get_device_subtopic(std::string_view topic)
+{
+    const std::string_view prefix("soilmoisture/");
+    if (topic.substr(0, prefix.size()) != prefix) {
+        return std::string_view();
+    }
+    topic.remove_prefix(prefix.size());
+
+    // Skip the <device-id>.
+    auto slash = topic.find('/');
+    if (slash == std::string_view::npos || slash == 0) {
+        return std::string_view();
+    }
+    topic.remove_prefix(slash + 1);
+    return topic;
+}
+
+
+// soilmoisture/<device-id>/touchpad/update
+//  requests an immediate sampling window and a publish of every active touch pad.
+constexpr std::string_view TOUCH_UPDATE_SUBTOPIC("touchpad/update");
+
+
+enum {
+    TOUCH_CONFIG_TOPIC_NONE = -2,      // not a touch pad config topic.
+    TOUCH_CONFIG_TOPIC_ALL_PADS = -1,  // soilmoisture/<device-id>/touchpad/config
+};
+
+/*
+Given an MQTT topic return:
+  TOUCH_CONFIG_TOPIC_ALL_PADS   for soilmoisture/<device-id>/touchpad/config
+  <n>                           for soilmoisture/<device-id>/touchpad/<n>/config
+  TOUCH_CONFIG_TOPIC_NONE       for anything else.
+*/
+inline int parse_touch_config_topic(std::string_view topic)
+{
+    topic = get_device_subtopic(topic);
+    if (topic.empty()) {
+        return TOUCH_CONFIG_TOPIC_NONE;
+    }
+
+    if (topic == "touchpad/config") {
+        return TOUCH_CONFIG_TOPIC_ALL_PADS;
+    }
+
+    const std::string_view touchpad("touchpad/"), config("/config");
+    if (topic.size() <= touchpad.size() + config.size()
+        || topic.substr(0, touchpad.size()) != touchpad
+        || topic.substr(topic.size() - config.size()) != config)
+    {
+        return TOUCH_CONFIG_TOPIC_NONE;
+    }
+    topic = topic.substr(touchpad.size(), topic.size() - touchpad.size() - config.size());
+
+    unsigned touch_pad_num;
+    if (topic.size() > 3 || !parse_config_number(topic, touch_pad_num)) {
+        return TOUCH_CONFIG_TOPIC_NONE;
+    }
+    return static_cast<int>(touch_pad_num);
+}
+
+
+
+#endif // _TOUCH_PAD_CONFIG_HPP_
@@ -0,0 +1,197 @@
+// touch_pipeline.hpp
+
+#ifndef _TOUCH_PIPELINE_HPP_
+#define _TOUCH_PIPELINE_HPP_
+
+#include <cstdint>
+
+#include "filter_pipeline.hpp"
+#include "lane_mask.hpp"
+
+
+enum class TouchReadStyle : uint8_t {
+    FILTER_CALLBACK,    // the driver hands over the filtered values of all the pads, every filter period.
+    TIMER_CALLBACK,     // a timer job reads the smoothed value of each pad.
+};
+
+
+/*
+The chip families, as the touch pad pipeline sees them.
+ pad_count is TOUCH_PAD_MAX, and touch pad 0 is the denoise channel (never active).
+*/
+struct Esp32TouchTraits {
+    using ValueType = uint16_t;
+    using AccumulatorType = uint32_t;
+    static constexpr TouchReadStyle read_style = TouchReadStyle::FILTER_CALLBACK;
+    static constexpr unsigned pad_count = 10;
+};
+
+struct Esp32S2S3TouchTraits {
+    using ValueType = uint32_t;
+    using AccumulatorType = uint64_t;
+    static constexpr TouchReadStyle read_style = TouchReadStyle::TIMER_CALLBACK;
+    static constexpr unsigned pad_count = 15;
+};
+
+
+
+/*
+The touch pad sampling pipeline, from the raw reads to the values to publish:
+ 1. add_sample() reads every active pad, drops outliers with the 'OutlierStage' (if any),
+    e.g. a MedianStage, and accumulates the values.
+ 2. At the end of each averaging window (2^average_bits samples) the averages are ready,
+    and go through the 'Filters' (if any), e.g. an EmaStage or a KalmanStage.
+ 3. publish_changed() hands over the values that moved by more than the deadband, and counts them
+    (e.g. to adapt the sampling period, see adaptive_period.hpp).
+
+ - 'ChipTraits' is one of the traits above.
+ - 'fixed_pads' != 0 fixes the active pads at compile time: every loop is unrolled to exactly
+   those pads, and set_pads() has no effect. With 0 (the default) the active pads are set at
+   runtime (i.e. from the touch pad config), and the loops walk the set bits of a LaneMask.
+ - 'OutlierStage' is a filter stage (see filter_pipeline.hpp) applied to each sample, before the
+   averager. It starts over with each window.
+ - 'Filters' are filter stages applied to each window's averages.
+ - Both are templates of the frame type, e.g. MedianStage<Frame, 3> through an alias template.
+ - The stages run on one frame (see filter_pipeline.hpp): the reads of a sample are replaced by
+   the averages at the end of a window, so there is no copy between the averager and the filters.
+
+NOTE:
+ - NOT thread safe, it belongs to the sampler.
+ - get_averages() is only valid until the next add_sample(), which overwrites it with reads.
+ - Change the pads or the averaging window only at a window boundary, i.e. right after add_sample()
+   returned true. Otherwise the current window is discarded. New pads also reset the filters.
+*/
+template<class ChipTraits, LaneMask fixed_pads = 0, template<class> class OutlierStage = PassStage,
+         template<class> class... Filters>
+class TouchPipeline {
+public:
+    using ValueType = typename ChipTraits::ValueType;
+    using AccumulatorType = typename ChipTraits::AccumulatorType;
+    using Frame = FilterFrame<ValueType, ChipTraits::pad_count, fixed_pads>;
+    using ValueArrayType = typename Frame::ValueArrayType;
+
+    static constexpr TouchReadStyle read_style = ChipTraits::read_style;
+    static constexpr unsigned pad_count = ChipTraits::pad_count;
+    static constexpr LaneMask valid_pads = all_lanes(pad_count) & ~LaneMask(1);
+    static constexpr bool has_fixed_pads = (fixed_pads != 0);
+    static_assert((fixed_pads & ~valid_pads) == 0, "fixed_pads has touch pads that the chip does not have.");
+
+    using AverageStage = BlockAverageStage<Frame, AccumulatorType>;
+
+
+    // The other stages are default constructed, filter<index>() tunes the filters.
+    explicit TouchPipeline(unsigned average_bits)
+        : stages(OutlierStage<Frame>(), AverageStage(average_bits), Filters<Frame>()...)
+    { }
+
+    template<std::size_t index>
+    auto& filter() { return stages.template stage<index + 2>(); }
+
+
+    LaneMask get_pads() const { return frame.get_lanes(); }
+
+    // Returns the active pads, which are 'new_pads' unless they are fixed.
+    // The same pads again keep the filters as they are (e.g. after a resume from deep sleep).
+    LaneMask set_pads(LaneMask new_pads) {
+        if (!has_fixed_pads && (new_pads & valid_pads) != frame.lanes) {
+            frame.lanes = new_pads & valid_pads;
+            stages.reset();
+        }
+        return get_pads();
+    }
+
+    unsigned get_sample_size() const { return average_stage().get_sample_size(); }
+
+    void set_average_bits(unsigned average_bits) { average_stage().set_number_of_bits(average_bits); }
+
+
+    // Call 'function(pad)' for each active pad, in order.
+    template<class Function>
+    void for_each_pad(Function&& function) const {
+        frame.for_each(function);
+    }
+
+
+    /*
+    Accumulate one sample of every active pad, 'read(pad)' returns the value of 'pad'.
+    Returns true at the end of an averaging window, get_averages() then has the averages.
+    */
+    template<class Read>
+    bool add_sample(Read&& read) {
+        for_each_pad([&](unsigned pad) {
+            frame.values[pad] = read(pad);
+        });
+        if (!stages.process(frame)) {
+            return false;
+        }
+        // The next window may be a batch that starts much later (see app_touch_pads.cpp).
+        stages.template stage<0>().reset();
+        return true;
+    }
+
+    // Discard the samples of the window in progress, so the next add_sample() starts a new one.
+    // The filters and the published values are kept.
+    void restart_window() {
+        stages.template stage<0>().reset();
+        average_stage().reset();
+    }
+
+    // The filtered averages, only the values of the active pads are meaningful.
+    const ValueArrayType& get_averages() const { return frame.values; }
+
+
+    struct PublishCounts {
+        unsigned changed;       // active pads that moved by more than the deadband.
+        unsigned suppressed;    // active pads that did not move enough, and were not published.
+    };
+
+    /*
+    Call 'publish(pad, value, diff)' for each active pad whose average moved by more than 'deadband'
+     since it was last published, or for each active pad if 'force'.
+    'publish' returns false if the value could not be published, it is then published next time.
+    */
+    template<class Publish>
+    PublishCounts publish_changed(uint32_t deadband, bool force, Publish&& publish) {
+        PublishCounts counts {0, 0};
+        for_each_pad([&](unsigned pad) {
+            const ValueType value = frame.values[pad];
+            const ValueType diff = get_published_diff(pad);
+            const bool changed = diff > deadband;
+            counts.changed += changed;
+            if (force || changed) {
+                published[pad] = publish(pad, value, diff) ? value : 0;
+            } else {
+                ++counts.suppressed;
+            }
+        });
+        return counts;
+    }
+
+    // The number of active pads that publish_changed() would publish, without publishing them.
+    unsigned count_changed(uint32_t deadband) const {
+        unsigned changed = 0;
+        for_each_pad([&](unsigned pad) {
+            changed += get_published_diff(pad) > deadband;
+        });
+        return changed;
+    }
+
+
+private:
+    FilterPipeline<Frame, OutlierStage<Frame>, AverageStage, Filters<Frame>...> stages;
+    Frame frame;
+    ValueArrayType published {};
+
+    ValueType get_published_diff(unsigned pad) const {
+        const ValueType prior_value = published[pad];
+        const ValueType value = frame.values[pad];
+        return prior_value > value ? prior_value - value : value - prior_value;
+    }
+
+    AverageStage& average_stage() { return stages.template stage<1>(); }
+    const AverageStage& average_stage() const { return stages.template stage<1>(); }
+};
+
+
+
+#endif // _TOUCH_PIPELINE_HPP_